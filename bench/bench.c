@@ -0,0 +1,247 @@
+/*
+ * Benchmarks of the simulator.
+ *
+ *   bench_n<N> [micro|scale|all] [<min seconds>]
+ *
+ * micro times the hot kernels one call at a time: the hop kernel (calculate_next_frequency, permute,
+ * remap_channel), the channel map refresh (setChMapBasedOnQtable), update_q_table, calculate_reward and
+ * determine_packet_outcome. scale runs full episodes of N piconets for every channel count of
+ * gBenchChannels and every hopping mode. Every kernel and sweep point is repeated with twice the work
+ * until it takes <min seconds> (default 0.2).
+ *
+ * NUM_AGENTS sizes the agents at compile time, so the Makefile builds one binary per piconet count. Each
+ * result is one JSON line on stdout, with the git revision of the build, so that runs of two revisions
+ * can be compared line by line.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/afh.h"
+#include "../src/marl.h"
+#include "../src/marl_diffusion.h"
+#include "../src/physical_model.h"
+#include "harness.h"
+
+#ifndef BENCH_REV
+#define BENCH_REV "unknown"
+#endif
+#define BENCH_SEED DFH_SEED
+#define BENCH_INPUTS 4096 // Precomputed inputs per kernel, a power of two
+
+typedef void (*FP_BENCH_BODY)(int n);
+
+static const int gBenchChannels[] = {20, 40, 60, 79};
+
+static double gMinSeconds = 0.2;
+static volatile uint64_t gSink;
+
+static uint32_t gClk[BENCH_INPUTS];
+static uint8_t gZ[BENCH_INPUTS];
+static uint16_t gP[BENCH_INPUTS];
+static bool gFullMap[79];
+static bool gAfhMap[79];
+static q_value_t gQtable[NUM_CHANNELS + 1];
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * Kernels
+ */
+static void bench_hop_full(int n)
+{
+    uint64_t sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += calculate_next_frequency(bdAddr[k & 31], gClk[k & (BENCH_INPUTS - 1)], gFullMap, 79);
+    gSink += sum;
+}
+
+static void bench_hop_afh(int n)
+{
+    uint64_t sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += calculate_next_frequency(bdAddr[k & 31], gClk[k & (BENCH_INPUTS - 1)], gAfhMap, 20);
+    gSink += sum;
+}
+
+static void bench_permute(int n)
+{
+    uint64_t sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += permute(gZ[k & (BENCH_INPUTS - 1)], gP[k & (BENCH_INPUTS - 1)]);
+    gSink += sum;
+}
+
+static void bench_remap(int n)
+{
+    uint64_t sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += remap_channel(k % 79, gAfhMap, 20, gZ[k & (BENCH_INPUTS - 1)], gP[k & (BENCH_INPUTS - 1)] & 0x7F, k % 20, (k & 1) * 32);
+    gSink += sum;
+}
+
+static void bench_map_refresh(int n)
+{
+    bool chMap[79];
+    double sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += setChMapBasedOnQtable(chMap, gQtable, 20);
+    gSink += (uint64_t)(-sum);
+}
+
+static void bench_q_update(int n)
+{
+    Agent *agent = &gstAgents[1];
+
+    for (int k = 0; k < n; k++)
+    {
+        agent->last_channel = k % gNum_channels + 1;
+        update_q_table(agent, (k * 7) % gNum_channels + 1, -(double)(k & 1), k * 2);
+    }
+    gSink += agent->last_channel;
+}
+
+static void bench_reward(int n)
+{
+    double sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += calculate_reward(gstAgents, NUM_AGENTS, k % NUM_AGENTS + 1, k % gNum_channels + 1);
+    gSink += (uint64_t)(-sum);
+}
+
+static void bench_sinr_1(int n)
+{
+    static const int interferers[1] = {2};
+    uint64_t sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += determine_packet_outcome(1, 1, interferers, 1, gstAgents);
+    gSink += sum;
+}
+
+static void bench_sinr_3(int n)
+{
+    static const int interferers[3] = {2, 3, 4};
+    uint64_t sum = 0;
+
+    for (int k = 0; k < n; k++)
+        sum += determine_packet_outcome(1, 1, interferers, 3, gstAgents);
+    gSink += sum;
+}
+
+static void time_kernel(const char *pName, FP_BENCH_BODY body)
+{
+    double t0, seconds;
+    int n = 1024;
+
+    body(n); // Warm-up
+    for (;;)
+    {
+        t0 = now_seconds();
+        body(n);
+        seconds = now_seconds() - t0;
+        if (seconds >= gMinSeconds || n >= (1 << 30))
+            break;
+        n *= 2;
+    }
+
+    printf("{\"bench\":\"kernel\",\"rev\":\"%s\",\"name\":\"%s\",\"calls\":%d,\"seconds\":%.6f,\"ns_per_call\":%.3f}\n", BENCH_REV, pName, n, seconds, seconds * 1e9 / n);
+    fflush(stdout);
+}
+
+static void run_micro(void)
+{
+    srand(BENCH_SEED);
+    for (int k = 0; k < BENCH_INPUTS; k++)
+    {
+        gClk[k] = ((uint32_t)rand() << 1) & 0x0FFFFFFE;
+        gZ[k] = rand() & 0x1F;
+        gP[k] = rand() & 0x3FFF;
+    }
+    memset(gFullMap, 1, sizeof(gFullMap));
+    memset(gAfhMap, 0, sizeof(gAfhMap));
+    for (int k = 0; k < 20; k++)
+        gAfhMap[(k * 4) % 79] = true;
+    for (int k = 1; k <= NUM_CHANNELS; k++)
+        gQtable[k] = Q_STORE(-(double)(rand() % 1000) / 1000);
+
+    time_kernel("calculate_next_frequency/79", bench_hop_full);
+    time_kernel("calculate_next_frequency/20", bench_hop_afh);
+    time_kernel("permute", bench_permute);
+    time_kernel("remap_channel", bench_remap);
+
+    gNum_channels = NUM_CHANNELS;
+    time_kernel("setChMapBasedOnQtable", bench_map_refresh);
+
+    setup_piconets(NUM_AGENTS, BENCH_SEED);
+    set_sweep_point(MODE_DFH_RL, NUM_CHANNELS, 2);
+    initialize_agents(gstAgents, NUM_AGENTS);
+    time_kernel("update_q_table", bench_q_update);
+    time_kernel("calculate_reward", bench_reward);
+    time_kernel("determine_packet_outcome/1", bench_sinr_1);
+    time_kernel("determine_packet_outcome/3", bench_sinr_3);
+}
+
+/*
+ * Episodes
+ */
+static void run_scale(void)
+{
+    double t0, seconds;
+    int episodes;
+
+    for (int c = 0; c < (int)(sizeof(gBenchChannels) / sizeof(gBenchChannels[0])); c++)
+    {
+        for (int mode = MODE_LEGACY; mode < MODE_MAX; mode++)
+        {
+            for (episodes = 2;; episodes *= 2)
+            {
+                setup_piconets(NUM_AGENTS, BENCH_SEED);
+                set_sweep_point(mode, gBenchChannels[c], 2);
+                initialize_agents(gstAgents, NUM_AGENTS);
+
+                gRunEpisodes = episodes;
+                t0 = now_seconds();
+                run_simulation(gstAgents, NUM_AGENTS);
+                seconds = now_seconds() - t0;
+                if (seconds >= gMinSeconds || episodes >= MAX_EPISODES)
+                    break;
+            }
+            gRunEpisodes = 0;
+
+            printf("{\"bench\":\"episodes\",\"rev\":\"%s\",\"agents\":%d,\"channels\":%d,\"mode\":\"%s\",\"episodes\":%d,\"seconds\":%.6f,"
+                   "\"episodes_per_sec\":%.1f,\"slots_per_sec\":%.1f,\"hops_per_sec\":%.1f}\n",
+                   BENCH_REV, NUM_AGENTS, gBenchChannels[c], gModeNames[mode], episodes, seconds, episodes / seconds, 2 * episodes / seconds, (double)NUM_AGENTS * episodes / seconds);
+            fflush(stdout);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pWhat = (argc > 1) ? argv[1] : "all";
+
+    if (argc > 2)
+        gMinSeconds = atof(argv[2]);
+
+    if (strcmp(pWhat, "micro") == 0 || strcmp(pWhat, "all") == 0)
+        run_micro();
+    if (strcmp(pWhat, "scale") == 0 || strcmp(pWhat, "all") == 0)
+        run_scale();
+
+    return 0;
+}
@@ -0,0 +1,200 @@
+/*
+ * Golden runs.
+ *
+ *   golden record <file>    run the configurations of gGoldenConfigs and write their results
+ *   golden check <file>     run them again and compare with <file>
+ *   golden hops <file>      check the batch hop kernel against the scalar one on random hops and AFH
+ *                           maps, and both against the vectors of <file>
+ *
+ * Each configuration starts from setup_piconets() with a fixed seed, so two builds that make the same
+ * rand() draws in the same order produce the same lines. The results of a configuration are the
+ * per-agent collision counts, the heatmap of the hops over all episodes, and per agent a hash of its
+ * whole hop sequence with its first GOLDEN_HOPS hops. A build with an optimized engine (HOP_BATCH,
+ * FAST_FORWARD, LAZY_Q_DECAY, ...) is checked against a recording of the reference engine; the first
+ * mismatching lines of each configuration are printed.
+ *
+ * Needs DETERMINISTIC for the hop hook. The recording holds for the options it was made with: a
+ * build with WIFI or another PHYSICAL_MODE needs a file of its own. With WIFI, the collisions with the
+ * APs are recorded too, for the configurations of all 79 channels only: once WiFi is off, the AFH maps
+ * take back the channels of the WiFi bands whatever the number of channels.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/afh.h"
+#include "../src/marl.h"
+#include "../src/marl_diffusion.h"
+#include "harness.h"
+
+#ifndef DETERMINISTIC
+#error "bench/golden.c needs the hop hook of DETERMINISTIC."
+#endif
+
+#ifndef GOLDEN_EPISODES
+#define GOLDEN_EPISODES (PERTURBATION + 2000)
+#endif
+#define GOLDEN_HOPS 32 // Hops of each agent written out, besides the hash of all of them
+#define GOLDEN_LINE 4096
+#define GOLDEN_MAX_DIFFS 4 // Mismatching lines printed per configuration
+#define GOLDEN_HOP_CASES 100000 // Random hops of golden hops, batch against scalar kernel, besides the vectors
+
+typedef struct
+{
+    int mode;
+    int nc;
+    int hmax;
+} S_GOLDEN_CONFIG;
+
+static const S_GOLDEN_CONFIG gGoldenConfigs[] = {
+    {MODE_LEGACY, 20, 2},
+    {MODE_LEGACY, 79, 2},
+    {MODE_LEGACY_RL, 20, 2},
+    {MODE_LEGACY_RL, 79, 2},
+    {MODE_AFH, 40, 2},
+    {MODE_AFH, 79, 2},
+    {MODE_AFH_RL, 40, 2},
+    {MODE_AFH_RL, 79, 2},
+    {MODE_DFH_RL, 20, 2},
+    {MODE_DFH_RL, 79, 2},
+    {MODE_DFH_RL, 79, 5},
+};
+
+static uint64_t gHopHash[NUM_AGENTS + 1];
+static uint8_t gFirstHops[NUM_AGENTS + 1][GOLDEN_HOPS];
+static int gHeatmap[NUM_CHANNELS + 1];
+
+static void record_hop(int agent, int channel, int episode)
+{
+    // FNV-1a over the channels
+    gHopHash[agent] = (gHopHash[agent] ^ (uint64_t)channel) * 0x100000001B3ULL;
+    if (episode <= GOLDEN_HOPS)
+        gFirstHops[agent][episode - 1] = channel;
+    gHeatmap[channel]++;
+}
+
+static FILE *open_file(const char *pPath, const char *pMode)
+{
+    FILE *fp = fopen(pPath, pMode);
+
+    if (fp == NULL)
+    {
+        printf("golden: can't open %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    return fp;
+}
+
+// Compares a line of the current run with the next line of the recording, or writes it when recording.
+static int emit(FILE *fp, bool bRecord, const char *pConfig, const char *pLine, int *pNumOfDiffs)
+{
+    char expected[GOLDEN_LINE];
+
+    if (bRecord)
+    {
+        fprintf(fp, "%s\n", pLine);
+        return 0;
+    }
+    if (fgets(expected, sizeof(expected), fp) == NULL)
+        expected[0] = '\0';
+    expected[strcspn(expected, "\r\n")] = '\0';
+    if (strcmp(expected, pLine) == 0)
+        return 0;
+
+    if (*pNumOfDiffs < GOLDEN_MAX_DIFFS)
+        printf("%s\n  expected: %.200s\n  actual:   %.200s\n", pConfig, expected, pLine);
+    (*pNumOfDiffs)++;
+    return 1;
+}
+
+static int run_config(FILE *fp, bool bRecord, const S_GOLDEN_CONFIG *pConfig)
+{
+    char config[128], line[GOLDEN_LINE];
+    int numOfDiffs = 0;
+    int len;
+
+    memset(gHopHash, 0, sizeof(gHopHash));
+    for (int i = 1; i <= NUM_AGENTS; i++)
+        gHopHash[i] = 0xCBF29CE484222325ULL;
+    memset(gFirstHops, 0, sizeof(gFirstHops));
+    memset(gHeatmap, 0, sizeof(gHeatmap));
+
+    setup_piconets(NUM_AGENTS, DFH_SEED);
+    set_sweep_point(pConfig->mode, pConfig->nc, pConfig->hmax);
+    initialize_agents(gstAgents, NUM_AGENTS);
+    gRunEpisodes = GOLDEN_EPISODES;
+    gpfHopHook = record_hop;
+    run_simulation(gstAgents, NUM_AGENTS);
+    gpfHopHook = NULL;
+    gRunEpisodes = 0;
+
+    snprintf(config, sizeof(config), "config %s nc %d na %d hmax %d episodes %d seed %d", gModeNames[pConfig->mode], pConfig->nc, NUM_AGENTS, pConfig->hmax, GOLDEN_EPISODES, DFH_SEED);
+    emit(fp, bRecord, config, config, &numOfDiffs);
+
+    len = sprintf(line, "collisions");
+    for (int i = 1; i <= NUM_AGENTS; i++)
+        len += sprintf(line + len, " %d", total_collisions[i]);
+    emit(fp, bRecord, config, line, &numOfDiffs);
+#ifdef WIFI
+    len = sprintf(line, "wifi");
+    for (int i = 1; i <= NUM_AGENTS; i++)
+        len += sprintf(line + len, " %d", total_wifi_collisions[i]);
+    emit(fp, bRecord, config, line, &numOfDiffs);
+#endif
+
+    len = sprintf(line, "heatmap");
+    for (int ch = 1; ch <= pConfig->nc; ch++)
+        len += sprintf(line + len, " %d", gHeatmap[ch]);
+    emit(fp, bRecord, config, line, &numOfDiffs);
+
+    for (int i = 1; i <= NUM_AGENTS; i++)
+    {
+        len = sprintf(line, "hops %d %016llx", i, (unsigned long long)gHopHash[i]);
+        for (int k = 0; k < GOLDEN_HOPS; k++)
+            len += sprintf(line + len, " %d", gFirstHops[i][k]);
+        emit(fp, bRecord, config, line, &numOfDiffs);
+    }
+
+    return numOfDiffs;
+}
+
+int main(int argc, char *argv[])
+{
+    int numOfConfigs = sizeof(gGoldenConfigs) / sizeof(gGoldenConfigs[0]);
+    int numOfFailed = 0;
+    bool bRecord;
+    FILE *fp;
+
+    if (argc != 3 || (strcmp(argv[1], "record") != 0 && strcmp(argv[1], "check") != 0 && strcmp(argv[1], "hops") != 0))
+    {
+        printf("usage: golden record|check|hops <file>\n");
+        return 2;
+    }
+    if (strcmp(argv[1], "hops") == 0)
+        return hop_batch_selftest(GOLDEN_HOP_CASES, argv[2]) ? 1 : 0;
+    bRecord = (strcmp(argv[1], "record") == 0);
+    fp = open_file(argv[2], bRecord ? "w" : "r");
+
+    for (int c = 0, n = numOfConfigs; c < n; c++)
+    {
+#ifdef WIFI
+        if (gGoldenConfigs[c].nc < NUM_CHANNELS)
+        {
+            numOfConfigs--;
+            continue;
+        }
+#endif
+        if (run_config(fp, bRecord, &gGoldenConfigs[c]) > 0)
+            numOfFailed++;
+    }
+    fclose(fp);
+
+    if (bRecord)
+    {
+        printf("golden: recorded %d configurations in %s\n", numOfConfigs, argv[2]);
+        return 0;
+    }
+    printf("golden: %d of %d configurations match %s\n", numOfConfigs - numOfFailed, numOfConfigs, argv[2]);
+    return numOfFailed ? 1 : 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * Shared by the programs of bench/, which link the simulator built with DFH_NO_MAIN and drive
+ * run_simulation() directly instead of going through marl_main().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/afh.h"
+#include "../src/marl.h"
+#include "../src/marl_diffusion.h"
+#include "../src/physical_model.h"
+#include "harness.h"
+
+const char *gModeNames[MODE_MAX] = {"LFH", "LFH_RL", "AFH", "AFH_RL", "DFH_RL"};
@@ -0,0 +1,34 @@
+/*
+ * harness.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef HARNESS_H_
+#define HARNESS_H_
+
+// Not in the headers of the simulator.
+extern uint8_t permute(uint8_t Z, uint16_t P);
+extern uint8_t remap_channel(uint8_t fk, bool *channel_map, uint8_t num_used_channels, uint8_t perm5_out, uint8_t E, uint8_t F_prime, uint8_t Y2);
+extern double setChMapBasedOnQtable(bool *pChMap, q_value_t *pQtable, int noOfUsedCh);
+extern void update_q_table(Agent *agent, int action, double reward, int current_time);
+extern double calculate_reward(Agent agents[], int num_agents, int agent_id, int next_channel);
+extern void initialize_agents(Agent agents[], int num_agents);
+extern void run_simulation(Agent agents[], int num_agents);
+extern void setup_piconets(int na, unsigned int seed);
+extern void set_sweep_point(int mode, int nc, int hmax);
+
+extern DFH_TLS Agent gstAgents[NUM_AGENTS + 1];
+extern uint64_t bdAddr[56];
+extern DFH_TLS int HMAX;
+extern DFH_TLS int gNum_channels;
+extern DFH_TLS int gModeDefault;
+extern DFH_TLS int gNumOfAvailCh;
+extern DFH_TLS int gRunEpisodes;
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+extern DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+
+extern const char *gModeNames[MODE_MAX];
+
+#endif /* HARNESS_H_ */
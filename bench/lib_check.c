@@ -0,0 +1,162 @@
+/*
+ * Checks libdfh against a recording of bench/golden.c.
+ *
+ *   lib_check <golden file>
+ *
+ * Every configuration of the recording runs in a handle of its own, all of them at the same time from
+ * one thread each. Every other configuration is stepped LIB_CHECK_STEP episodes at a time instead of
+ * run in one call. The collision counts of each handle must be those of the recording: handles that
+ * shared any state, or steps that did not add up to a run, would not give them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "../src/dfh.h"
+
+#define LIB_CHECK_MAX_CONFIGS 64
+#define LIB_CHECK_MAX_AGENTS 256
+#define LIB_CHECK_STEP 500
+#define LIB_CHECK_LINE 4096
+
+typedef struct
+{
+    char name[128];
+    S_DFH_CONFIG stConfig;
+    bool bStepped;
+    int expected[LIB_CHECK_MAX_AGENTS + 1];
+    int actual[LIB_CHECK_MAX_AGENTS + 1];
+    double pcol;
+    int ret;
+} S_LIB_CHECK;
+
+static const char *gModeNames[] = {"LFH", "LFH_RL", "AFH", "AFH_RL", "DFH_RL"};
+
+static S_LIB_CHECK gChecks[LIB_CHECK_MAX_CONFIGS];
+
+static void *run_check(void *pArg)
+{
+    S_LIB_CHECK *pCheck = pArg;
+    S_DFH_SIM *pSim = dfh_create();
+    S_DFH_RESULT stResult;
+
+    if (pSim == NULL)
+    {
+        pCheck->ret = DFH_ERR_STATE;
+        return NULL;
+    }
+    pCheck->ret = dfh_configure(pSim, &pCheck->stConfig);
+    if (pCheck->ret == DFH_OK)
+    {
+        if (pCheck->bStepped)
+        {
+            while (dfh_step(pSim, LIB_CHECK_STEP) > 0)
+                ;
+        }
+        else
+            dfh_run(pSim);
+        pCheck->ret = dfh_collect(pSim, &stResult);
+        for (int i = 1; i <= stResult.numOfAgents; i++)
+            pCheck->actual[i] = stResult.pCollisions[i];
+        pCheck->pcol = stResult.pcol;
+    }
+    dfh_destroy(pSim);
+    return NULL;
+}
+
+// Reads the config line and the collisions line of each configuration.
+static int read_golden(const char *pPath)
+{
+    char line[LIB_CHECK_LINE], mode[32];
+    S_LIB_CHECK *pCheck;
+    S_DFH_CONFIG *pConfig;
+    int numOfChecks = 0;
+    char *p;
+    FILE *fp = fopen(pPath, "r");
+
+    if (fp == NULL)
+    {
+        printf("lib_check: can't open %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL && numOfChecks < LIB_CHECK_MAX_CONFIGS)
+    {
+        pCheck = &gChecks[numOfChecks];
+        pConfig = &(pCheck->stConfig);
+        if (sscanf(line, "config %31s nc %d na %d hmax %d episodes %d seed %u", mode, &pConfig->numOfChannels, &pConfig->numOfAgents, &pConfig->hmax, &pConfig->episodes, &pConfig->seed) != 6)
+            continue;
+        if (pConfig->numOfAgents > LIB_CHECK_MAX_AGENTS)
+        {
+            printf("lib_check: %d agents in %s. Exiting.\n", pConfig->numOfAgents, pPath);
+            exit(777);
+        }
+        line[strcspn(line, "\r\n")] = '\0';
+        snprintf(pCheck->name, sizeof(pCheck->name), "%.127s", line);
+
+        pConfig->mode = -1;
+        for (int m = 0; m < (int)(sizeof(gModeNames) / sizeof(gModeNames[0])); m++)
+        {
+            if (strcmp(mode, gModeNames[m]) == 0)
+                pConfig->mode = m;
+        }
+
+        if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, "collisions", 10) != 0)
+        {
+            printf("lib_check: no collisions after \"%s\". Exiting.\n", pCheck->name);
+            exit(777);
+        }
+        p = line + 10;
+        for (int i = 1; i <= pConfig->numOfAgents; i++)
+            pCheck->expected[i] = strtol(p, &p, 10);
+
+        pCheck->bStepped = (numOfChecks % 2 == 1);
+        numOfChecks++;
+    }
+    fclose(fp);
+    return numOfChecks;
+}
+
+int main(int argc, char *argv[])
+{
+    pthread_t threads[LIB_CHECK_MAX_CONFIGS];
+    int numOfChecks, numOfFailed = 0;
+    S_LIB_CHECK *pCheck;
+
+    if (argc != 2)
+    {
+        printf("usage: lib_check <golden file>\n");
+        return 2;
+    }
+    numOfChecks = read_golden(argv[1]);
+
+    for (int c = 0; c < numOfChecks; c++)
+        pthread_create(&threads[c], NULL, run_check, &gChecks[c]);
+    for (int c = 0; c < numOfChecks; c++)
+        pthread_join(threads[c], NULL);
+
+    for (int c = 0; c < numOfChecks; c++)
+    {
+        pCheck = &gChecks[c];
+        if (pCheck->ret != DFH_OK)
+        {
+            printf("%s: error %d\n", pCheck->name, pCheck->ret);
+            numOfFailed++;
+            continue;
+        }
+        if (memcmp(&pCheck->expected[1], &pCheck->actual[1], pCheck->stConfig.numOfAgents * sizeof(int)) != 0)
+        {
+            printf("%s%s: collisions differ\n  expected:", pCheck->name, pCheck->bStepped ? " (stepped)" : "");
+            for (int i = 1; i <= pCheck->stConfig.numOfAgents; i++)
+                printf(" %d", pCheck->expected[i]);
+            printf("\n  actual:  ");
+            for (int i = 1; i <= pCheck->stConfig.numOfAgents; i++)
+                printf(" %d", pCheck->actual[i]);
+            printf("\n");
+            numOfFailed++;
+        }
+    }
+    printf("lib_check: %d of %d configurations match %s\n", numOfChecks - numOfFailed, numOfChecks, argv[1]);
+    return numOfFailed ? 1 : 0;
+}
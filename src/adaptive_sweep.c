@@ -0,0 +1,515 @@
+/*
+ * Adaptive refinement of the (piconets x channels) sweep of marl_main.
+ *
+ * Instead of every na and every tenth nc, the sweep starts from a coarse grid and only splits the
+ * intervals where the pcol surface is not flat. A sweep point runs every mode as the mode loop of
+ * marl_main does (DFH-RL with HMAX 5, 3 and 2). Along a row of fixed na, the interval between two
+ * channel counts is split at its middle when, for some mode, one of its ends lies off the straight line
+ * through its neighbours by more than ADAPTIVE_TOL (curvature), or when two modes swap ranks across it by
+ * more than ADAPTIVE_TOL (crossover). Rows are refined the same way along na on the coarse channel
+ * counts, which every row has; a new row is then refined along nc. No interval is split below the steps
+ * ADAPTIVE_FINE_NA and ADAPTIVE_FINE_NC.
+ *
+ * adaptive_sweep_run() runs all the points first. marl_main then walks the points row by row and loads
+ * each result with adaptive_sweep_load_result(), so pcol keeps its format with the channel counts of
+ * each row in ascending order. With RESULT_CACHE, the modes of a point already in the cache are loaded
+ * from it instead of run.
+ *
+ * With ADAPTIVE_FIDELITY, the points of the full grid (steps ADAPTIVE_FINE_NA and ADAPTIVE_FINE_NC) that
+ * the refinement skipped are run as well, on the side, and compared with the surface marl_main would
+ * otherwise stand in for them: linear along nc within the rows, then along na between the rows around.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "adaptive_sweep.h"
+#include "result_cache.h"
+#include "live_stats.h"
+
+#ifdef ADAPTIVE_SWEEP
+
+#ifdef DIFFUSIVE
+#error "ADAPTIVE_SWEEP refines the sweep of the non-DIFFUSIVE loops of marl_main. Disable DIFFUSIVE."
+#endif
+#ifdef SWEEP_SCHEDULER
+#error "ADAPTIVE_SWEEP chooses the sweep points as it runs them. Disable SWEEP_SCHEDULER."
+#endif
+#if defined(CH_MAP_SIZE) || defined(HEATMAP) || defined(TRAFFIC) || defined(SYNC_SLOT_COMPARE)
+#error "ADAPTIVE_SWEEP only keeps the collision totals of a mode. Disable CH_MAP_SIZE, HEATMAP, TRAFFIC and SYNC_SLOT_COMPARE."
+#endif
+
+#define ADAPTIVE_MAX_VARIANTS (MODE_MAX + 2) // DFH-RL runs with three HMAX.
+
+extern DFH_TLS int HMAX;
+extern DFH_TLS int gNum_channels;
+extern DFH_TLS int gNumOfAvailCh;
+extern DFH_TLS int gModeDefault;
+extern DFH_TLS int num_diff;
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+extern DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+extern DFH_TLS Agent gstAgents[NUM_AGENTS + 1];
+extern void initialize_agents(Agent agents[], int num_agents);
+extern void run_simulation(Agent agents[], int num_agents);
+extern void next_sweep_variant(void);
+
+typedef struct
+{
+    int mode;
+    int hmax;
+    double pcol;
+    int *pCollisions; // total_collisions of agents 1..na
+    int *pWifiCollisions;
+} S_ADAPTIVE_VARIANT;
+
+typedef struct
+{
+    int na;
+    int nc;
+    int numOfVariants;
+    S_ADAPTIVE_VARIANT stVariants[ADAPTIVE_MAX_VARIANTS];
+} S_ADAPTIVE_POINT;
+
+static S_ADAPTIVE_POINT *gpAdaptivePoints;
+static int gNumOfAdaptivePoints;
+static double gAdaptiveTol;
+
+static S_ADAPTIVE_POINT *find_point(int na, int nc)
+{
+    for (int p = 0; p < gNumOfAdaptivePoints; p++)
+    {
+        if (gpAdaptivePoints[p].na == na && gpAdaptivePoints[p].nc == nc)
+            return &gpAdaptivePoints[p];
+    }
+    return NULL;
+}
+
+static int *copy_counts(const int *pCounts, int na)
+{
+    int *pCopy = malloc((na + 1) * sizeof(int));
+
+    if (pCopy == NULL)
+    {
+        printf("adaptive: out of memory. Exiting.\n");
+        exit(777);
+    }
+    memcpy(pCopy, pCounts, (na + 1) * sizeof(int));
+    return pCopy;
+}
+
+// Runs every mode at (na, nc) into pPoint.
+static void run_modes(S_ADAPTIVE_POINT *pPoint, int na, int nc)
+{
+    S_ADAPTIVE_VARIANT *pVariant;
+    long long sum;
+
+    pPoint->na = na;
+    pPoint->nc = nc;
+    pPoint->numOfVariants = 0;
+
+    // The mode loop of marl_main. Starting from HMAX 5, every point runs DFH-RL with HMAX 5, 3 and 2.
+    gNum_channels = nc;
+    num_diff = 0;
+    HMAX = 5;
+    for (gModeDefault = MODE_LEGACY; gModeDefault < MODE_DFH_RL + 1; gModeDefault++)
+    {
+        if (gModeDefault == MODE_AFH || gModeDefault == MODE_AFH_RL)
+            gNumOfAvailCh = 20;
+        else
+            gNumOfAvailCh = (nc < 79) ? nc : 79;
+
+#ifdef LIVE_STATS
+        live_stats_point(na, nc);
+#endif
+#ifdef RESULT_CACHE
+        if (!result_cache_load(na, nc))
+        {
+            initialize_agents(gstAgents, na);
+            run_simulation(gstAgents, na);
+            result_cache_store(na);
+        }
+#else
+        initialize_agents(gstAgents, na);
+        run_simulation(gstAgents, na);
+#endif
+
+        pVariant = &(pPoint->stVariants[pPoint->numOfVariants++]);
+        pVariant->mode = gModeDefault;
+        pVariant->hmax = HMAX;
+        pVariant->pCollisions = copy_counts(total_collisions, na);
+        pVariant->pWifiCollisions = copy_counts(total_wifi_collisions, na);
+        sum = 0;
+        for (int i = 1; i <= na; i++)
+            sum += total_collisions[i];
+        pVariant->pcol = sum * 1.0 / na / (MAX_EPISODES - PERTURBATION);
+#ifdef LIVE_STATS
+        live_stats_point_done(pVariant->pcol);
+#endif
+
+        next_sweep_variant();
+    }
+}
+
+// Runs every mode at (na, nc), unless the point has been run already.
+static void run_point(int na, int nc)
+{
+    if (find_point(na, nc) != NULL)
+        return;
+    run_modes(&gpAdaptivePoints[gNumOfAdaptivePoints++], na, nc);
+    printf("adaptive: na %d nc %d (%d points)\n", na, nc, gNumOfAdaptivePoints);
+    fflush(stdout);
+}
+
+// Channel counts of the coarse grid, ascending.
+static int coarse_ncs(int *pNc)
+{
+    int n = 0;
+
+    for (int nc = 20; nc <= 79; nc += ADAPTIVE_COARSE_NC)
+        pNc[n++] = nc;
+    if (pNc[n - 1] != 79)
+        pNc[n++] = 79;
+    return n;
+}
+
+static int compare_int(const void *pA, const void *pB)
+{
+    return *(const int *)pA - *(const int *)pB;
+}
+
+// Piconet counts of the rows, ascending.
+static int row_nas(int *pNa)
+{
+    int n = 0;
+    bool bNew;
+
+    for (int p = 0; p < gNumOfAdaptivePoints; p++)
+    {
+        bNew = true;
+        for (int k = 0; k < n && bNew; k++)
+            bNew = (pNa[k] != gpAdaptivePoints[p].na);
+        if (bNew)
+            pNa[n++] = gpAdaptivePoints[p].na;
+    }
+    qsort(pNa, n, sizeof(int), compare_int);
+    return n;
+}
+
+// Channel counts run in the row of na, ascending.
+static int row_ncs(int na, int *pNc)
+{
+    int n = 0;
+
+    for (int p = 0; p < gNumOfAdaptivePoints; p++)
+    {
+        if (gpAdaptivePoints[p].na == na)
+            pNc[n++] = gpAdaptivePoints[p].nc;
+    }
+    qsort(pNc, n, sizeof(int), compare_int);
+    return n;
+}
+
+// How far the pcol of some mode at pB is off the straight line through pA and pC.
+static double bend(const S_ADAPTIVE_POINT *pA, int xA, const S_ADAPTIVE_POINT *pB, int xB, const S_ADAPTIVE_POINT *pC, int xC)
+{
+    double line, err = 0;
+
+    for (int v = 0; v < pB->numOfVariants; v++)
+    {
+        line = pA->stVariants[v].pcol + (pC->stVariants[v].pcol - pA->stVariants[v].pcol) * (xB - xA) / (xC - xA);
+        err = fmax(err, fabs(pB->stVariants[v].pcol - line));
+    }
+    return err;
+}
+
+// Largest pcol difference of two modes that are ranked one way at pA and the other at pB, the smaller of
+// the two ends. Near ties that swap back and forth are noise.
+static double crossover(const S_ADAPTIVE_POINT *pA, const S_ADAPTIVE_POINT *pB)
+{
+    double dA, dB, err = 0;
+
+    for (int i = 0; i < pA->numOfVariants; i++)
+    {
+        for (int j = i + 1; j < pA->numOfVariants; j++)
+        {
+            dA = pA->stVariants[i].pcol - pA->stVariants[j].pcol;
+            dB = pB->stVariants[i].pcol - pB->stVariants[j].pcol;
+            if (dA * dB < 0)
+                err = fmax(err, fmin(fabs(dA), fabs(dB)));
+        }
+    }
+    return err;
+}
+
+// Error of the interval between points k and k + 1 of a row or column of n points at x[].
+static double interval_error(S_ADAPTIVE_POINT **ppLine, const int *x, int n, int k)
+{
+    double err = crossover(ppLine[k], ppLine[k + 1]);
+
+    if (k > 0)
+        err = fmax(err, bend(ppLine[k - 1], x[k - 1], ppLine[k], x[k], ppLine[k + 1], x[k + 1]));
+    if (k + 2 < n)
+        err = fmax(err, bend(ppLine[k], x[k], ppLine[k + 1], x[k + 1], ppLine[k + 2], x[k + 2]));
+    return err;
+}
+
+static void refine_row(int na)
+{
+    S_ADAPTIVE_POINT *pLine[NUM_CHANNELS + 1];
+    int nc[NUM_CHANNELS + 1];
+    bool bSplit;
+    int n;
+
+    do
+    {
+        n = row_ncs(na, nc);
+        for (int k = 0; k < n; k++)
+            pLine[k] = find_point(na, nc[k]);
+
+        bSplit = false;
+        for (int k = 0; k + 1 < n && gNumOfAdaptivePoints < ADAPTIVE_MAX_POINTS; k++)
+        {
+            if (nc[k + 1] - nc[k] >= 2 * ADAPTIVE_FINE_NC && interval_error(pLine, nc, n, k) > gAdaptiveTol)
+            {
+                run_point(na, (nc[k] + nc[k + 1]) / 2);
+                bSplit = true;
+            }
+        }
+    } while (bSplit);
+}
+
+// Runs the coarse channel counts of a new row, then refines it. false when there is no room left.
+static bool add_row(int na)
+{
+    int nc[NUM_CHANNELS + 1];
+    int n = coarse_ncs(nc);
+
+    if (gNumOfAdaptivePoints + n > ADAPTIVE_MAX_POINTS)
+        return false;
+    for (int k = 0; k < n; k++)
+        run_point(na, nc[k]);
+    refine_row(na);
+    return true;
+}
+
+static void refine_rows(void)
+{
+    static S_ADAPTIVE_POINT *pColumn[NUM_AGENTS + 1];
+    static int na[NUM_AGENTS + 1];
+    int nc[NUM_CHANNELS + 1];
+    int numOfNc = coarse_ncs(nc);
+    bool bSplit;
+    double err;
+    int n;
+
+    do
+    {
+        n = row_nas(na);
+        bSplit = false;
+        for (int k = 0; k + 1 < n; k++)
+        {
+            if (na[k + 1] - na[k] < 2 * ADAPTIVE_FINE_NA)
+                continue;
+
+            // The coarse channel counts are on every row.
+            err = 0;
+            for (int c = 0; c < numOfNc; c++)
+            {
+                for (int j = 0; j < n; j++)
+                    pColumn[j] = find_point(na[j], nc[c]);
+                err = fmax(err, interval_error(pColumn, na, n, k));
+            }
+            if (err > gAdaptiveTol && add_row((na[k] + na[k + 1]) / 2))
+                bSplit = true;
+        }
+    } while (bSplit);
+}
+
+// Values from first to last in steps, and last.
+static int grid_size(int first, int last, int step)
+{
+    return (last - first) / step + 1 + ((last - first) % step != 0);
+}
+
+#ifdef ADAPTIVE_FIDELITY
+// Index k of the interval x[k] <= v <= x[k + 1] of n ascending values.
+static int find_interval(const int *x, int n, int v)
+{
+    int k = 0;
+
+    while (k + 2 < n && x[k + 1] < v)
+        k++;
+    return k;
+}
+
+// pcol of variant v at nc, linear between the channel counts of the row of na around it.
+static double row_pcol(int na, int nc, int v)
+{
+    int ncs[NUM_CHANNELS + 1];
+    int n = row_ncs(na, ncs);
+    int k = find_interval(ncs, n, nc);
+    double a = find_point(na, ncs[k])->stVariants[v].pcol;
+    double b = find_point(na, ncs[k + 1])->stVariants[v].pcol;
+
+    return a + (b - a) * (nc - ncs[k]) / (ncs[k + 1] - ncs[k]);
+}
+
+// pcol of variant v at (na, nc) on the surface of the points run.
+static double surface_pcol(int na, int nc, int v)
+{
+    int nas[NUM_AGENTS + 1];
+    int n = row_nas(nas);
+    int k = find_interval(nas, n, na);
+    double a, b;
+
+    if (n == 1)
+        return row_pcol(nas[0], nc, v);
+    a = row_pcol(nas[k], nc, v);
+    b = row_pcol(nas[k + 1], nc, v);
+    return a + (b - a) * (na - nas[k]) / (nas[k + 1] - nas[k]);
+}
+
+// Runs the full grid points that were not run and prints the largest and mean error of the surface at
+// them, per mode, over the whole grid (the points run count with no error).
+static void measure_fidelity(void)
+{
+    S_ADAPTIVE_POINT stPoint = {0};
+    double maxErr[ADAPTIVE_MAX_VARIANTS] = {0}, sumErr[ADAPTIVE_MAX_VARIANTS] = {0};
+    int worstNa[ADAPTIVE_MAX_VARIANTS] = {0}, worstNc[ADAPTIVE_MAX_VARIANTS] = {0};
+    int numOfPoints = 0, numOfRun = 0, numOfVariants = gpAdaptivePoints[0].numOfVariants;
+    double err;
+
+    for (int na = 10;; na += ADAPTIVE_FINE_NA)
+    {
+        if (na > NUM_AGENTS)
+            na = NUM_AGENTS;
+        for (int nc = 20;; nc += ADAPTIVE_FINE_NC)
+        {
+            if (nc > 79)
+                nc = 79;
+            numOfPoints++;
+            if (find_point(na, nc) == NULL)
+            {
+                run_modes(&stPoint, na, nc);
+                numOfRun++;
+                for (int v = 0; v < numOfVariants; v++)
+                {
+                    err = fabs(stPoint.stVariants[v].pcol - surface_pcol(na, nc, v));
+                    sumErr[v] += err;
+                    if (err > maxErr[v])
+                    {
+                        maxErr[v] = err;
+                        worstNa[v] = na;
+                        worstNc[v] = nc;
+                    }
+                    free(stPoint.stVariants[v].pCollisions);
+                    free(stPoint.stVariants[v].pWifiCollisions);
+                }
+            }
+            if (nc == 79)
+                break;
+        }
+        if (na == NUM_AGENTS)
+            break;
+    }
+
+    printf("adaptive: fidelity over the %d points of the full grid, %d of them interpolated (tolerance %.4f)\n", numOfPoints, numOfRun, gAdaptiveTol);
+    for (int v = 0; v < numOfVariants; v++)
+    {
+        printf("adaptive: M%d hmax%d max error %.4f (na %d nc %d) mean error %.4f\n", gpAdaptivePoints[0].stVariants[v].mode,
+               gpAdaptivePoints[0].stVariants[v].hmax, maxErr[v], worstNa[v], worstNc[v], sumErr[v] / numOfPoints);
+    }
+    fflush(stdout);
+}
+#endif
+
+void adaptive_sweep_run(void)
+{
+    int step = ADAPTIVE_COARSE_NA;
+
+    gpAdaptivePoints = calloc(ADAPTIVE_MAX_POINTS, sizeof(S_ADAPTIVE_POINT));
+    if (gpAdaptivePoints == NULL)
+    {
+        printf("adaptive: out of memory. Exiting.\n");
+        exit(777);
+    }
+    gNumOfAdaptivePoints = 0;
+    // Short runs are noisy: ADAPTIVE_NOISE standard errors of the pcol of 10 piconets at pcol 0.5.
+    gAdaptiveTol = fmax(ADAPTIVE_TOL, ADAPTIVE_NOISE * sqrt(0.25 / (10.0 * (MAX_EPISODES - PERTURBATION))));
+
+    // At least three rows, or the bends along na can't be seen.
+    if (NUM_AGENTS - 10 < 2 * step)
+        step = (NUM_AGENTS - 10) / 2;
+    if (step < 1)
+        step = 1;
+    for (int na = 10;; na += step)
+    {
+        if (na > NUM_AGENTS)
+            na = NUM_AGENTS;
+        add_row(na);
+        if (na == NUM_AGENTS)
+            break;
+    }
+    refine_rows();
+
+    printf("adaptive: %d sweep points run, %d in the full grid of na step %d and nc step %d (tolerance %.4f)\n", gNumOfAdaptivePoints,
+           grid_size(10, NUM_AGENTS, ADAPTIVE_FINE_NA) * grid_size(20, 79, ADAPTIVE_FINE_NC), ADAPTIVE_FINE_NA, ADAPTIVE_FINE_NC, gAdaptiveTol);
+#ifdef ADAPTIVE_FIDELITY
+    measure_fidelity();
+#endif
+}
+
+// Next row after na (0 for the first), 0 after the last.
+int adaptive_sweep_next_na(int na)
+{
+    int next = 0;
+
+    for (int p = 0; p < gNumOfAdaptivePoints; p++)
+    {
+        if (gpAdaptivePoints[p].na > na && (next == 0 || gpAdaptivePoints[p].na < next))
+            next = gpAdaptivePoints[p].na;
+    }
+    return next;
+}
+
+// Next channel count of the row of na after nc (0 for the first), 0 after the last.
+int adaptive_sweep_next_nc(int na, int nc)
+{
+    int next = 0;
+
+    for (int p = 0; p < gNumOfAdaptivePoints; p++)
+    {
+        if (gpAdaptivePoints[p].na == na && gpAdaptivePoints[p].nc > nc && (next == 0 || gpAdaptivePoints[p].nc < next))
+            next = gpAdaptivePoints[p].nc;
+    }
+    return next;
+}
+
+// Loads the totals of gModeDefault (and HMAX for DFH-RL) at (na, nc) as run_simulation() left them.
+void adaptive_sweep_load_result(int na, int nc)
+{
+    S_ADAPTIVE_POINT *pPoint = find_point(na, nc);
+    S_ADAPTIVE_VARIANT *pVariant;
+
+    for (int v = 0; pPoint != NULL && v < pPoint->numOfVariants; v++)
+    {
+        pVariant = &(pPoint->stVariants[v]);
+        if (pVariant->mode == gModeDefault && (gModeDefault != MODE_DFH_RL || pVariant->hmax == HMAX))
+        {
+            memset(total_collisions, 0, sizeof(total_collisions));
+            memset(total_wifi_collisions, 0, sizeof(total_wifi_collisions));
+            memcpy(total_collisions, pVariant->pCollisions, (na + 1) * sizeof(int));
+            memcpy(total_wifi_collisions, pVariant->pWifiCollisions, (na + 1) * sizeof(int));
+            return;
+        }
+    }
+    printf("adaptive: no result for na %d nc %d M%d hmax%d. Exiting.\n", na, nc, gModeDefault, HMAX);
+    exit(777);
+}
+
+#endif /* ADAPTIVE_SWEEP */
@@ -0,0 +1,35 @@
+/*
+ * adaptive_sweep.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef ADAPTIVE_SWEEP_H_
+#define ADAPTIVE_SWEEP_H_
+
+// Coarse grid of the first runs. The last channel count (79) and NUM_AGENTS are always on it.
+#define ADAPTIVE_COARSE_NC 20
+#define ADAPTIVE_COARSE_NA 10
+// Finest steps of the refinement, those of the full grid the refinement stands in for.
+#define ADAPTIVE_FINE_NC 5
+#define ADAPTIVE_FINE_NA 1
+// An interval is split when the pcol of a mode is off the straight line through its neighbours by more
+// than this, or when two modes swap ranks across it by more than this. Against the 143 points of the
+// full grid (ADAPTIVE_FIDELITY, NUM_AGENTS 20, MAX_EPISODES, DETERMINISTIC), the largest error of the
+// surface over the modes was 0.017 at 0.01 (124 points run), 0.020 at 0.02 (46) and 0.031 at 0.04 (18),
+// and the mean error 0.0010, 0.0034 and 0.0059.
+#ifndef ADAPTIVE_TOL
+#define ADAPTIVE_TOL 0.02
+#endif
+// The tolerance is at least this many standard errors of a pcol, for short runs (MAX_EPISODES).
+#define ADAPTIVE_NOISE 3.0
+// Upper bound on the number of sweep points (na, nc) run.
+#define ADAPTIVE_MAX_POINTS 4096
+
+extern void adaptive_sweep_run(void);
+extern int adaptive_sweep_next_na(int na);
+extern int adaptive_sweep_next_nc(int na, int nc);
+extern void adaptive_sweep_load_result(int na, int nc);
+
+#endif /* ADAPTIVE_SWEEP_H_ */
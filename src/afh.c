@@ -1,16 +1,15 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "afh.h"
 
 #define HOPPING_SEQUENCE_LENGTH 79 // Number of frequencies in the sequence (79 for basic Bluetooth)
 #define BT_CLK_MASK 0x1FFFFFFF     // Mask for the 27-bit clock
 #define BD_ADDR_MASK 0xFFFFFFFF    // Mask for the 28 bits of BD_ADDR (UAP/LAP)
 
-typedef unsigned char uint8_t;
-typedef unsigned short uint16_t;
-typedef unsigned int uint32_t;
-typedef unsigned long long uint64_t;
-
 // Function prototypes
 uint8_t calculate_next_frequency(uint64_t master_bdaddr, uint32_t current_clk, bool *channel_map, uint8_t num_used_channels);
 
@@ -154,8 +153,8 @@ uint8_t calculate_next_frequency(uint64_t master_bdaddr, uint32_t current_clk, b
     // Step 2: XOR with A22-19 (simulated)
     Z_prime ^= B;
 
-    // Step 3: Create control word P with XOR between Y1 and C
-    uint16_t P = (((C ^ Y1) << 9) & 0x3E00) | (D & 0x1FF); // Combine (C ^ Y1) and D to form the control word for permutation
+    // Step 3: Create control word P with XOR between Y1 and each of the five bits of C
+    uint16_t P = (((C ^ (0x1F * Y1)) << 9) & 0x3E00) | (D & 0x1FF); // Combine (C ^ Y1) and D to form the control word for permutation
 
     // Step 4: Permutation operation using control word P
     uint16_t permuted_output = permute(Z_prime, P);
@@ -203,8 +202,8 @@ uint8_t get_permuteout(uint64_t master_bdaddr, uint32_t current_clk, bool *chann
     // Step 2: XOR with A22-19 (simulated)
     Z_prime ^= B;
 
-    // Step 3: Create control word P with XOR between Y1 and C
-    uint16_t P = (((C ^ Y1) << 9) & 0x3E00) | (D & 0x1FF); // Combine (C ^ Y1) and D to form the control word for permutation
+    // Step 3: Create control word P with XOR between Y1 and each of the five bits of C
+    uint16_t P = (((C ^ (0x1F * Y1)) << 9) & 0x3E00) | (D & 0x1FF); // Combine (C ^ Y1) and D to form the control word for permutation
 
     // Step 4: Permutation operation using control word P
     uint16_t permuted_output = permute(Z_prime, P);
@@ -260,3 +259,347 @@ void update_channel_map(bool *channel_map)
            channel_map[40] ? "available" : "blocked",
            channel_map[50] ? "available" : "blocked");
 }
+
+/*
+ * Batch hop kernel.
+ *
+ * Same selection as calculate_next_frequency(), written without data dependent branches so that
+ * HOP_BATCH_WIDTH (address, clock) pairs are evaluated together: the butterfly network becomes
+ * a conditional bit swap per stage, the mod 79 / mod N reductions use a float reciprocal with
+ * a one step correction (all operands are below 2^21), and the AFH remap is a table lookup.
+ * Lanes can belong to different piconets (table_index selects the channel map per lane) or to
+ * consecutive clocks of one piconet (calculate_hop_sequence).
+ */
+void build_afh_remap_table(S_AFH_REMAP_TABLE *pTable, const bool *channel_map, uint8_t num_used_channels)
+{
+    int index = 0;
+
+    memset(pTable, 0, sizeof(S_AFH_REMAP_TABLE));
+    for (int i = 0; i < HOPPING_SEQUENCE_LENGTH; i++)
+        pTable->avail[i] = channel_map[i] ? 1 : 0;
+
+    // Same ordering as remap_channel(): even channels first, then odd channels.
+    for (int i = 0; i < HOPPING_SEQUENCE_LENGTH; i = i + 2)
+    {
+        if (channel_map[i])
+            pTable->remap[index++] = i;
+    }
+    for (int i = 1; i < HOPPING_SEQUENCE_LENGTH; i = i + 2)
+    {
+        if (channel_map[i])
+            pTable->remap[index++] = i;
+    }
+    pTable->noOfCh = num_used_channels;
+}
+
+// Conditional swap of bits a and b of Z when bit k of the control word P is set.
+#define BUTTERFLY(Z, P, k, a, b)                                  \
+    do                                                            \
+    {                                                             \
+        uint32_t t_ = (((Z) >> (a)) ^ ((Z) >> (b))) & ((P) >> (k)) & 1; \
+        (Z) ^= (t_ << (a)) | (t_ << (b));                         \
+    } while (0)
+
+static uint8_t calculate_next_frequency_lane(uint32_t bdaddr, uint32_t current_clk, const S_AFH_REMAP_TABLE *pTable)
+{
+    uint32_t X = (current_clk >> 2) & 0x1F;
+    uint32_t Y1 = (current_clk >> 1) & 1;
+    uint32_t Y2 = 32 * Y1;
+    uint32_t A = ((bdaddr >> 23) & 0x1F) ^ ((current_clk >> 21) & 0x1F);
+    uint32_t B = (bdaddr >> 19) & 0x0F;
+    uint32_t C = (GET_SET_BIT(bdaddr, 8, 4) | GET_SET_BIT(bdaddr, 6, 3) | GET_SET_BIT(bdaddr, 4, 2) | GET_SET_BIT(bdaddr, 2, 1) | GET_SET_BIT(bdaddr, 0, 0)) ^ ((current_clk >> 16) & 0x1F);
+    uint32_t D = ((bdaddr >> 10) & 0x1FF) ^ ((current_clk >> 7) & 0x1FF);
+    uint32_t E = GET_SET_BIT(bdaddr, 13, 6) | GET_SET_BIT(bdaddr, 11, 5) | GET_SET_BIT(bdaddr, 9, 4) | GET_SET_BIT(bdaddr, 7, 3) | GET_SET_BIT(bdaddr, 5, 2) | GET_SET_BIT(bdaddr, 3, 1) | GET_SET_BIT(bdaddr, 1, 0);
+    uint32_t F = (16 * ((current_clk >> 7) & 0x1FFFFF)) % 79;
+    uint32_t F_prime = (16 * ((current_clk >> 7) & 0x1FFFFF)) % pTable->noOfCh;
+    uint32_t Z = ((X + A) % 32) ^ B;
+    uint32_t P = (((C ^ (0x1F * Y1)) << 9) & 0x3E00) | (D & 0x1FF);
+    uint32_t frequency;
+
+    BUTTERFLY(Z, P, 12, 0, 3);
+    BUTTERFLY(Z, P, 13, 1, 2);
+    BUTTERFLY(Z, P, 10, 2, 4);
+    BUTTERFLY(Z, P, 11, 1, 3);
+    BUTTERFLY(Z, P, 8, 1, 4);
+    BUTTERFLY(Z, P, 9, 0, 3);
+    BUTTERFLY(Z, P, 6, 0, 2);
+    BUTTERFLY(Z, P, 7, 3, 4);
+    BUTTERFLY(Z, P, 4, 0, 4);
+    BUTTERFLY(Z, P, 5, 1, 3);
+    BUTTERFLY(Z, P, 2, 1, 2);
+    BUTTERFLY(Z, P, 3, 3, 4);
+    BUTTERFLY(Z, P, 0, 0, 1);
+    BUTTERFLY(Z, P, 1, 2, 3);
+
+    frequency = (Z + E + F + Y2) % HOPPING_SEQUENCE_LENGTH;
+    frequency = (frequency < 40) ? frequency * 2 : frequency * 2 - HOPPING_SEQUENCE_LENGTH;
+
+    if (!pTable->avail[frequency])
+        frequency = pTable->remap[(Z + E + F_prime + Y2) % pTable->noOfCh];
+
+    return (uint8_t)frequency;
+}
+
+/*
+ * The SSE4.1 kernel is compiled with a target attribute, so every x86 build carries it whatever its
+ * -m options; calculate_next_frequency_x8() runs it when the CPU has SSE4.1 and the lanes one by one
+ * otherwise.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <smmintrin.h>
+
+#define HOP_BATCH_SSE41 __attribute__((target("sse4.1")))
+
+// x mod m for 0 <= x < 2^21. The truncated float quotient is off by at most one.
+static inline HOP_BATCH_SSE41 __m128i mod_x4(__m128i x, __m128i m, __m128 inv_m)
+{
+    __m128i q = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(x), inv_m));
+    __m128i r = _mm_sub_epi32(x, _mm_mullo_epi32(q, m));
+
+    r = _mm_add_epi32(r, _mm_and_si128(_mm_cmplt_epi32(r, _mm_setzero_si128()), m));
+    r = _mm_sub_epi32(r, _mm_andnot_si128(_mm_cmpgt_epi32(m, r), m));
+    return r;
+}
+
+#define GET_SET_BIT_X4(v, get_bit, set_bit) _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, get_bit), one), set_bit)
+
+#define BUTTERFLY_X4(Z, P, k, a, b)                                                                      \
+    do                                                                                                   \
+    {                                                                                                    \
+        __m128i t_ = _mm_and_si128(_mm_xor_si128(_mm_srli_epi32(Z, a), _mm_srli_epi32(Z, b)), one);     \
+        t_ = _mm_and_si128(t_, _mm_srli_epi32(P, k));                                                    \
+        Z = _mm_xor_si128(Z, _mm_or_si128(_mm_slli_epi32(t_, a), _mm_slli_epi32(t_, b)));                \
+    } while (0)
+
+/*
+ * Two 128-bit halves rather than one 256-bit register: the kernel is called in short bursts from
+ * the hop cache, and intermittent 256-bit use made the surrounding libm calls (SINR model) run
+ * several times slower on the Xeon machines we sweep on.
+ */
+static HOP_BATCH_SSE41 void calculate_next_frequency_x8_sse41(const uint32_t *bdaddr, const uint32_t *current_clk, const S_AFH_REMAP_TABLE *pTables, const uint8_t *table_index, uint8_t *out)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i m79 = _mm_set1_epi32(HOPPING_SEQUENCE_LENGTH);
+    const __m128 inv79 = _mm_set1_ps(1.0f / HOPPING_SEQUENCE_LENGTH);
+    int lanes[4];
+
+    for (int h = 0; h < HOP_BATCH_WIDTH; h += 4)
+    {
+        const S_AFH_REMAP_TABLE *pTbl[4] = {&pTables[table_index[h]], &pTables[table_index[h + 1]], &pTables[table_index[h + 2]], &pTables[table_index[h + 3]]};
+        __m128i addr = _mm_loadu_si128((const __m128i *)&bdaddr[h]);
+        __m128i clk = _mm_loadu_si128((const __m128i *)&current_clk[h]);
+        __m128i N = _mm_setr_epi32(pTbl[0]->noOfCh, pTbl[1]->noOfCh, pTbl[2]->noOfCh, pTbl[3]->noOfCh);
+
+        __m128i X = _mm_and_si128(_mm_srli_epi32(clk, 2), _mm_set1_epi32(0x1F));
+        __m128i Y1 = _mm_and_si128(_mm_srli_epi32(clk, 1), one);
+        __m128i Y2 = _mm_slli_epi32(Y1, 5);
+        __m128i A = _mm_and_si128(_mm_xor_si128(_mm_srli_epi32(addr, 23), _mm_srli_epi32(clk, 21)), _mm_set1_epi32(0x1F));
+        __m128i B = _mm_and_si128(_mm_srli_epi32(addr, 19), _mm_set1_epi32(0x0F));
+        __m128i C = _mm_or_si128(_mm_or_si128(GET_SET_BIT_X4(addr, 8, 4), GET_SET_BIT_X4(addr, 6, 3)),
+                                 _mm_or_si128(_mm_or_si128(GET_SET_BIT_X4(addr, 4, 2), GET_SET_BIT_X4(addr, 2, 1)), GET_SET_BIT_X4(addr, 0, 0)));
+        C = _mm_xor_si128(C, _mm_and_si128(_mm_srli_epi32(clk, 16), _mm_set1_epi32(0x1F)));
+        __m128i D = _mm_and_si128(_mm_xor_si128(_mm_srli_epi32(addr, 10), _mm_srli_epi32(clk, 7)), _mm_set1_epi32(0x1FF));
+        __m128i E = _mm_or_si128(_mm_or_si128(_mm_or_si128(GET_SET_BIT_X4(addr, 13, 6), GET_SET_BIT_X4(addr, 11, 5)),
+                                              _mm_or_si128(GET_SET_BIT_X4(addr, 9, 4), GET_SET_BIT_X4(addr, 7, 3))),
+                                 _mm_or_si128(_mm_or_si128(GET_SET_BIT_X4(addr, 5, 2), GET_SET_BIT_X4(addr, 3, 1)), GET_SET_BIT_X4(addr, 1, 0)));
+        // 16 * CLK27_7 mod n is computed as 16 * (CLK27_7 mod n) mod n to keep every operand below 2^21.
+        __m128i clk27_7 = _mm_and_si128(_mm_srli_epi32(clk, 7), _mm_set1_epi32(0x1FFFFF));
+        __m128i F = mod_x4(_mm_slli_epi32(mod_x4(clk27_7, m79, inv79), 4), m79, inv79);
+        __m128 invN = _mm_div_ps(_mm_set1_ps(1.0f), _mm_cvtepi32_ps(N));
+        __m128i F_prime = mod_x4(_mm_slli_epi32(mod_x4(clk27_7, N, invN), 4), N, invN);
+        __m128i Z = _mm_xor_si128(_mm_and_si128(_mm_add_epi32(X, A), _mm_set1_epi32(0x1F)), B);
+        // -Y1 sets every bit of C ^ Y1 the mask keeps.
+        __m128i P = _mm_or_si128(_mm_and_si128(_mm_slli_epi32(_mm_xor_si128(C, _mm_sub_epi32(_mm_setzero_si128(), Y1)), 9), _mm_set1_epi32(0x3E00)), D);
+
+        BUTTERFLY_X4(Z, P, 12, 0, 3);
+        BUTTERFLY_X4(Z, P, 13, 1, 2);
+        BUTTERFLY_X4(Z, P, 10, 2, 4);
+        BUTTERFLY_X4(Z, P, 11, 1, 3);
+        BUTTERFLY_X4(Z, P, 8, 1, 4);
+        BUTTERFLY_X4(Z, P, 9, 0, 3);
+        BUTTERFLY_X4(Z, P, 6, 0, 2);
+        BUTTERFLY_X4(Z, P, 7, 3, 4);
+        BUTTERFLY_X4(Z, P, 4, 0, 4);
+        BUTTERFLY_X4(Z, P, 5, 1, 3);
+        BUTTERFLY_X4(Z, P, 2, 1, 2);
+        BUTTERFLY_X4(Z, P, 3, 3, 4);
+        BUTTERFLY_X4(Z, P, 0, 0, 1);
+        BUTTERFLY_X4(Z, P, 1, 2, 3);
+
+        __m128i ZEY2 = _mm_add_epi32(_mm_add_epi32(Z, E), Y2);
+        __m128i frequency = mod_x4(_mm_add_epi32(ZEY2, F), m79, inv79);
+        // Even/odd fold: f < 40 ? 2f : 2f - 79
+        frequency = _mm_slli_epi32(frequency, 1);
+        frequency = _mm_sub_epi32(frequency, _mm_andnot_si128(_mm_cmpgt_epi32(m79, frequency), m79));
+        __m128i k_prime = mod_x4(_mm_add_epi32(ZEY2, F_prime), N, invN);
+
+        // AFH remap: SSE has no gather, so the two table lookups are done per lane.
+        int f[4], k[4];
+        _mm_storeu_si128((__m128i *)f, frequency);
+        _mm_storeu_si128((__m128i *)k, k_prime);
+        for (int i = 0; i < 4; i++)
+            lanes[i] = pTbl[i]->avail[f[i]] ? f[i] : pTbl[i]->remap[k[i]];
+
+        for (int i = 0; i < 4; i++)
+            out[h + i] = (uint8_t)lanes[i];
+    }
+}
+#endif
+
+void calculate_next_frequency_x8(const uint32_t *bdaddr, const uint32_t *current_clk, const S_AFH_REMAP_TABLE *pTables, const uint8_t *table_index, uint8_t *out)
+{
+#ifdef HOP_BATCH_SSE41
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        calculate_next_frequency_x8_sse41(bdaddr, current_clk, pTables, table_index, out);
+        return;
+    }
+#endif
+    for (int i = 0; i < HOP_BATCH_WIDTH; i++)
+        out[i] = calculate_next_frequency_lane(bdaddr[i], current_clk[i], &pTables[table_index[i]]);
+}
+
+void calculate_next_frequency_batch(const uint64_t *master_bdaddr, const uint32_t *current_clk, const S_AFH_REMAP_TABLE *pTables, const uint8_t *table_index, int n, uint8_t *out)
+{
+    uint32_t bdaddr[HOP_BATCH_WIDTH];
+    int i = 0;
+
+    for (; i + HOP_BATCH_WIDTH <= n; i += HOP_BATCH_WIDTH)
+    {
+        for (int k = 0; k < HOP_BATCH_WIDTH; k++)
+            bdaddr[k] = extract_bdaddr(master_bdaddr[i + k]);
+        calculate_next_frequency_x8(bdaddr, &current_clk[i], pTables, &table_index[i], &out[i]);
+    }
+    for (; i < n; i++)
+        out[i] = calculate_next_frequency_lane(extract_bdaddr(master_bdaddr[i]), current_clk[i], &pTables[table_index[i]]);
+}
+
+// Channels of one piconet for current_time = first_time, first_time + time_step, ... (clock as in select_channel)
+void calculate_hop_sequence(uint64_t master_bdaddr, uint32_t base_clk, int first_time, int time_step, int n, const S_AFH_REMAP_TABLE *pTable, uint8_t *out)
+{
+    uint32_t bdaddr[HOP_BATCH_WIDTH];
+    uint32_t clk[HOP_BATCH_WIDTH];
+    uint8_t table_index[HOP_BATCH_WIDTH] = {0};
+    int i = 0;
+
+    for (int k = 0; k < HOP_BATCH_WIDTH; k++)
+        bdaddr[k] = extract_bdaddr(master_bdaddr);
+
+    for (; i + HOP_BATCH_WIDTH <= n; i += HOP_BATCH_WIDTH)
+    {
+        for (int k = 0; k < HOP_BATCH_WIDTH; k++)
+            clk[k] = ((uint32_t)(first_time + (i + k) * time_step) + base_clk) << 1;
+        calculate_next_frequency_x8(bdaddr, clk, pTable, table_index, &out[i]);
+    }
+    for (; i < n; i++)
+        out[i] = calculate_next_frequency_lane(bdaddr[0], ((uint32_t)(first_time + i * time_step) + base_clk) << 1, pTable);
+}
+
+/*
+ * Checks the batch kernel bit-exactly against calculate_next_frequency() on random addresses,
+ * clocks and channel maps. If vector_path is given, each line "<bd_addr hex> <clock hex> <channel>"
+ * (e.g. the sample data of the Bluetooth Core specification, bench/hop_vectors.txt) is checked against
+ * the scalar kernel and every lane of the batch kernel; lines starting with '#' are skipped.
+ * Returns the number of mismatches.
+ */
+int hop_batch_selftest(int num_of_cases, const char *vector_path)
+{
+    S_AFH_REMAP_TABLE stTables[HOP_BATCH_WIDTH];
+    bool chMaps[HOP_BATCH_WIDTH][HOPPING_SEQUENCE_LENGTH];
+    uint8_t noOfCh[HOP_BATCH_WIDTH];
+    uint64_t addr[HOP_BATCH_WIDTH];
+    uint32_t clk[HOP_BATCH_WIDTH];
+    uint8_t table_index[HOP_BATCH_WIDTH];
+    uint8_t out[HOP_BATCH_WIDTH];
+    int errors = 0;
+    int checked = 0;
+
+    for (int i = 0; i < HOP_BATCH_WIDTH; i++)
+    {
+        // Map i keeps 20 + 7 * i channels (the last one keeps all 79).
+        int used = (i == HOP_BATCH_WIDTH - 1) ? HOPPING_SEQUENCE_LENGTH : 20 + 7 * i;
+        memset(chMaps[i], 0, sizeof(chMaps[i]));
+        noOfCh[i] = 0;
+        while (noOfCh[i] < used)
+        {
+            int ch = rand() % HOPPING_SEQUENCE_LENGTH;
+            if (!chMaps[i][ch])
+            {
+                chMaps[i][ch] = true;
+                noOfCh[i]++;
+            }
+        }
+        build_afh_remap_table(&stTables[i], chMaps[i], noOfCh[i]);
+    }
+
+    for (int n = 0; n < num_of_cases; n += HOP_BATCH_WIDTH)
+    {
+        for (int i = 0; i < HOP_BATCH_WIDTH; i++)
+        {
+            addr[i] = ((uint64_t)rand() << 32) ^ ((uint64_t)rand() << 16) ^ (uint64_t)rand();
+            clk[i] = ((uint32_t)rand() << 16) ^ (uint32_t)rand();
+            table_index[i] = (uint8_t)((i + n / HOP_BATCH_WIDTH) % HOP_BATCH_WIDTH);
+        }
+        calculate_next_frequency_batch(addr, clk, stTables, table_index, HOP_BATCH_WIDTH, out);
+
+        for (int i = 0; i < HOP_BATCH_WIDTH; i++)
+        {
+            uint8_t expected = calculate_next_frequency(addr[i], clk[i], chMaps[table_index[i]], noOfCh[table_index[i]]);
+            if (out[i] != expected)
+            {
+                if (errors < 10)
+                    printf("hop batch mismatch: addr %llx clk %x map %d: %d != %d\n", (unsigned long long)addr[i], clk[i], table_index[i], out[i], expected);
+                errors++;
+            }
+            checked++;
+        }
+    }
+
+    if (vector_path != NULL)
+    {
+        FILE *fp = fopen(vector_path, "r");
+        char line[128];
+        unsigned long long vAddr;
+        unsigned int vClk;
+        int vCh;
+        bool allChannels[HOPPING_SEQUENCE_LENGTH];
+
+        memset(allChannels, 1, sizeof(allChannels));
+        build_afh_remap_table(&stTables[0], allChannels, HOPPING_SEQUENCE_LENGTH);
+
+        if (fp == NULL)
+        {
+            printf("hop batch: cannot open %s\n", vector_path);
+            return errors + 1;
+        }
+        while (fgets(line, sizeof(line), fp) != NULL)
+        {
+            if (line[0] == '#' || sscanf(line, "%llx %x %d", &vAddr, &vClk, &vCh) != 3)
+                continue;
+            uint8_t scalar = calculate_next_frequency(vAddr, vClk, allChannels, HOPPING_SEQUENCE_LENGTH);
+            bool bBatch = true;
+
+            // The vector in every lane of a full batch, so that the SIMD kernel is checked too.
+            for (int i = 0; i < HOP_BATCH_WIDTH; i++)
+            {
+                addr[i] = vAddr;
+                clk[i] = vClk;
+                table_index[i] = 0;
+            }
+            calculate_next_frequency_batch(addr, clk, stTables, table_index, HOP_BATCH_WIDTH, out);
+            for (int i = 0; i < HOP_BATCH_WIDTH; i++)
+                bBatch = bBatch && out[i] == vCh;
+            if (scalar != vCh || !bBatch)
+            {
+                if (errors < 10)
+                    printf("hop vector mismatch: addr %llx clk %x: scalar %d batch %d expected %d\n", vAddr, vClk, scalar, out[0], vCh);
+                errors++;
+            }
+            checked++;
+        }
+        fclose(fp);
+    }
+
+    printf("hop batch selftest: %d hops checked, %d mismatches\n", checked, errors);
+    return errors;
+}
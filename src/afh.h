@@ -8,11 +8,25 @@
 #ifndef AFH_H_
 #define AFH_H_
 
-typedef unsigned char uint8_t;
-typedef unsigned short uint16_t;
-typedef unsigned int uint32_t;
-typedef unsigned long long uint64_t;
+#include <stdint.h>
 
 extern uint8_t calculate_next_frequency(uint64_t master_bdaddr, uint32_t current_clk, bool *channel_map, uint8_t num_used_channels);
 extern uint8_t get_permuteout(uint64_t master_bdaddr, uint32_t current_clk, bool *channel_map, uint8_t num_used_channels);
+
+// Number of hops computed per call of the batch kernel (two SSE registers of 32-bit lanes).
+#define HOP_BATCH_WIDTH 8
+
+// Channel map compiled for the batch kernel. Entries are int so that they can be gathered per lane.
+typedef struct
+{
+    int avail[80]; // 1 if the channel is in the map
+    int remap[80]; // k-th channel of the map, even channels first then odd channels (see remap_channel)
+    int noOfCh;
+} S_AFH_REMAP_TABLE;
+
+extern void build_afh_remap_table(S_AFH_REMAP_TABLE *pTable, const bool *channel_map, uint8_t num_used_channels);
+extern void calculate_next_frequency_x8(const uint32_t *bdaddr, const uint32_t *current_clk, const S_AFH_REMAP_TABLE *pTables, const uint8_t *table_index, uint8_t *out);
+extern void calculate_next_frequency_batch(const uint64_t *master_bdaddr, const uint32_t *current_clk, const S_AFH_REMAP_TABLE *pTables, const uint8_t *table_index, int n, uint8_t *out);
+extern void calculate_hop_sequence(uint64_t master_bdaddr, uint32_t base_clk, int first_time, int time_step, int n, const S_AFH_REMAP_TABLE *pTable, uint8_t *out);
+extern int hop_batch_selftest(int num_of_cases, const char *vector_path);
 #endif /* AFH_H_ */
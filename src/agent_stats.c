@@ -0,0 +1,180 @@
+/*
+ * Streaming distribution of the per-agent collision rates of a sweep point (agent_stats.h).
+ *
+ * The rates are added one agent at a time to running moments (count, sum, sum of squares, min, max) and
+ * to a sketch of logarithmic bins: bin k counts the rates in (g^(k-1), g^k], g = (1 + a) / (1 - a), and
+ * reports 2 g^k / (g + 1), which is within a (AGENT_STATS_ALPHA) of every rate in the bin. The memory
+ * does not grow with the number of agents, and sketches of replicated runs merge exactly by adding their
+ * counts. Jain's index and the mean come from the moments, the quantiles and boxplot from the sketch.
+ *
+ * With AGENT_STATS, marl_main writes the summary and the sketch of every sweep point to fair_<time>.txt
+ * instead of the rate of each agent to pcol. tools/fair_merge merges the files of replicated runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+
+#include "agent_stats.h"
+
+#ifdef AGENT_STATS
+
+static double log_gamma(void)
+{
+    return log((1 + AGENT_STATS_ALPHA) / (1 - AGENT_STATS_ALPHA));
+}
+
+static double bin_value(int b)
+{
+    double gamma = (1 + AGENT_STATS_ALPHA) / (1 - AGENT_STATS_ALPHA);
+
+    return 2 * exp((b - AGENT_STATS_BINS + 1) * log_gamma()) / (gamma + 1);
+}
+
+void agent_stats_reset(S_AGENT_STATS *pStats)
+{
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->min = INFINITY;
+    pStats->max = -INFINITY;
+}
+
+void agent_stats_add(S_AGENT_STATS *pStats, double x)
+{
+    int b;
+
+    pStats->n++;
+    pStats->sum += x;
+    pStats->sumSq += x * x;
+    if (x < pStats->min)
+        pStats->min = x;
+    if (x > pStats->max)
+        pStats->max = x;
+
+    if (x < AGENT_STATS_MIN)
+    {
+        pStats->zero++;
+        return;
+    }
+    b = (int)ceil(log(x) / log_gamma()) + AGENT_STATS_BINS - 1;
+    if (b > AGENT_STATS_BINS - 1) // Rates above 1
+        b = AGENT_STATS_BINS - 1;
+    pStats->bins[b]++;
+}
+
+void agent_stats_merge(S_AGENT_STATS *pTo, const S_AGENT_STATS *pFrom)
+{
+    pTo->n += pFrom->n;
+    pTo->sum += pFrom->sum;
+    pTo->sumSq += pFrom->sumSq;
+    if (pFrom->min < pTo->min)
+        pTo->min = pFrom->min;
+    if (pFrom->max > pTo->max)
+        pTo->max = pFrom->max;
+    pTo->zero += pFrom->zero;
+    for (int b = 0; b < AGENT_STATS_BINS; b++)
+        pTo->bins[b] += pFrom->bins[b];
+}
+
+// Rate of rank q (n - 1), 0 <= q <= 1, kept within the min and max seen.
+double agent_stats_quantile(const S_AGENT_STATS *pStats, double q)
+{
+    double rank = q * (pStats->n - 1), value = pStats->max;
+    long long count = pStats->zero;
+
+    if (pStats->n == 0)
+        return NAN;
+    if (rank < count)
+        value = pStats->min;
+    for (int b = 0; b < AGENT_STATS_BINS && rank >= count; b++)
+    {
+        count += pStats->bins[b];
+        if (rank < count)
+            value = bin_value(b);
+    }
+    return fmin(fmax(value, pStats->min), pStats->max);
+}
+
+void agent_stats_summary(const S_AGENT_STATS *pStats, S_AGENT_SUMMARY *pSummary)
+{
+    double iqr, fenceLo, fenceHi, value;
+
+    pSummary->jain = (pStats->sumSq > 0) ? pStats->sum * pStats->sum / (pStats->n * pStats->sumSq) : 1.0;
+    pSummary->mean = (pStats->n > 0) ? pStats->sum / pStats->n : NAN;
+    pSummary->min = pStats->min;
+    pSummary->max = pStats->max;
+    pSummary->p05 = agent_stats_quantile(pStats, 0.05);
+    pSummary->q1 = agent_stats_quantile(pStats, 0.25);
+    pSummary->median = agent_stats_quantile(pStats, 0.5);
+    pSummary->q3 = agent_stats_quantile(pStats, 0.75);
+    pSummary->p95 = agent_stats_quantile(pStats, 0.95);
+
+    // Tukey's whiskers, on the values the bins report.
+    iqr = pSummary->q3 - pSummary->q1;
+    fenceLo = pSummary->q1 - 1.5 * iqr;
+    fenceHi = pSummary->q3 + 1.5 * iqr;
+    pSummary->whiskerLo = pSummary->q1;
+    pSummary->whiskerHi = pSummary->q3;
+    pSummary->outliers = 0;
+    if (pStats->zero > 0)
+    {
+        if (pStats->min >= fenceLo)
+            pSummary->whiskerLo = pStats->min;
+        else
+            pSummary->outliers += pStats->zero;
+    }
+    for (int b = 0; b < AGENT_STATS_BINS; b++)
+    {
+        if (pStats->bins[b] == 0)
+            continue;
+        value = fmin(fmax(bin_value(b), pStats->min), pStats->max);
+        if (value < fenceLo || value > fenceHi)
+            pSummary->outliers += pStats->bins[b];
+        else
+        {
+            pSummary->whiskerLo = fmin(pSummary->whiskerLo, value);
+            pSummary->whiskerHi = fmax(pSummary->whiskerHi, value);
+        }
+    }
+}
+
+// Writes the summary line after pKey, then the sketch line that agent_stats_read() takes back.
+void agent_stats_write(FILE *fp, const char *pKey, const S_AGENT_STATS *pStats)
+{
+    S_AGENT_SUMMARY stSummary;
+
+    agent_stats_summary(pStats, &stSummary);
+    fprintf(fp, "%s %lld %f %f %f %f %f %f %f %f %f %f %f %lld\n", pKey, pStats->n, stSummary.jain, stSummary.mean, stSummary.min,
+            stSummary.p05, stSummary.q1, stSummary.median, stSummary.q3, stSummary.p95, stSummary.max, stSummary.whiskerLo,
+            stSummary.whiskerHi, stSummary.outliers);
+    fprintf(fp, "sketch %lld %.17g %.17g %.17g %.17g %lld", pStats->n, pStats->sum, pStats->sumSq, pStats->min, pStats->max, pStats->zero);
+    for (int b = 0; b < AGENT_STATS_BINS; b++)
+    {
+        if (pStats->bins[b] > 0)
+            fprintf(fp, " %d:%lld", b, pStats->bins[b]);
+    }
+    fprintf(fp, "\n");
+}
+
+// Parses a sketch line of agent_stats_write(). Returns false if pLine is not one.
+bool agent_stats_read(const char *pLine, S_AGENT_STATS *pStats)
+{
+    const char *p;
+    char *pEnd;
+    int consumed, b;
+
+    agent_stats_reset(pStats);
+    if (sscanf(pLine, "sketch %lld %lf %lf %lf %lf %lld%n", &pStats->n, &pStats->sum, &pStats->sumSq, &pStats->min, &pStats->max,
+               &pStats->zero, &consumed) != 6)
+        return false;
+    for (p = pLine + consumed;; p = pEnd)
+    {
+        b = strtol(p, &pEnd, 10);
+        if (pEnd == p || *pEnd != ':' || b < 0 || b >= AGENT_STATS_BINS)
+            break;
+        pStats->bins[b] = strtoll(pEnd + 1, &pEnd, 10);
+    }
+    return true;
+}
+
+#endif /* AGENT_STATS */
@@ -0,0 +1,56 @@
+/*
+ * agent_stats.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef AGENT_STATS_H_
+#define AGENT_STATS_H_
+
+// Quantiles are within AGENT_STATS_ALPHA of the true value, relatively. Rates below AGENT_STATS_MIN count
+// as 0. AGENT_STATS_BINS logarithmic bins reach below AGENT_STATS_MIN from 1.
+#define AGENT_STATS_ALPHA 0.01
+#define AGENT_STATS_MIN 1e-6
+#define AGENT_STATS_BINS 700
+
+// Distribution of the collision rates of the agents of a sweep point: moments and a sketch of fixed-size
+// logarithmic bins (DDSketch), so two of them merge by adding their counts.
+typedef struct
+{
+    long long n;
+    double sum;
+    double sumSq;
+    double min;
+    double max;
+    long long zero;                    // Rates below AGENT_STATS_MIN
+    long long bins[AGENT_STATS_BINS]; // Bin b holds (g^(k-1), g^k], k = b - AGENT_STATS_BINS + 1, g = (1+a)/(1-a)
+} S_AGENT_STATS;
+
+typedef struct
+{
+    double jain; // Jain's fairness index, (sum x)^2 / (n sum x^2)
+    double mean;
+    double min;
+    double p05;
+    double q1;
+    double median;
+    double q3;
+    double p95;
+    double max;
+    double whiskerLo; // Lowest and highest rates within 1.5 IQR of the box
+    double whiskerHi;
+    long long outliers;
+} S_AGENT_SUMMARY;
+
+#ifdef AGENT_STATS
+extern void agent_stats_reset(S_AGENT_STATS *pStats);
+extern void agent_stats_add(S_AGENT_STATS *pStats, double x);
+extern void agent_stats_merge(S_AGENT_STATS *pTo, const S_AGENT_STATS *pFrom);
+extern double agent_stats_quantile(const S_AGENT_STATS *pStats, double q);
+extern void agent_stats_summary(const S_AGENT_STATS *pStats, S_AGENT_SUMMARY *pSummary);
+extern void agent_stats_write(FILE *fp, const char *pKey, const S_AGENT_STATS *pStats);
+extern bool agent_stats_read(const char *pLine, S_AGENT_STATS *pStats);
+#endif
+
+#endif /* AGENT_STATS_H_ */
@@ -0,0 +1,129 @@
+/*
+ * Full-resolution collision log (collision_log.h).
+ *
+ * With COLLISION_LOG, marl_main logs every sweep point to collog_M<mode>_<nc>_<na>_<avail>_hmax<h>.bin:
+ * one bit per agent and episode, from episode 1, perturbation included. The statistics loops of
+ * run_episodes() and of the FAST_FORWARD engine add the outcome of each agent; the bits of the current
+ * block are kept in memory and the block is written once its last episode is in. 10,000 agents over
+ * 100,000 episodes take 125 MB. The index of per-block counts is written at the end of the run, then the
+ * header is completed, so a log without an index is a run that did not finish.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "collision_log.h"
+
+#ifdef COLLISION_LOG
+
+#if defined(SWEEP_SCHEDULER) || defined(ADAPTIVE_SWEEP) || defined(RESULT_CACHE)
+#error "COLLISION_LOG logs the runs of marl_main. Disable SWEEP_SCHEDULER, ADAPTIVE_SWEEP and RESULT_CACHE."
+#endif
+
+#define COLLOG_WORDS (COLLOG_BLOCK_EPISODES / 64)
+
+static DFH_TLS FILE *gpCollogFile;
+static DFH_TLS S_COLLOG_HEADER gstCollogHeader;
+static DFH_TLS uint64_t *gpCollogBits; // COLLOG_WORDS per agent, agent 1 first
+static DFH_TLS int gCollogBlock;       // Block of the bits in memory
+static DFH_TLS int gCollogLastEpisode;
+static DFH_TLS uint32_t *gpCollogIndex;
+static DFH_TLS int gCollogIndexBlocks;
+
+static void write_block(void)
+{
+    uint32_t numOfAgents = gstCollogHeader.numOfAgents;
+    uint32_t *pCounts;
+
+    gpCollogIndex = realloc(gpCollogIndex, (size_t)(gCollogBlock + 1) * numOfAgents * sizeof(uint32_t));
+    if (gpCollogIndex == NULL)
+    {
+        printf("collision log: out of memory. Exiting.\n");
+        exit(777);
+    }
+    pCounts = &gpCollogIndex[(size_t)gCollogBlock * numOfAgents];
+    for (uint32_t a = 0; a < numOfAgents; a++)
+    {
+        pCounts[a] = 0;
+        for (int w = 0; w < COLLOG_WORDS; w++)
+            pCounts[a] += __builtin_popcountll(gpCollogBits[(size_t)a * COLLOG_WORDS + w]);
+    }
+    gCollogIndexBlocks = gCollogBlock + 1;
+
+    if (fwrite(gpCollogBits, COLLOG_BLOCK_BYTES(numOfAgents, COLLOG_BLOCK_EPISODES), 1, gpCollogFile) != 1)
+    {
+        printf("collision log: can't write block %d. Exiting.\n", gCollogBlock);
+        exit(777);
+    }
+    memset(gpCollogBits, 0, COLLOG_BLOCK_BYTES(numOfAgents, COLLOG_BLOCK_EPISODES));
+}
+
+void collision_log_open(const char *pPath, int num_agents)
+{
+    gpCollogFile = fopen(pPath, "wb");
+    if (gpCollogFile == NULL)
+    {
+        printf("collision log: can't create %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    memset(&gstCollogHeader, 0, sizeof(gstCollogHeader));
+    gstCollogHeader.magic = COLLOG_MAGIC;
+    gstCollogHeader.version = COLLOG_VERSION;
+    gstCollogHeader.numOfAgents = num_agents;
+    gstCollogHeader.blockEpisodes = COLLOG_BLOCK_EPISODES;
+    fwrite(&gstCollogHeader, sizeof(gstCollogHeader), 1, gpCollogFile);
+
+    gpCollogBits = calloc(1, COLLOG_BLOCK_BYTES(num_agents, COLLOG_BLOCK_EPISODES));
+    if (gpCollogBits == NULL)
+    {
+        printf("collision log: out of memory. Exiting.\n");
+        exit(777);
+    }
+    gCollogBlock = 0;
+    gCollogLastEpisode = 0;
+    gCollogIndexBlocks = 0;
+}
+
+// Episodes come in order, from 1.
+void collision_log_add(int agent, int episode, bool bCollided)
+{
+    int k = episode - 1;
+
+    if (gpCollogFile == NULL)
+        return;
+    while (k / COLLOG_BLOCK_EPISODES > gCollogBlock)
+    {
+        write_block();
+        gCollogBlock++;
+    }
+    k %= COLLOG_BLOCK_EPISODES;
+    gpCollogBits[(size_t)(agent - 1) * COLLOG_WORDS + k / 64] |= (uint64_t)bCollided << (k % 64);
+    gCollogLastEpisode = episode;
+}
+
+void collision_log_close(void)
+{
+    if (gpCollogFile == NULL)
+        return;
+    if (gCollogLastEpisode > 0)
+        write_block();
+
+    gstCollogHeader.numOfEpisodes = gCollogLastEpisode;
+    gstCollogHeader.indexOffset = sizeof(gstCollogHeader) + (uint64_t)gCollogIndexBlocks * COLLOG_BLOCK_BYTES(gstCollogHeader.numOfAgents, COLLOG_BLOCK_EPISODES);
+    fwrite(gpCollogIndex, sizeof(uint32_t), (size_t)gCollogIndexBlocks * gstCollogHeader.numOfAgents, gpCollogFile);
+    rewind(gpCollogFile);
+    fwrite(&gstCollogHeader, sizeof(gstCollogHeader), 1, gpCollogFile);
+    fclose(gpCollogFile);
+    gpCollogFile = NULL;
+
+    free(gpCollogBits);
+    free(gpCollogIndex);
+    gpCollogBits = NULL;
+    gpCollogIndex = NULL;
+}
+
+#endif /* COLLISION_LOG */
@@ -0,0 +1,39 @@
+/*
+ * collision_log.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef COLLISION_LOG_H_
+#define COLLISION_LOG_H_
+
+// Bit-packed log of the collision of every agent in every episode (COLLISION_LOG), read by tools/col_log.
+// The file is a header, blocks of COLLOG_BLOCK_EPISODES episodes and an index. A block holds one row of
+// bits per agent, bit k of the row for episode first + k of the block. The index holds the collisions of
+// each agent in each block (uint32, block by block), so a window only reads the bits of its two ends.
+#define COLLOG_MAGIC 0x4c484644 // "DFHL"
+#define COLLOG_VERSION 1
+#define COLLOG_BLOCK_EPISODES 4096
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numOfAgents;
+    uint32_t blockEpisodes;
+    uint64_t numOfEpisodes; // Written when the run ends, with indexOffset
+    uint64_t indexOffset;   // 0 while the run is going
+} S_COLLOG_HEADER;
+
+// Bytes of the row of an agent in a block, and of a block.
+#define COLLOG_ROW_BYTES(blockEpisodes) ((uint64_t)(blockEpisodes) / 8)
+#define COLLOG_BLOCK_BYTES(numOfAgents, blockEpisodes) ((uint64_t)(numOfAgents) * COLLOG_ROW_BYTES(blockEpisodes))
+
+#ifdef COLLISION_LOG
+extern void collision_log_open(const char *pPath, int num_agents);
+extern void collision_log_add(int agent, int episode, bool bCollided);
+extern void collision_log_close(void);
+#endif
+
+#endif /* COLLISION_LOG_H_ */
@@ -0,0 +1,313 @@
+/*
+ * Simulation handles of libdfh (dfh.h).
+ *
+ * The simulator keeps its state in globals. Built with DFH_LIB, they are thread-local (DFH_TLS), so each
+ * handle owns a thread that holds the state of its simulation and runs the calls made on the handle: the
+ * caller posts a command and waits for the thread to finish it. Calls on different handles run in
+ * parallel without sharing anything but the read-only tables. rand() is replaced by a generator per
+ * thread that draws the same sequence as glibc's rand(), so a handle gives the results of bench/golden.c
+ * for the same configuration and seed.
+ *
+ * A run set up by dfh_configure() goes through run_simulation() when dfh_run() is called first (with the
+ * FAST_FORWARD engine when it applies), and through run_simulation_begin() and run_episodes() when it is
+ * stepped.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "hop_cache.h"
+#include "dfh.h"
+
+#ifdef DFH_LIB
+
+#if defined(PROFILE) || defined(SWEEP_SCHEDULER) || defined(HEATMAP) || defined(SHUFFLE) || defined(DEBUG) || defined(DEBUG_CH_STATE_1) || defined(SYNC_SLOT_COMPARE)
+#error "DFH_LIB writes no files. Disable PROFILE, SWEEP_SCHEDULER, HEATMAP, SHUFFLE, DEBUG, DEBUG_CH_STATE_1 and SYNC_SLOT_COMPARE."
+#endif
+#if defined(INTERFERENCE_SCHEDULE) || defined(TRACE_REPLAY)
+#error "The interference schedule and the trace are loaded once per process. Disable INTERFERENCE_SCHEDULE and TRACE_REPLAY with DFH_LIB."
+#endif
+#ifdef DIFFUSIVE
+#error "The coexistence runs of DIFFUSIVE are sweeps of marl_main(). Disable DIFFUSIVE with DFH_LIB."
+#endif
+#ifdef _OPENMP
+#error "The threads of OpenMP don't see the state of the handle. Build DFH_LIB without -fopenmp."
+#endif
+
+extern void initialize_agents(Agent agents[], int num_agents);
+extern void run_simulation(Agent agents[], int num_agents);
+extern void run_simulation_begin(Agent agents[], int num_agents);
+extern void run_episodes(Agent agents[], int num_agents, int first, int last);
+extern void setup_piconets(int na, unsigned int seed);
+extern void set_sweep_point(int mode, int nc, int hmax);
+
+extern DFH_TLS Agent gstAgents[NUM_AGENTS + 1];
+extern DFH_TLS int gRunEpisodes;
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+
+typedef enum
+{
+    DFH_CMD_NONE = 0, // The thread is done with the last command.
+    DFH_CMD_CONFIGURE,
+    DFH_CMD_STEP,
+    DFH_CMD_RUN,
+    DFH_CMD_COLLECT,
+    DFH_CMD_EXIT,
+} E_DFH_CMD;
+
+struct S_DFH_SIM
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    E_DFH_CMD eCmd;
+    int arg;
+    int ret;
+
+    // Written by the thread of the handle only.
+    S_DFH_CONFIG stConfig;
+    bool bConfigured;
+    int episodesDone;
+    S_DFH_RESULT stResult;
+    int collisions[NUM_AGENTS + 1];
+};
+
+// State of rand() for the thread, set to seed 1 on the first draw as rand() is.
+static DFH_TLS struct random_data gstRandData;
+static DFH_TLS char gRandState[128]; // 128 bytes: the TYPE_3 generator of rand()
+static DFH_TLS bool gbRandSeeded;
+
+void dfh_srand(unsigned int seed)
+{
+    memset(&gstRandData, 0, sizeof(gstRandData));
+    initstate_r(seed, gRandState, sizeof(gRandState), &gstRandData);
+    gbRandSeeded = true;
+}
+
+int dfh_rand(void)
+{
+    int32_t result;
+
+    if (!gbRandSeeded)
+        dfh_srand(1);
+    random_r(&gstRandData, &result);
+    return result;
+}
+
+/*
+ * Commands, run by the thread of the handle
+ */
+static int do_configure(S_DFH_SIM *pSim)
+{
+    S_DFH_CONFIG *pConfig = &(pSim->stConfig);
+
+    setup_piconets(pConfig->numOfAgents, pConfig->seed);
+    set_sweep_point(pConfig->mode, pConfig->numOfChannels, pConfig->hmax);
+    initialize_agents(gstAgents, pConfig->numOfAgents);
+    gRunEpisodes = pConfig->episodes;
+
+    pSim->bConfigured = true;
+    pSim->episodesDone = 0;
+    return DFH_OK;
+}
+
+static int do_step(S_DFH_SIM *pSim, int episodes)
+{
+    int left = pSim->stConfig.episodes - pSim->episodesDone;
+
+    if (!pSim->bConfigured)
+        return DFH_ERR_STATE;
+    if (episodes > left)
+        episodes = left;
+    if (episodes <= 0)
+        return 0;
+
+    if (pSim->episodesDone == 0)
+        run_simulation_begin(gstAgents, pSim->stConfig.numOfAgents);
+    run_episodes(gstAgents, pSim->stConfig.numOfAgents, pSim->episodesDone + 1, pSim->episodesDone + episodes);
+    pSim->episodesDone += episodes;
+    return episodes;
+}
+
+static int do_run(S_DFH_SIM *pSim)
+{
+    if (!pSim->bConfigured)
+        return DFH_ERR_STATE;
+    if (pSim->episodesDone > 0)
+        return do_step(pSim, pSim->stConfig.episodes);
+
+    run_simulation(gstAgents, pSim->stConfig.numOfAgents);
+    pSim->episodesDone = pSim->stConfig.episodes;
+    return pSim->episodesDone;
+}
+
+static int do_collect(S_DFH_SIM *pSim)
+{
+    S_DFH_RESULT *pResult = &(pSim->stResult);
+    int na = pSim->stConfig.numOfAgents;
+    int counted = pSim->episodesDone - PERTURBATION;
+
+    if (!pSim->bConfigured)
+        return DFH_ERR_STATE;
+
+    pResult->episodes = pSim->episodesDone;
+    pResult->numOfAgents = na;
+    pResult->collisions = 0;
+    for (int i = 1; i <= na; i++)
+    {
+        pSim->collisions[i] = total_collisions[i];
+        pResult->collisions += total_collisions[i];
+    }
+    pResult->pcol = (counted > 0) ? pResult->collisions * 1.0 / na / counted : 0.0;
+    pResult->pCollisions = pSim->collisions;
+    return DFH_OK;
+}
+
+static void *sim_thread(void *pArg)
+{
+    S_DFH_SIM *pSim = pArg;
+    E_DFH_CMD eCmd;
+    int ret;
+
+    pthread_mutex_lock(&pSim->lock);
+    for (;;)
+    {
+        while (pSim->eCmd == DFH_CMD_NONE)
+            pthread_cond_wait(&pSim->cond, &pSim->lock);
+        eCmd = pSim->eCmd;
+        pthread_mutex_unlock(&pSim->lock);
+
+        switch (eCmd)
+        {
+        case DFH_CMD_CONFIGURE:
+            ret = do_configure(pSim);
+            break;
+        case DFH_CMD_STEP:
+            ret = do_step(pSim, pSim->arg);
+            break;
+        case DFH_CMD_RUN:
+            ret = do_run(pSim);
+            break;
+        case DFH_CMD_COLLECT:
+            ret = do_collect(pSim);
+            break;
+        default:
+#ifdef HOP_CACHE
+            // The sequences of the cache are allocated per thread.
+            hop_cache_reset();
+#endif
+            ret = DFH_OK;
+            break;
+        }
+
+        pthread_mutex_lock(&pSim->lock);
+        pSim->ret = ret;
+        pSim->eCmd = DFH_CMD_NONE;
+        pthread_cond_broadcast(&pSim->cond);
+        if (eCmd == DFH_CMD_EXIT)
+            break;
+    }
+    pthread_mutex_unlock(&pSim->lock);
+    return NULL;
+}
+
+// Hands a command to the thread of the handle and waits for its result.
+static int call_sim(S_DFH_SIM *pSim, E_DFH_CMD eCmd, int arg)
+{
+    int ret;
+
+    pthread_mutex_lock(&pSim->lock);
+    pSim->eCmd = eCmd;
+    pSim->arg = arg;
+    pthread_cond_broadcast(&pSim->cond);
+    while (pSim->eCmd != DFH_CMD_NONE)
+        pthread_cond_wait(&pSim->cond, &pSim->lock);
+    ret = pSim->ret;
+    pthread_mutex_unlock(&pSim->lock);
+    return ret;
+}
+
+/*
+ * API
+ */
+S_DFH_SIM *dfh_create(void)
+{
+    S_DFH_SIM *pSim = calloc(1, sizeof(S_DFH_SIM));
+
+    if (pSim == NULL)
+        return NULL;
+    pthread_mutex_init(&pSim->lock, NULL);
+    pthread_cond_init(&pSim->cond, NULL);
+    if (pthread_create(&pSim->thread, NULL, sim_thread, pSim) != 0)
+    {
+        pthread_cond_destroy(&pSim->cond);
+        pthread_mutex_destroy(&pSim->lock);
+        free(pSim);
+        return NULL;
+    }
+    return pSim;
+}
+
+void dfh_default_config(S_DFH_CONFIG *pConfig)
+{
+    pConfig->mode = MODE_DFH_RL;
+    pConfig->numOfAgents = NUM_AGENTS;
+    pConfig->numOfChannels = NUM_CHANNELS;
+    pConfig->hmax = 2;
+    pConfig->episodes = MAX_EPISODES;
+    pConfig->seed = DFH_SEED;
+}
+
+int dfh_configure(S_DFH_SIM *pSim, const S_DFH_CONFIG *pConfig)
+{
+    if (pConfig->mode < MODE_LEGACY || pConfig->mode >= MODE_MAX)
+        return DFH_ERR_CONFIG;
+    if (pConfig->numOfAgents < 1 || pConfig->numOfAgents > NUM_AGENTS)
+        return DFH_ERR_CONFIG;
+    if (pConfig->numOfChannels < 20 || pConfig->numOfChannels > NUM_CHANNELS)
+        return DFH_ERR_CONFIG;
+    if (pConfig->hmax < 1 || pConfig->episodes < 1 || pConfig->episodes > MAX_EPISODES)
+        return DFH_ERR_CONFIG;
+
+    // The thread is waiting for a command, so the configuration can be handed over before the call.
+    pSim->stConfig = *pConfig;
+    return call_sim(pSim, DFH_CMD_CONFIGURE, 0);
+}
+
+int dfh_step(S_DFH_SIM *pSim, int episodes)
+{
+    return call_sim(pSim, DFH_CMD_STEP, episodes);
+}
+
+int dfh_run(S_DFH_SIM *pSim)
+{
+    return call_sim(pSim, DFH_CMD_RUN, 0);
+}
+
+int dfh_collect(S_DFH_SIM *pSim, S_DFH_RESULT *pResult)
+{
+    int ret = call_sim(pSim, DFH_CMD_COLLECT, 0);
+
+    if (ret == DFH_OK)
+        *pResult = pSim->stResult;
+    return ret;
+}
+
+void dfh_destroy(S_DFH_SIM *pSim)
+{
+    if (pSim == NULL)
+        return;
+    call_sim(pSim, DFH_CMD_EXIT, 0);
+    pthread_join(pSim->thread, NULL);
+    pthread_cond_destroy(&pSim->cond);
+    pthread_mutex_destroy(&pSim->lock);
+    free(pSim);
+}
+
+#endif /* DFH_LIB */
@@ -0,0 +1,60 @@
+/*
+ * dfh.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef DFH_H_
+#define DFH_H_
+
+// Simulations of libdfh (make lib). A handle keeps the state of its simulation on a thread of its own, so
+// any number of handles can run side by side in one process and be called from any thread. A call returns
+// once the simulation is done with it; the calls on one handle must not overlap.
+//
+//   pSim = dfh_create();
+//   dfh_default_config(&stConfig);
+//   stConfig.mode = 4;
+//   dfh_configure(pSim, &stConfig);
+//   while (dfh_step(pSim, 1000) > 0)
+//       dfh_collect(pSim, &stResult);
+//   dfh_destroy(pSim);
+
+#define DFH_OK 0
+#define DFH_ERR_CONFIG (-1) // A value of S_DFH_CONFIG is out of range.
+#define DFH_ERR_STATE (-2)  // Not configured yet.
+
+typedef struct S_DFH_SIM S_DFH_SIM;
+
+typedef struct
+{
+    int mode;          // E_MODE of marl.h: 0 LFH, 1 LFH-RL, 2 AFH, 3 AFH-RL, 4 DFH-RL
+    int numOfAgents;   // Piconets, 1 to the NUM_AGENTS of the build
+    int numOfChannels; // 20 to 79
+    int hmax;          // DFH-RL hops at most +-hmax channels.
+    int episodes;      // Episodes (2 slots) of the run, up to MAX_EPISODES. The first PERTURBATION are not counted.
+    unsigned int seed; // Positions, clocks and every draw of the run
+} S_DFH_CONFIG;
+
+typedef struct
+{
+    int episodes;           // Episodes run so far
+    int numOfAgents;
+    long long collisions;   // Episodes with a collision after PERTURBATION, all agents
+    double pcol;            // collisions per agent and counted episode, the pcol of marl_main()
+    const int *pCollisions; // Of each agent, from index 1. Valid until the next call on the handle.
+} S_DFH_RESULT;
+
+// NULL when the thread of the simulation can't be started.
+extern S_DFH_SIM *dfh_create(void);
+extern void dfh_default_config(S_DFH_CONFIG *pConfig);
+// Starts a new run from episode 0, also after earlier runs of the handle.
+extern int dfh_configure(S_DFH_SIM *pSim, const S_DFH_CONFIG *pConfig);
+// Runs up to episodes more episodes and returns how many were run, 0 at the end of the run.
+extern int dfh_step(S_DFH_SIM *pSim, int episodes);
+// Runs the rest of the run. Returns the number of episodes run.
+extern int dfh_run(S_DFH_SIM *pSim);
+extern int dfh_collect(S_DFH_SIM *pSim, S_DFH_RESULT *pResult);
+extern void dfh_destroy(S_DFH_SIM *pSim);
+
+#endif /* DFH_H_ */
@@ -0,0 +1,277 @@
+/*
+ * Fast-forward engine for populations where every agent runs MODE_LEGACY or MODE_AFH.
+ *
+ * Neither mode consults the Q-table when choosing a channel, so the channel of every agent is
+ * known for a whole block of episodes once its channel map is fixed (LFH: always, AFH: until its
+ * next 2-second refresh). The block is generated with the batch hop kernel and collisions are then
+ * resolved per episode with a channel occupancy table, O(num_agents) instead of the O(num_agents^2)
+ * scan of calculate_reward().
+ *
+ * The result is identical to run_simulation(), including its sequential update order: while agent i
+ * chooses, agents < i already hold their new channel and agents > i still hold the previous one.
+ * The Q-tables are updated as update_q_table() does, since AFH builds its channel map from them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "fast_forward.h"
+#include "run_length.h"
+#include "collision_log.h"
+#include "live_stats.h"
+#ifdef HOP_CACHE
+#include "hop_cache.h"
+#endif
+
+#ifdef FAST_FORWARD
+
+extern DFH_TLS int episode;
+extern DFH_TLS int gNum_channels;
+extern DFH_TLS int gNumOfAvailCh;
+extern DFH_TLS int collision_map[NUM_AGENTS + 1];
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+#ifdef RUN_LENGTH
+extern DFH_TLS int gCollisionRun[NUM_AGENTS + 1];
+extern DFH_TLS S_RUN_HIST gstRunHist;
+#endif
+extern DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+extern DFH_TLS int prev_cols[NUM_AGENTS + 1];
+#ifdef SYNC_SLOT
+extern DFH_TLS bool gSyncSlot;
+#endif
+extern double setChMapBasedOnQtable(bool *pChMap, q_value_t *pQtable, int noOfUsedCh);
+
+#define FF_NO_REFRESH INT_MAX
+
+// Channels (1-based, as in Agent.current_channel) of each agent for the current block.
+static DFH_TLS uint8_t gFfHops[NUM_AGENTS + 1][FF_BLOCK];
+
+bool can_fast_forward(Agent agents[], int num_agents)
+{
+#if (PHYSICAL_MODE != NONE_MODEL) || defined(WIFI) || defined(HEATMAP) || defined(DEBUG) || defined(SHUFFLE) || defined(TRAFFIC) || defined(MULTI_SLOT) || DEBUG_CH_STATE_1
+    // Fading draws, WiFi bans, idle slots and per-episode traces depend on the slot-by-slot loop.
+    return false;
+#else
+#ifdef SYNC_SLOT
+    // The occupancy rules below follow the sequential update order.
+    if (gSyncSlot)
+        return false;
+#endif
+    for (int i = 1; i <= num_agents; i++)
+    {
+        if (agents[i].hopping_mode != MODE_LEGACY && agents[i].hopping_mode != MODE_AFH)
+            return false;
+    }
+    return true;
+#endif
+}
+
+// First episode >= from at which select_classical_afh_action() refreshes the channel map of the agent.
+static int next_refresh_episode(const Agent *agent, int from)
+{
+    uint32_t base_clk = piconet_queues[agent->id].stHoppingInfo.base_clk;
+    uint32_t current_time = (uint32_t)(from - 1) * 2;
+    uint32_t delta = (3200 - (current_time + base_clk) % 3200) % 3200;
+
+    if (from == 1)
+        return 1; // Initial map at current_time == 0
+    if (delta % 2)
+        return FF_NO_REFRESH; // The clock never lands on a refresh boundary.
+
+    return from + delta / 2;
+}
+
+// Same map update as select_classical_afh_action() (without WiFi, which disables the fast path).
+static void refresh_afh_map(Agent *agent, int current_time)
+{
+    S_HOPPING_INFO *pHopInfo = &(piconet_queues[agent->id].stHoppingInfo);
+    int numOfAvailCh = gNumOfAvailCh;
+
+#ifdef DIFFUSIVE
+    if (agent->hopping_mode == MODE_AFH)
+        numOfAvailCh = 20;
+#endif
+    if (gNumOfAvailCh > gNum_channels)
+        numOfAvailCh = gNum_channels;
+
+    if (current_time == 0)
+    {
+        setChMapBasedOnQtable(pHopInfo->available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), gNum_channels);
+        pHopInfo->noOfCh = gNum_channels;
+    }
+    if (((uint32_t)current_time + pHopInfo->base_clk) % (1600 * 2) == 0)
+    {
+        setChMapBasedOnQtable(pHopInfo->available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), numOfAvailCh);
+        pHopInfo->noOfCh = numOfAvailCh;
+    }
+}
+
+// Fills gFfHops[id][0 .. n) with the channels for episodes first_episode ...
+static void generate_hops(Agent *agent, int first_episode, int n)
+{
+    S_HOPPING_INFO *pHopInfo = &(piconet_queues[agent->id].stHoppingInfo);
+    int first_time = (first_episode - 1) * 2;
+    uint8_t *pHops = gFfHops[agent->id];
+
+#ifdef HOP_CACHE
+    S_HOP_CACHE_ENTRY *pEntry = hop_cache_get_entry(agent->id, pHopInfo);
+
+    // AFH maps are not cached, and runs longer than MAX_EPISODES (gRunEpisodes) go past the cached window.
+    if (pEntry != NULL && first_time + (n - 1) * 2 < (int)pEntry->window)
+    {
+        hop_cache_prefetch(pEntry, first_time, first_time + (n - 1) * 2, 2);
+        for (int k = 0; k < n; k++)
+            pHops[k] = *hop_cache_slot(pEntry, first_time + k * 2) + 1;
+        return;
+    }
+#endif
+    S_AFH_REMAP_TABLE stTable;
+
+    build_afh_remap_table(&stTable, pHopInfo->available_channels, pHopInfo->noOfCh);
+    calculate_hop_sequence(pHopInfo->bdAddr, pHopInfo->base_clk, first_time, 2, n, &stTable, pHops);
+    for (int k = 0; k < n; k++)
+        pHops[k] += 1;
+}
+
+void run_fast_forward(Agent agents[], int num_agents, int last)
+{
+    int cur[NUM_AGENTS + 1];  // Channel of each agent in the previous episode
+    int next[NUM_AGENTS + 1]; // Channel of each agent in this episode
+    bool flag[NUM_AGENTS + 1];
+    int refresh[NUM_AGENTS + 1];
+    // Occupancy of this and the previous episode, indexed by channel.
+    int cntNew[NUM_CHANNELS + 1];
+    int minNew[NUM_CHANNELS + 1];
+    int maxNew[NUM_CHANNELS + 1];
+    int maxOld[NUM_CHANNELS + 1];
+    int first_episode, last_episode, n;
+
+    for (int i = 1; i <= num_agents; i++)
+    {
+        cur[i] = agents[i].current_channel;
+        flag[i] = agents[i].isCurChCollied;
+        refresh[i] = (agents[i].hopping_mode == MODE_AFH) ? next_refresh_episode(&agents[i], 1) : FF_NO_REFRESH;
+    }
+
+    memset(maxOld, 0, sizeof(maxOld));
+    for (int i = 1; i <= num_agents; i++)
+    {
+        if (maxOld[cur[i]] < i)
+            maxOld[cur[i]] = i;
+    }
+
+    for (first_episode = 1; first_episode <= last; first_episode = last_episode + 1)
+    {
+        // The block ends at the first map refresh of any AFH agent.
+        last_episode = first_episode + FF_BLOCK - 1;
+        if (last_episode > last)
+            last_episode = last;
+        for (int i = 1; i <= num_agents; i++)
+        {
+            if (refresh[i] < last_episode)
+                last_episode = refresh[i];
+        }
+        n = last_episode - first_episode + 1;
+
+        for (int i = 1; i <= num_agents; i++)
+            generate_hops(&agents[i], first_episode, n);
+
+        for (int k = 0; k < n; k++)
+        {
+            episode = first_episode + k;
+
+            if (episode <= PERTURBATION)
+            {
+                for (int i = 1; i <= num_agents; i++)
+                {
+                    total_collisions[i] = 0;
+                    total_wifi_collisions[i] = 0;
+                    prev_cols[i] = 0;
+#ifdef RUN_LENGTH
+                    gCollisionRun[i] = 0;
+#endif
+                }
+            }
+
+            memset(cntNew, 0, sizeof(cntNew));
+            memset(maxNew, 0, sizeof(maxNew));
+            for (int i = num_agents; i >= 1; i--)
+            {
+                next[i] = gFfHops[i][k];
+                cntNew[next[i]]++;
+                minNew[next[i]] = i;
+                if (maxNew[next[i]] == 0)
+                    maxNew[next[i]] = i;
+            }
+
+            for (int i = 1; i <= num_agents; i++)
+            {
+                // An agent < i picked the channel i still holds from the previous episode.
+                bool bStaleHit = (cntNew[cur[i]] > 0 && minNew[cur[i]] < i);
+                // Another agent picked the same channel, or an agent > i still holds it from the previous episode.
+                bool bCollided = (cntNew[next[i]] > 1 || maxOld[next[i]] > i);
+
+                if (episode > 1)
+                {
+                    double reward = ((flag[i] || bStaleHit) * -1);
+                    q_value_t *pQ = agents[i].q_table[E_ACTION_TYPE_DEFAULT];
+
+                    // update_q_table(): the next action of both modes is the hop of this episode.
+                    pQ[cur[i]] = Q_STORE(Q_LOAD(pQ[cur[i]]) + ALPHA * (reward + GAMMA * Q_LOAD(pQ[next[i]]) - Q_LOAD(pQ[cur[i]])));
+                    agents[i].cumulative_reward = reward + GAMMA * agents[i].cumulative_reward;
+                }
+
+                collision_map[i] = (bCollided || (bStaleHit && !flag[i])) ? 1 : 0;
+                flag[i] = bCollided;
+            }
+
+            for (int i = 1; i <= num_agents; i++)
+            {
+                total_collisions[i] += collision_map[i];
+#ifdef RUN_LENGTH
+                run_length_track(&gCollisionRun[i], &gstRunHist, collision_map[i] != 0);
+#endif
+#ifdef COLLISION_LOG
+                collision_log_add(i, episode, collision_map[i] != 0);
+#endif
+                collision_map[i] = 0;
+#ifdef DETERMINISTIC
+                if (gpfHopHook != NULL)
+                    gpfHopHook(i, next[i], episode);
+#endif
+                agents[i].last_channel = cur[i];
+                cur[i] = next[i];
+            }
+            memcpy(maxOld, maxNew, sizeof(maxOld));
+#ifdef LIVE_STATS
+            live_stats_tick(episode, num_agents);
+#endif
+        }
+
+        for (int i = 1; i <= num_agents; i++)
+        {
+            if (refresh[i] == last_episode)
+            {
+                refresh_afh_map(&agents[i], (last_episode - 1) * 2);
+                refresh[i] = next_refresh_episode(&agents[i], last_episode + 1);
+            }
+        }
+    }
+
+    for (int i = 1; i <= num_agents; i++)
+    {
+        agents[i].current_channel = cur[i];
+        agents[i].isCurChCollied = flag[i];
+        agents[i].last_action = E_ACTION_TYPE_DEFAULT;
+        agents[i].interferer_count = 0;
+        memset(agents[i].interferers_bitmap, 0, sizeof(agents[i].interferers_bitmap));
+    }
+    episode = last + 1;
+}
+
+#endif /* FAST_FORWARD */
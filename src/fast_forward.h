@@ -0,0 +1,17 @@
+/*
+ * fast_forward.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef FAST_FORWARD_H_
+#define FAST_FORWARD_H_
+
+// Number of episodes whose hops are generated per agent in one batch.
+#define FF_BLOCK 1024
+
+extern bool can_fast_forward(Agent agents[], int num_agents);
+extern void run_fast_forward(Agent agents[], int num_agents, int last);
+
+#endif /* FAST_FORWARD_H_ */
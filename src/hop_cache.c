@@ -0,0 +1,317 @@
+/*
+ * Hop-sequence cache.
+ *
+ * For a fixed channel map the channel a piconet uses at a given clock is a pure function of
+ * (bdAddr, base_clk, channel map), so the sequence is materialized once, one byte per clock value,
+ * and reused by every sweep point and hopping mode that hops over the same map.
+ * Only the static maps (the first noOfCh channels, as set by initialize_agents) are cached. An AFH
+ * map lives between two refreshes and is derived from the Q-table, so it is hardly ever met again;
+ * its hops are computed directly. Entries are found through a hash of (bdAddr, base_clk, noOfCh).
+ * In memory, a sequence is allocated chunk by chunk as its slots are used, so a short run costs
+ * no more than the slots it visits.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "hop_cache.h"
+
+#ifdef HOP_CACHE
+
+#ifdef HOP_CACHE_DIR
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Entries and their hash index (open addressing, -1 if free), allocated on first use.
+static DFH_TLS S_HOP_CACHE_ENTRY *gpHopCache;
+static DFH_TLS int *gpHopCacheIndex;
+static DFH_TLS int gHopCacheIndexMask;
+static DFH_TLS int gNumOfHopCache = 0;
+// Entry last used by each piconet. Checked against the hopping info before each use.
+static DFH_TLS S_HOP_CACHE_ENTRY *gpHopCacheCur[MAX_PICONNETS + 1];
+
+// 79 channels on then 79 off: the static map of n channels is the 79 bytes from 79 - n.
+static const bool gStaticMaps[2 * 79] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+static bool is_static_map(const S_HOPPING_INFO *pHopInfo)
+{
+    return pHopInfo->noOfCh <= 79 && memcmp(pHopInfo->available_channels, &gStaticMaps[79 - pHopInfo->noOfCh], 79) == 0;
+}
+
+static bool is_same_key(const S_HOP_CACHE_KEY *pKey, const S_HOPPING_INFO *pHopInfo)
+{
+    return pKey->bdAddr == pHopInfo->bdAddr && pKey->base_clk == pHopInfo->base_clk && pKey->noOfCh == pHopInfo->noOfCh;
+}
+
+static unsigned int hash_key(const S_HOPPING_INFO *pHopInfo)
+{
+    uint64_t h = pHopInfo->bdAddr * 0x9E3779B97F4A7C15ULL;
+
+    h ^= ((uint64_t)pHopInfo->base_clk << 8 | pHopInfo->noOfCh) * 0xC2B2AE3D27D4EB4FULL;
+    return (unsigned int)(h >> 32);
+}
+
+#ifdef HOP_CACHE_DIR
+static uint8_t *map_file(int fd, uint32_t window)
+{
+    void *pMap = mmap(NULL, window, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+    return (pMap == MAP_FAILED) ? NULL : (uint8_t *)pMap;
+}
+
+// A file under its final name is always complete: it is created and marked empty under a temporary
+// name, then linked into place. Of two processes creating the same file, the second maps the first's.
+static uint8_t *map_sequence_file(const S_HOP_CACHE_KEY *pKey, uint32_t window)
+{
+    char path[256], tmp[272];
+    struct stat st;
+    int fd;
+    uint8_t *pMap;
+
+    mkdir(HOP_CACHE_DIR, 0755);
+    sprintf(path, "%s/hop_%012llx_%08x_%02d_%u.bin", HOP_CACHE_DIR, (unsigned long long)pKey->bdAddr, pKey->base_clk, pKey->noOfCh, window);
+
+    fd = open(path, O_RDWR);
+    if (fd >= 0)
+    {
+        if (fstat(fd, &st) != 0 || st.st_size != window)
+        {
+            close(fd);
+            return NULL;
+        }
+        return map_file(fd, window);
+    }
+    if (errno != ENOENT)
+        return NULL;
+
+    sprintf(tmp, "%s.XXXXXX", path);
+    fd = mkstemp(tmp);
+    if (fd < 0)
+        return NULL;
+    if (fchmod(fd, 0644) != 0 || ftruncate(fd, window) != 0)
+    {
+        close(fd);
+        unlink(tmp);
+        return NULL;
+    }
+    pMap = map_file(fd, window);
+    if (pMap == NULL)
+    {
+        unlink(tmp);
+        return NULL;
+    }
+    // Sparse regions of a new file read back as zero, which is a valid channel. Mark them empty.
+    memset(pMap, HOP_CACHE_EMPTY, window);
+
+    if (link(tmp, path) != 0)
+    {
+        int err = errno;
+
+        unlink(tmp);
+        munmap(pMap, window);
+        if (err != EEXIST)
+            return NULL;
+        fd = open(path, O_RDWR);
+        return (fd < 0) ? NULL : map_file(fd, window);
+    }
+    unlink(tmp);
+
+    return pMap;
+}
+#endif
+
+static void release_entry(S_HOP_CACHE_ENTRY *pEntry)
+{
+#ifdef HOP_CACHE_DIR
+    if (pEntry->pMap != NULL)
+    {
+        munmap(pEntry->pMap, pEntry->window);
+        pEntry->pMap = NULL;
+        memset(pEntry->pChunks, 0, sizeof(pEntry->pChunks));
+        return;
+    }
+#endif
+    for (int i = 0; i < HOP_CACHE_CHUNKS; i++)
+    {
+        free(pEntry->pChunks[i]);
+        pEntry->pChunks[i] = NULL;
+    }
+}
+
+static void *alloc_or_exit(size_t size)
+{
+    void *p = calloc(1, size);
+
+    if (p == NULL)
+    {
+        printf("hop cache: out of memory. Exiting.\n");
+        exit(777);
+    }
+    return p;
+}
+
+// Slot of current_time (below the window), its chunk allocated and marked empty when first used.
+uint8_t *hop_cache_slot(S_HOP_CACHE_ENTRY *pEntry, int current_time)
+{
+    uint8_t **ppChunk = &pEntry->pChunks[current_time / HOP_CACHE_CHUNK];
+
+    if (*ppChunk == NULL)
+    {
+        *ppChunk = (uint8_t *)alloc_or_exit(HOP_CACHE_CHUNK);
+        memset(*ppChunk, HOP_CACHE_EMPTY, HOP_CACHE_CHUNK);
+    }
+    return *ppChunk + current_time % HOP_CACHE_CHUNK;
+}
+
+static S_HOP_CACHE_ENTRY *new_entry(S_HOPPING_INFO *pHopInfo, int *pIndexSlot)
+{
+    S_HOP_CACHE_ENTRY *pEntry = &gpHopCache[gNumOfHopCache];
+
+    *pIndexSlot = gNumOfHopCache++;
+    pEntry->key.bdAddr = pHopInfo->bdAddr;
+    pEntry->key.base_clk = pHopInfo->base_clk;
+    pEntry->key.noOfCh = pHopInfo->noOfCh;
+    pEntry->window = HOP_CACHE_WINDOW;
+
+#ifdef HOP_CACHE_DIR
+    pEntry->pMap = map_sequence_file(&pEntry->key, pEntry->window);
+    if (pEntry->pMap != NULL)
+    {
+        for (int i = 0; i < HOP_CACHE_CHUNKS; i++)
+            pEntry->pChunks[i] = pEntry->pMap + i * HOP_CACHE_CHUNK;
+    }
+#endif
+#ifdef HOP_BATCH
+    build_afh_remap_table(&pEntry->stTable, pHopInfo->available_channels, pHopInfo->noOfCh);
+#endif
+    return pEntry;
+}
+
+S_HOP_CACHE_ENTRY *hop_cache_get_entry(int picoId, S_HOPPING_INFO *pHopInfo)
+{
+    S_HOP_CACHE_ENTRY *pEntry = gpHopCacheCur[picoId];
+    unsigned int slot;
+
+    if (!is_static_map(pHopInfo))
+        return NULL;
+    if (pEntry != NULL && is_same_key(&pEntry->key, pHopInfo))
+        return pEntry;
+
+    if (gpHopCache == NULL)
+    {
+        gHopCacheIndexMask = 1;
+        while (gHopCacheIndexMask < 2 * HOP_CACHE_MAX_ENTRIES)
+            gHopCacheIndexMask <<= 1;
+        gpHopCache = (S_HOP_CACHE_ENTRY *)alloc_or_exit(sizeof(S_HOP_CACHE_ENTRY) * HOP_CACHE_MAX_ENTRIES);
+        gpHopCacheIndex = (int *)alloc_or_exit(sizeof(int) * gHopCacheIndexMask);
+        memset(gpHopCacheIndex, -1, sizeof(int) * gHopCacheIndexMask);
+        gHopCacheIndexMask--;
+    }
+    // Full: start over rather than pick a victim. A sweep uses far fewer maps than the table holds.
+    if (gNumOfHopCache == HOP_CACHE_MAX_ENTRIES)
+        hop_cache_reset();
+
+    for (slot = hash_key(pHopInfo) & gHopCacheIndexMask;; slot = (slot + 1) & gHopCacheIndexMask)
+    {
+        if (gpHopCacheIndex[slot] < 0)
+        {
+            pEntry = new_entry(pHopInfo, &gpHopCacheIndex[slot]);
+            break;
+        }
+        if (is_same_key(&gpHopCache[gpHopCacheIndex[slot]].key, pHopInfo))
+        {
+            pEntry = &gpHopCache[gpHopCacheIndex[slot]];
+            break;
+        }
+    }
+    gpHopCacheCur[picoId] = pEntry;
+
+    return pEntry;
+}
+
+uint8_t hop_cache_lookup(int picoId, S_HOPPING_INFO *pHopInfo, int current_time)
+{
+    S_HOP_CACHE_ENTRY *pEntry;
+    uint8_t *pSlot;
+
+    if (current_time < 0 || current_time >= HOP_CACHE_WINDOW || (pEntry = hop_cache_get_entry(picoId, pHopInfo)) == NULL)
+        return calculate_next_frequency(pHopInfo->bdAddr, ((uint32_t)current_time + pHopInfo->base_clk) << 1, pHopInfo->available_channels, pHopInfo->noOfCh);
+
+    pSlot = hop_cache_slot(pEntry, current_time);
+
+    if (*pSlot == HOP_CACHE_EMPTY)
+    {
+#ifdef HOP_BATCH
+        // The simulator advances two slots per episode, so fill the next HOP_BATCH_WIDTH episodes at once.
+        hop_cache_prefetch(pEntry, current_time, current_time + 2 * (HOP_BATCH_WIDTH - 1), 2);
+#else
+        *pSlot = calculate_next_frequency(pHopInfo->bdAddr, ((uint32_t)current_time + pHopInfo->base_clk) << 1, pHopInfo->available_channels, pHopInfo->noOfCh);
+#endif
+    }
+
+    return *pSlot;
+}
+
+// Materializes the slots first_time, first_time + time_step, ... up to last_time (inclusive).
+void hop_cache_prefetch(S_HOP_CACHE_ENTRY *pEntry, int first_time, int last_time, int time_step)
+{
+    S_HOP_CACHE_KEY *pKey = &(pEntry->key);
+
+    if (first_time < 0)
+        first_time = 0;
+    if (last_time >= (int)pEntry->window)
+        last_time = pEntry->window - 1;
+
+#ifdef HOP_BATCH
+    uint8_t hops[HOP_BATCH_WIDTH * 64];
+    int n;
+
+    while (first_time <= last_time)
+    {
+        n = (last_time - first_time) / time_step + 1;
+        if (n > HOP_BATCH_WIDTH * 64)
+            n = HOP_BATCH_WIDTH * 64;
+
+        calculate_hop_sequence(pKey->bdAddr, pKey->base_clk, first_time, time_step, n, &pEntry->stTable, hops);
+        for (int i = 0; i < n; i++)
+            *hop_cache_slot(pEntry, first_time + i * time_step) = hops[i];
+
+        first_time += n * time_step;
+    }
+#else
+    bool channels[79];
+    uint8_t *pSlot;
+
+    memcpy(channels, &gStaticMaps[79 - pKey->noOfCh], sizeof(channels));
+    for (int t = first_time; t <= last_time; t += time_step)
+    {
+        pSlot = hop_cache_slot(pEntry, t);
+        if (*pSlot == HOP_CACHE_EMPTY)
+            *pSlot = calculate_next_frequency(pKey->bdAddr, ((uint32_t)t + pKey->base_clk) << 1, channels, pKey->noOfCh);
+    }
+#endif
+}
+
+void hop_cache_reset(void)
+{
+    for (int i = 0; i < gNumOfHopCache; i++)
+        release_entry(&gpHopCache[i]);
+    if (gpHopCacheIndex != NULL)
+        memset(gpHopCacheIndex, -1, sizeof(int) * (gHopCacheIndexMask + 1));
+
+    memset(gpHopCacheCur, 0, sizeof(gpHopCacheCur));
+    gNumOfHopCache = 0;
+}
+
+#endif /* HOP_CACHE */
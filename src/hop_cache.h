@@ -0,0 +1,49 @@
+/*
+ * hop_cache.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef HOP_CACHE_H_
+#define HOP_CACHE_H_
+
+// current_time runs from 0 to 2 * MAX_EPISODES, one byte of sequence per clock value.
+#define HOP_CACHE_WINDOW (MAX_EPISODES * 2 + 2)
+// Sequences in memory are allocated in chunks of this many clock values, when a slot of the chunk is first used.
+#define HOP_CACHE_CHUNK 4096
+#define HOP_CACHE_CHUNKS ((HOP_CACHE_WINDOW + HOP_CACHE_CHUNK - 1) / HOP_CACHE_CHUNK)
+// Sequences kept: one per channel count of the sweep (12) for every piconet. The cache is emptied when full.
+#define HOP_CACHE_MAX_ENTRIES (16 * (MAX_PICONNETS + 1))
+// Marks a slot whose channel has not been computed yet (valid channels are 0..78).
+#define HOP_CACHE_EMPTY 0xFF
+// Directory for disk-backed (mmap) sequences. Comment out to keep the cache in memory only.
+// #define HOP_CACHE_DIR "hopcache"
+
+// Only the static maps (the first noOfCh channels) are cached, so the channel count stands for the map.
+typedef struct
+{
+    uint64_t bdAddr;
+    uint32_t base_clk;
+    uint8_t noOfCh;
+} S_HOP_CACHE_KEY;
+
+typedef struct
+{
+    S_HOP_CACHE_KEY key;
+    uint8_t *pChunks[HOP_CACHE_CHUNKS]; // Channel per current_time, HOP_CACHE_EMPTY until computed.
+    uint8_t *pMap;                      // mmap of the whole window from a file under HOP_CACHE_DIR, or NULL.
+    uint32_t window;
+#ifdef HOP_BATCH
+    S_AFH_REMAP_TABLE stTable; // Channel map compiled for the batch kernel.
+#endif
+} S_HOP_CACHE_ENTRY;
+
+// NULL when the map of pHopInfo is not static: AFH maps are not cached.
+extern S_HOP_CACHE_ENTRY *hop_cache_get_entry(int picoId, S_HOPPING_INFO *pHopInfo);
+extern uint8_t hop_cache_lookup(int picoId, S_HOPPING_INFO *pHopInfo, int current_time);
+extern void hop_cache_prefetch(S_HOP_CACHE_ENTRY *pEntry, int first_time, int last_time, int time_step);
+extern uint8_t *hop_cache_slot(S_HOP_CACHE_ENTRY *pEntry, int current_time);
+extern void hop_cache_reset(void);
+
+#endif /* HOP_CACHE_H_ */
@@ -0,0 +1,286 @@
+/*
+ * External interference schedule.
+ *
+ * A schedule is a list of APs, each blocking a channel range while it is up and, optionally, only for
+ * `on` episodes out of every `period`. INTERFERENCE_CONFIG has one AP per line:
+ *
+ *   # ap <first_ch> <last_ch> <start> <end> [<period> <on> [<phase>]]
+ *   ap 25 47 30% 70%
+ *   ap 1 21 20000 90000 16 4
+ *
+ * Channels are 1-based and inclusive; start and end are episodes, or a percentage of MAX_EPISODES.
+ * The schedule is compiled once into windows of episodes with a constant 79-bit mask of blocked
+ * channels. interference_seek() moves to the window of an episode, so the collision check is one bit
+ * test of gIntfMask.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "interference.h"
+
+#ifdef INTERFERENCE_SCHEDULE
+
+#ifndef WIFI
+#error "INTERFERENCE_SCHEDULE replaces the WiFi bands and needs WIFI."
+#endif
+
+typedef struct
+{
+    int episode;
+    int ap;
+    int delta; // +1: the AP turns on, -1: it turns off.
+} S_INTF_EDGE;
+
+uint64_t gIntfMask[2];
+
+static S_INTF_AP gIntfAps[INTF_MAX_APS];
+static int gNumOfIntfAps = -1; // -1: not loaded yet
+static S_INTF_WINDOW *gpIntfWindows;
+static int gNumOfIntfWindows;
+static int gIntfCur;
+static int gIntfFirst, gIntfLast;
+
+static S_INTF_EDGE *gpIntfEdges;
+static int gNumOfIntfEdges, gIntfEdgeCap;
+
+// "1234" is an episode, "30%" a share of MAX_EPISODES.
+static double parse_episode(const char *pStr)
+{
+    char *pEnd;
+    double value = strtod(pStr, &pEnd);
+
+    if (pEnd == pStr)
+    {
+        printf("%s: bad episode '%s'. Exiting.\n", INTERFERENCE_CONFIG, pStr);
+        exit(777);
+    }
+    if (*pEnd == '%')
+        value = value / 100.0 * MAX_EPISODES;
+
+    return value;
+}
+
+static bool read_config(void)
+{
+    FILE *fp = fopen(INTERFERENCE_CONFIG, "r");
+    char line[256], start[32], end[32];
+    S_INTF_AP stAp;
+    int n, lineNo = 0;
+
+    if (fp == NULL)
+        return false;
+
+    gNumOfIntfAps = 0;
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        lineNo++;
+        if (line[strspn(line, " \t\r\n")] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+            continue;
+
+        memset(&stAp, 0, sizeof(stAp));
+        n = sscanf(line, " ap %d %d %31s %31s %d %d %d", &stAp.first_ch, &stAp.last_ch, start, end, &stAp.period, &stAp.on, &stAp.phase);
+        if (n < 4 || n == 5 || stAp.first_ch < 1 || stAp.last_ch > NUM_CHANNELS || stAp.first_ch > stAp.last_ch || stAp.period < 0 || stAp.on < 0 || stAp.phase < 0)
+        {
+            printf("%s:%d: expected 'ap <first_ch> <last_ch> <start> <end> [<period> <on> [<phase>]]'. Exiting.\n", INTERFERENCE_CONFIG, lineNo);
+            exit(777);
+        }
+        if (gNumOfIntfAps == INTF_MAX_APS)
+        {
+            printf("%s: more than %d APs. Exiting.\n", INTERFERENCE_CONFIG, INTF_MAX_APS);
+            exit(777);
+        }
+        stAp.start = parse_episode(start);
+        stAp.end = parse_episode(end);
+        gIntfAps[gNumOfIntfAps++] = stAp;
+    }
+    fclose(fp);
+
+    return true;
+}
+
+static void add_edge(int episode, int ap, int delta)
+{
+    if (gNumOfIntfEdges == gIntfEdgeCap)
+    {
+        gIntfEdgeCap = gIntfEdgeCap ? gIntfEdgeCap * 2 : 256;
+        gpIntfEdges = realloc(gpIntfEdges, gIntfEdgeCap * sizeof(S_INTF_EDGE));
+        if (gpIntfEdges == NULL)
+        {
+            printf("interference: out of memory. Exiting.\n");
+            exit(777);
+        }
+    }
+    gpIntfEdges[gNumOfIntfEdges].episode = episode;
+    gpIntfEdges[gNumOfIntfEdges].ap = ap;
+    gpIntfEdges[gNumOfIntfEdges].delta = delta;
+    gNumOfIntfEdges++;
+}
+
+// Adds the on-interval [first, last] of the AP, clipped to the simulated episodes.
+static void add_interval(int ap, int first, int last)
+{
+    if (first < 1)
+        first = 1;
+    if (last > MAX_EPISODES)
+        last = MAX_EPISODES;
+    if (first > last)
+        return;
+
+    add_edge(first, ap, 1);
+    add_edge(last + 1, ap, -1);
+
+    if (gIntfFirst == 0 || first < gIntfFirst)
+        gIntfFirst = first;
+    if (last > gIntfLast)
+        gIntfLast = last;
+}
+
+static int compare_edge(const void *pA, const void *pB)
+{
+    return ((const S_INTF_EDGE *)pA)->episode - ((const S_INTF_EDGE *)pB)->episode;
+}
+
+static void compile_windows(void)
+{
+    uint64_t apMask[INTF_MAX_APS][2];
+    int upCount[INTF_MAX_APS];
+    uint64_t mask[2];
+    S_INTF_AP *pAp;
+    int first, last, e, k;
+
+    for (k = 0; k < gNumOfIntfAps; k++)
+    {
+        pAp = &gIntfAps[k];
+        apMask[k][0] = apMask[k][1] = 0;
+        for (int ch = pAp->first_ch; ch <= pAp->last_ch; ch++)
+            apMask[k][(ch - 1) >> 6] |= 1ULL << ((ch - 1) & 63);
+
+        // Same window as the WiFi macros: start <= episode <= end.
+        first = (int)pAp->start;
+        if (first < pAp->start)
+            first++;
+        last = (int)pAp->end;
+
+        if (pAp->period == 0)
+        {
+            add_interval(k, first, last);
+        }
+        else
+        {
+            for (int s = first + pAp->phase; s <= last && s <= MAX_EPISODES; s += pAp->period)
+                add_interval(k, s, (s + pAp->on - 1 < last) ? s + pAp->on - 1 : last);
+        }
+    }
+
+    qsort(gpIntfEdges, gNumOfIntfEdges, sizeof(S_INTF_EDGE), compare_edge);
+
+    // At most one window per edge, plus the one starting at episode 1.
+    gpIntfWindows = malloc((gNumOfIntfEdges + 1) * sizeof(S_INTF_WINDOW));
+    if (gpIntfWindows == NULL)
+    {
+        printf("interference: out of memory. Exiting.\n");
+        exit(777);
+    }
+    memset(upCount, 0, sizeof(upCount));
+    gpIntfWindows[0].start = 1;
+    gpIntfWindows[0].mask[0] = gpIntfWindows[0].mask[1] = 0;
+    gNumOfIntfWindows = 1;
+
+    for (e = 0; e < gNumOfIntfEdges;)
+    {
+        int episode = gpIntfEdges[e].episode;
+
+        for (; e < gNumOfIntfEdges && gpIntfEdges[e].episode == episode; e++)
+            upCount[gpIntfEdges[e].ap] += gpIntfEdges[e].delta;
+
+        mask[0] = mask[1] = 0;
+        for (k = 0; k < gNumOfIntfAps; k++)
+        {
+            if (upCount[k] > 0)
+            {
+                mask[0] |= apMask[k][0];
+                mask[1] |= apMask[k][1];
+            }
+        }
+
+        if (mask[0] == gpIntfWindows[gNumOfIntfWindows - 1].mask[0] && mask[1] == gpIntfWindows[gNumOfIntfWindows - 1].mask[1])
+            continue;
+        if (gpIntfWindows[gNumOfIntfWindows - 1].start == episode)
+            gNumOfIntfWindows--;
+        gpIntfWindows[gNumOfIntfWindows].start = episode;
+        gpIntfWindows[gNumOfIntfWindows].mask[0] = mask[0];
+        gpIntfWindows[gNumOfIntfWindows].mask[1] = mask[1];
+        gNumOfIntfWindows++;
+    }
+
+    free(gpIntfEdges);
+    gpIntfEdges = NULL;
+    gNumOfIntfEdges = gIntfEdgeCap = 0;
+}
+
+// Loads INTERFERENCE_CONFIG, or takes the default APs if there is none. Only the first call does anything.
+void interference_load(const S_INTF_AP *pDefault, int numOfDefault)
+{
+    if (gNumOfIntfAps >= 0)
+        return;
+
+    if (read_config() == false)
+    {
+        memcpy(gIntfAps, pDefault, numOfDefault * sizeof(S_INTF_AP));
+        gNumOfIntfAps = numOfDefault;
+    }
+    compile_windows();
+
+    gIntfCur = 0;
+    gIntfMask[0] = gpIntfWindows[0].mask[0];
+    gIntfMask[1] = gpIntfWindows[0].mask[1];
+}
+
+void interference_seek(int episode)
+{
+    if (episode < gpIntfWindows[gIntfCur].start)
+        gIntfCur = 0;
+    while (gIntfCur + 1 < gNumOfIntfWindows && gpIntfWindows[gIntfCur + 1].start <= episode)
+        gIntfCur++;
+
+    gIntfMask[0] = gpIntfWindows[gIntfCur].mask[0];
+    gIntfMask[1] = gpIntfWindows[gIntfCur].mask[1];
+}
+
+// First episode of the next window, -1 after the last one.
+int interference_next_change(void)
+{
+    return (gIntfCur + 1 < gNumOfIntfWindows) ? gpIntfWindows[gIntfCur + 1].start : -1;
+}
+
+bool interference_active(void)
+{
+    return (gIntfMask[0] | gIntfMask[1]) != 0;
+}
+
+int interference_ap_count(void)
+{
+    return gNumOfIntfAps;
+}
+
+const S_INTF_AP *interference_ap(int k)
+{
+    return &gIntfAps[k];
+}
+
+// First and last episode with any AP on, 0 if none is.
+int interference_first_episode(void)
+{
+    return gIntfFirst;
+}
+
+int interference_last_episode(void)
+{
+    return gIntfLast;
+}
+
+#endif /* INTERFERENCE_SCHEDULE */
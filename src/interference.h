@@ -0,0 +1,49 @@
+/*
+ * interference.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef INTERFERENCE_H_
+#define INTERFERENCE_H_
+
+// Schedule read at the first run. Without it, the WiFi APs of marl.c are used.
+#define INTERFERENCE_CONFIG "interference.cfg"
+#define INTF_MAX_APS 32
+
+typedef struct
+{
+    int first_ch; // 1-based, inclusive
+    int last_ch;
+    double start; // Episodes the AP is up, start <= episode <= end
+    double end;
+    int period; // Duty cycle in episodes. 0: always on while up.
+    int on;     // Episodes on per period, from start + phase.
+    int phase;
+} S_INTF_AP;
+
+typedef struct
+{
+    int start;        // First episode of the window, which lasts until the next window starts.
+    uint64_t mask[2]; // Bit (channel - 1) is set for a blocked channel.
+} S_INTF_WINDOW;
+
+// Blocked channels of the window set by interference_seek().
+extern uint64_t gIntfMask[2];
+
+extern void interference_load(const S_INTF_AP *pDefault, int numOfDefault);
+extern void interference_seek(int episode);
+extern int interference_next_change(void);
+extern bool interference_active(void);
+extern int interference_ap_count(void);
+extern const S_INTF_AP *interference_ap(int k);
+extern int interference_first_episode(void);
+extern int interference_last_episode(void);
+
+static inline bool interference_blocked(int channel)
+{
+    return (gIntfMask[(channel - 1) >> 6] >> ((channel - 1) & 63)) & 1;
+}
+
+#endif /* INTERFERENCE_H_ */
@@ -0,0 +1,229 @@
+/*
+ * Live counters of a sweep (live_stats.h).
+ *
+ * With LIVE_STATS, marl_main creates the segment /dev/shm/dfh_live.<pid> and publishes the sweep point it
+ * runs, the episode, the slot rate, the running pcol, the resident memory and the pcol of every mode so
+ * far. The episode loops call live_stats_tick(), which only masks the episode; every LIVE_STATS_PERIOD
+ * episodes the clock is read, and the segment is written when LIVE_STATS_INTERVAL_MS have passed, so the
+ * hot loop pays neither a system call nor a cache line shared with the reader. The segment is removed
+ * when the sweep ends; tools/dfh_top removes the ones of processes that are gone.
+ *
+ * With SWEEP_SCHEDULER, sweep_run_job() publishes the jobs instead of marl_main. Each forked worker has a
+ * segment of its own pid for the jobs it runs, and the segment of the sweep records the jobs as the
+ * workers finish them (with SWEEP_SHARD, the jobs this process runs, as it runs them). With ADAPTIVE_SWEEP,
+ * the points are published as the refinement runs them, with no estimate of the points left.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "live_stats.h"
+
+#ifdef LIVE_STATS
+
+_Static_assert(LIVE_STATS_MODES == MODE_MAX, "LIVE_STATS_MODES is the number of modes");
+
+extern DFH_TLS int gModeDefault;
+extern DFH_TLS int gNumOfAvailCh;
+extern DFH_TLS int HMAX;
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+
+static DFH_TLS S_LIVE_STATS *gpLive;
+static DFH_TLS char gLiveName[64];
+static DFH_TLS double gLiveStart, gLiveLast; // Seconds, CLOCK_MONOTONIC
+static DFH_TLS int gLiveEpisode;             // Last tick of the current point, 0 if it was served without running
+static DFH_TLS uint64_t gLiveSlots;          // Slots of the points done
+static DFH_TLS uint64_t gLiveLastSlots;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t resident_bytes(void)
+{
+    unsigned long size, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+
+    if (fp == NULL)
+        return 0;
+    if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+        resident = 0;
+    fclose(fp);
+    return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+static void write_begin(void)
+{
+    __atomic_store_n(&gpLive->seq, gpLive->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void write_end(void)
+{
+    __atomic_store_n(&gpLive->seq, gpLive->seq + 1, __ATOMIC_RELEASE);
+}
+
+// Counters that move within a point. The caller holds the write.
+static void publish(int episode, int num_agents, double t)
+{
+    uint64_t slots = gLiveSlots + (uint64_t)episode * 2;
+    int64_t tally = 0;
+
+    for (int i = 1; i <= num_agents; i++)
+        tally += total_collisions[i];
+    gpLive->episode = episode;
+    gpLive->slots = slots;
+    gpLive->pcol = (episode > PERTURBATION) ? tally * 1.0 / num_agents / (episode - PERTURBATION) : 0.0;
+    gpLive->elapsed = t - gLiveStart;
+    if (t > gLiveLast)
+        gpLive->slotsPerSec = (slots - gLiveLastSlots) / (t - gLiveLast);
+    gpLive->rssBytes = resident_bytes();
+    gLiveLast = t;
+    gLiveLastSlots = slots;
+}
+
+static void create_segment(void)
+{
+    int fd;
+
+    snprintf(gLiveName, sizeof(gLiveName), LIVE_STATS_NAME, (int)getpid());
+    fd = shm_open(gLiveName, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(S_LIVE_STATS)) != 0)
+    {
+        printf("live stats: can't create /dev/shm%s. Exiting.\n", gLiveName);
+        exit(777);
+    }
+    gpLive = mmap(NULL, sizeof(S_LIVE_STATS), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (gpLive == MAP_FAILED)
+    {
+        printf("live stats: can't map /dev/shm%s. Exiting.\n", gLiveName);
+        exit(777);
+    }
+    // The segment is zero-filled, so seq starts even.
+    write_begin();
+    gpLive->magic = LIVE_STATS_MAGIC;
+    gpLive->version = LIVE_STATS_VERSION;
+    gpLive->pid = getpid();
+    gpLive->episodes = MAX_EPISODES;
+    write_end();
+    gLiveStart = gLiveLast = now();
+    gLiveSlots = gLiveLastSlots = 0;
+}
+
+void live_stats_begin(void)
+{
+    create_segment();
+    printf("live stats: /dev/shm%s (tools/dfh_top)\n", gLiveName);
+}
+
+// Points the sweep runs, when they are known in advance (SWEEP_SCHEDULER).
+void live_stats_total(int num_points)
+{
+    if (gpLive == NULL)
+        return;
+    write_begin();
+    gpLive->numOfPoints = num_points;
+    write_end();
+}
+
+// In a worker forked with the segment of the sweep mapped: publishes the num_points jobs dealt to the
+// worker in a segment of its own pid, and leaves the one of the sweep to the parent.
+void live_stats_fork(int num_points)
+{
+    if (gpLive == NULL)
+        return;
+    munmap(gpLive, sizeof(S_LIVE_STATS));
+    gpLive = NULL;
+    create_segment();
+    live_stats_total(num_points);
+}
+
+// The sweep is at (na, nc) number pair of num_pairs, which runs num_points variants (modes, HMAX).
+void live_stats_pair(int pair, int num_pairs, int num_points)
+{
+    if (gpLive == NULL)
+        return;
+    write_begin();
+    gpLive->numOfPoints = gpLive->point + num_points * (num_pairs - pair);
+    write_end();
+}
+
+void live_stats_point(int na, int nc)
+{
+    if (gpLive == NULL)
+        return;
+    write_begin();
+    gpLive->point++;
+    gpLive->mode = gModeDefault;
+    gpLive->na = na;
+    gpLive->nc = nc;
+    gpLive->avail = gNumOfAvailCh;
+    gpLive->hmax = HMAX;
+    gLiveEpisode = 0;
+    publish(0, na, now());
+    write_end();
+}
+
+void live_stats_update(int episode, int num_agents)
+{
+    double t;
+
+    if (gpLive == NULL)
+        return;
+    gLiveEpisode = episode;
+    t = now();
+    if (t - gLiveLast < LIVE_STATS_INTERVAL_MS * 1e-3)
+        return;
+    write_begin();
+    publish(episode, num_agents, t);
+    write_end();
+}
+
+void live_stats_point_done(double pcol)
+{
+    int mode = gModeDefault;
+
+    if (gpLive == NULL)
+        return;
+    write_begin();
+    // marl_main runs every point to MAX_EPISODES; a point of RESULT_CACHE may not run at all.
+    if (gLiveEpisode > 0)
+        gLiveSlots += (uint64_t)MAX_EPISODES * 2;
+    gpLive->episode = (gLiveEpisode > 0) ? MAX_EPISODES : 0;
+    gpLive->slots = gLiveSlots;
+    gpLive->pcol = pcol;
+    gpLive->pointsDone[mode]++;
+    gpLive->pcolSum[mode] += pcol;
+    gpLive->lastPcol[mode] = pcol;
+    gpLive->elapsed = now() - gLiveStart;
+    write_end();
+}
+
+void live_stats_end(void)
+{
+    if (gpLive == NULL)
+        return;
+    write_begin();
+    gpLive->bDone = 1;
+    gpLive->elapsed = now() - gLiveStart;
+    write_end();
+    munmap(gpLive, sizeof(S_LIVE_STATS));
+    shm_unlink(gLiveName);
+    gpLive = NULL;
+}
+
+#endif /* LIVE_STATS */
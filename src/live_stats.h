@@ -0,0 +1,73 @@
+/*
+ * live_stats.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef LIVE_STATS_H_
+#define LIVE_STATS_H_
+
+// Live counters of a sweep of marl_main (LIVE_STATS), in the shared memory segment /dev/shm/dfh_live.<pid>,
+// shown by tools/dfh_top. The simulator writes them under a sequence lock: seq is odd while it writes, so
+// a reader copies the segment and keeps the copy only if seq was even and the same before and after.
+#define LIVE_STATS_NAME "/dfh_live.%d"
+#define LIVE_STATS_PREFIX "dfh_live."
+#define LIVE_STATS_MAGIC 0x564c4644 // "DFLV"
+#define LIVE_STATS_VERSION 1
+#define LIVE_STATS_MODES 5 // MODE_MAX
+// The episode loops look at the clock every LIVE_STATS_PERIOD episodes (a power of 2) and publish at
+// most every LIVE_STATS_INTERVAL_MS.
+#define LIVE_STATS_PERIOD 256
+#define LIVE_STATS_INTERVAL_MS 100
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;
+    int32_t pid;
+    int32_t bDone;       // The sweep is over
+    int32_t point;       // Sweep points started
+    int32_t numOfPoints; // Estimated from the variants of the current (na, nc) for the ones left
+    int32_t mode;        // Current sweep point
+    int32_t na;
+    int32_t nc;
+    int32_t avail;
+    int32_t hmax;
+    int32_t episode;
+    int32_t episodes;
+    uint64_t slots;      // Slots simulated by the sweep (2 per episode)
+    uint64_t rssBytes;
+    double elapsed;      // Seconds since the start of the sweep
+    double slotsPerSec;  // Since the last update
+    double pcol;         // Running pcol of the current point, from episode PERTURBATION
+    int32_t pointsDone[LIVE_STATS_MODES];
+    double pcolSum[LIVE_STATS_MODES];
+    double lastPcol[LIVE_STATS_MODES];
+} S_LIVE_STATS;
+
+#ifdef LIVE_STATS
+// The sweep loops of marl_main run the points and publish them. Otherwise sweep_sched.c and adaptive_sweep.c do.
+#if !defined(SWEEP_SCHEDULER) && !defined(ADAPTIVE_SWEEP)
+#define LIVE_STATS_SWEEP_LOOPS
+#endif
+
+extern void live_stats_begin(void);
+extern void live_stats_total(int num_points);
+extern void live_stats_fork(int num_points);
+extern void live_stats_pair(int pair, int num_pairs, int num_points);
+extern void live_stats_point(int na, int nc);
+extern void live_stats_update(int episode, int num_agents);
+extern void live_stats_point_done(double pcol);
+extern void live_stats_end(void);
+
+// Called by the episode loops after the collisions of the episode are counted.
+static inline void live_stats_tick(int episode, int num_agents)
+{
+    if ((episode & (LIVE_STATS_PERIOD - 1)) == 0)
+        live_stats_update(episode, num_agents);
+}
+#endif
+
+#endif /* LIVE_STATS_H_ */
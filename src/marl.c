@@ -10,16 +10,49 @@
 #include "marl.h"
 #include "marl_diffusion.h"
 #include "physical_model.h"
+#include "fast_forward.h"
+#include "sweep_sched.h"
+#include "adaptive_sweep.h"
+#include "result_cache.h"
+#include "result_store.h"
+#include "agent_stats.h"
+#include "run_length.h"
+#include "collision_log.h"
+#include "live_stats.h"
+#include "rare_event.h"
+#include "traffic.h"
+#include "multi_slot.h"
+#include "timer_wheel.h"
+#include "interference.h"
+#include "trace_replay.h"
+#include "profiler.h"
+
+#if NUM_AGENTS > MAX_PICONNETS
+#error "Every agent needs a piconet queue. Raise MAX_PICONNETS to NUM_AGENTS."
+#endif
 
-int HMAX = 2;
-int episode = 0;
+DFH_TLS int HMAX = 2;
+DFH_TLS int episode = 0;
 
 #ifdef DIFFUSIVE
-int gTargetCoexit;
+DFH_TLS int gTargetCoexit;
 #endif
 
+// Episodes of the WiFi window. Given in DEFS for runs much shorter than MAX_EPISODES (GOLDEN_WIFI of the Makefile).
+#ifndef WIFI_START
 #define WIFI_START 0.3 * MAX_EPISODES
+#endif
+#ifndef WIFI_END
 #define WIFI_END 0.7 * MAX_EPISODES
+#endif
+#ifdef INTERFERENCE_SCHEDULE
+// First and last episode with an AP up, from the interference schedule.
+#define WIFI_ON_EPISODE interference_first_episode()
+#define WIFI_OFF_EPISODE interference_last_episode()
+#else
+#define WIFI_ON_EPISODE (WIFI_START)
+#define WIFI_OFF_EPISODE (WIFI_END)
+#endif
 // Note: Channels 11-50 are for simulating severe interference from two WLANs. Otherwise, set to 31.
 // #define WIFI_CHANNEL_START 31
 // #define WIFI_CHANNEL_END 50
@@ -49,16 +82,29 @@ int gTargetCoexit;
 #define WIFI_CHANNEL_1_END 80
 #endif
 
+#ifdef INTERFERENCE_SCHEDULE
+// The WiFi bands above, used when there is no INTERFERENCE_CONFIG.
+static const S_INTF_AP gDefaultWifiAps[] = {
+	{WIFI_CHANNEL_START, WIFI_CHANNEL_END, WIFI_START, WIFI_END, 0, 0, 0},
+#if NO_OF_WIFI > 1
+	{WIFI_CHANNEL_11_START, WIFI_CHANNEL_11_END, WIFI_START, WIFI_END, 0, 0, 0},
+#endif
+#if NO_OF_WIFI > 2
+	{WIFI_CHANNEL_1_START, WIFI_CHANNEL_1_END, WIFI_START, WIFI_END, 0, 0, 0},
+#endif
+};
+#endif
+
 #ifdef SHUFFLE
 
 // A map used for channel shuffling with the Fisher-Yates algorithm.
-int CHANNEL_SHUFFLE[NUM_CHANNELS];
+DFH_TLS int CHANNEL_SHUFFLE[NUM_CHANNELS];
 
 // Function to perform Fisher-Yates shuffle, which creates a maximum entropy shuffle.
 void fisherYatesShuffle(int CHANNEL_SHUFFLE[], int n)
 {
 	// Seed the random number generator
-	srand(time(NULL));
+	DFH_SRAND(DFH_RAND_SEED());
 
 	for (int i = 0; i < NUM_CHANNELS; i++)
 		CHANNEL_SHUFFLE[i] = i;
@@ -67,7 +113,7 @@ void fisherYatesShuffle(int CHANNEL_SHUFFLE[], int n)
 	for (int i = n - 1; i > 0; i--)
 	{
 		// Pick a random index from 0 to i
-		int j = rand() % (i + 1);
+		int j = DFH_RAND() % (i + 1);
 
 		// Swap CHANNEL_SHUFFLE[i] with the element at the random index
 		int temp = CHANNEL_SHUFFLE[i];
@@ -78,35 +124,66 @@ void fisherYatesShuffle(int CHANNEL_SHUFFLE[], int n)
 
 #endif
 
-extern int select_channel(uint8_t picoId, int current_time, int duration);
+extern int select_channel(int picoId, int current_time, int duration);
+extern uint64_t bdAddr[56];
+int get_best_channel_based_on_qtable(Agent *agent);
 
 /******************************************************************************************/
-int hopping_mode = 0; // Default is legacy. 1=adaptive, 2=diffusive
-int gNum_channels = NUM_CHANNELS;
-int num_diff = 0;
-FILE *pcol;
-FILE *col_graph;
-FILE *chan;
-FILE *heatmapfile;
+DFH_TLS int hopping_mode = 0; // Default is legacy. 1=adaptive, 2=diffusive
+DFH_TLS int gNum_channels = NUM_CHANNELS;
+DFH_TLS int num_diff = 0;
+DFH_TLS FILE *pcol;
+DFH_TLS FILE *col_graph;
+DFH_TLS FILE *chan;
+DFH_TLS FILE *heatmapfile;
 // FILE* creward;
-FILE *trajectory;
-FILE *pfQValueFile;
+DFH_TLS FILE *trajectory;
+DFH_TLS FILE *pfQValueFile;
+#ifdef SYNC_SLOT_COMPARE
+DFH_TLS FILE *psync;
+#endif
+#ifdef TRAFFIC
+DFH_TLS FILE *ptraffic;
+#endif
+#ifdef AGENT_STATS
+DFH_TLS FILE *pfair;
+#endif
+#ifdef RUN_LENGTH
+DFH_TLS FILE *pretx;
+#endif
+#ifdef RARE_EVENT
+DFH_TLS FILE *prare;
+#endif
 
 // Statistics for the number of collisions per episode.
-int collision_map[NUM_AGENTS + 1];
+DFH_TLS int collision_map[NUM_AGENTS + 1];
+#ifdef RUN_LENGTH
+// Collided episodes in a row of each agent, and the runs that ended (run_length.h).
+DFH_TLS int gCollisionRun[NUM_AGENTS + 1];
+DFH_TLS S_RUN_HIST gstRunHist;
+#endif
 // Statistics for the final total number of collisions.
-int total_collisions[NUM_AGENTS + 1];
+DFH_TLS int total_collisions[NUM_AGENTS + 1];
 // Statistics for the final total number of collisions with WiFi.
-int total_wifi_collisions[NUM_AGENTS + 1];
-int final_collision_tally = 0;
-double final_wifi_collision_tally = 0;
-int prev_cols[NUM_AGENTS + 1] = {0};
-int gModeDefault = MODE_AFH;
-int gNumOfAvailCh = 79;
+DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+DFH_TLS int final_collision_tally = 0;
+DFH_TLS double final_wifi_collision_tally = 0;
+DFH_TLS int prev_cols[NUM_AGENTS + 1] = {0};
+DFH_TLS int gModeDefault = MODE_AFH;
+DFH_TLS int gNumOfAvailCh = 79;
+// Episodes of run_simulation() when > 0 (the benchmarks), MAX_EPISODES otherwise.
+DFH_TLS int gRunEpisodes = 0;
+#ifdef DETERMINISTIC
+DFH_TLS FP_HOP_HOOK gpfHopHook;
+#endif
+#ifdef SYNC_SLOT
+// true: synchronous slot semantics (run_sync_slot), false: the sequential per-agent loop.
+DFH_TLS bool gSyncSlot = true;
+#endif
 
 #ifdef HEATMAP
 // Used to visualize the frequency hopping pattern. Analyzes one channel, hence the uppercase name.
-int heatmap[NUM_CHANNELS + 1];
+DFH_TLS int heatmap[NUM_CHANNELS + 1];
 #endif
 
 void initialize_agents(Agent agents[], int num_agents)
@@ -126,6 +203,9 @@ void initialize_agents(Agent agents[], int num_agents)
 		total_collisions[i] = 0;
 		total_wifi_collisions[i] = 0;
 		final_collision_tally = 0;
+#ifdef RUN_LENGTH
+		gCollisionRun[i] = 0;
+#endif
 
 #ifdef DEBUG
 		printf("agent %d uses %d\n", i, agents[i].current_channel);
@@ -149,20 +229,28 @@ void initialize_agents(Agent agents[], int num_agents)
 
 		// Remember the last channel for the diffusive action. Initialize with a value different from current_channel.
 		agents[i].last_channel = -1;
-		for (int k = 0; k < E_ACTION_TYPE_MAX; k++)
+		for (int k = 0; k < Q_TABLE_ROWS; k++)
 		{
 			// Bug fix: num_channels is variable, modified to gNum_channels + 1.
 			for (int j = 1; j < gNum_channels + 1; j++)
 			{
-				agents[i].q_table[k][j] = 0.0;
+				agents[i].q_table[k][j] = Q_STORE(0.0);
 			}
 		}
+#ifdef LAZY_Q_DECAY
+		agents[i].qDecayEpoch = 0;
+		agents[i].qSettledEpoch = 0;
+		memset(agents[i].lastUsedTime, 0, sizeof(agents[i].lastUsedTime));
+#endif
 		memset(piconet_queues[i].stHoppingInfo.available_channels, 0, 79 * sizeof(bool));
 		memset(agents[i].new_available_channels, 0, 79 * sizeof(bool));
 		memset(piconet_queues[i].stHoppingInfo.available_channels, 1, gNum_channels * sizeof(bool));
 		piconet_queues[i].stHoppingInfo.noOfCh = gNum_channels;
 		piconet_queues[i].stHoppingInfo.bWifiStart = false;
 		piconet_queues[i].stHoppingInfo.bWifiStop = false;
+#if defined(WIFI) && defined(INTERFERENCE_SCHEDULE)
+		memset(agents[i].wifiBanMask, 0, sizeof(agents[i].wifiBanMask));
+#endif
 
 		agents[i].cumulative_reward = 0.0;
 	}
@@ -172,6 +260,301 @@ void initialize_agents(Agent agents[], int num_agents)
 	for (int k = 1; k <= NUM_CHANNELS; k++)
 		heatmap[k] = 0;
 #endif
+#ifdef RUN_LENGTH
+	run_hist_reset(&gstRunHist);
+#endif
+}
+
+#ifdef TIMER_WHEEL
+// Agents of the running simulation, for the event handlers.
+static DFH_TLS Agent *gpTimerAgents;
+#if defined(WIFI) && !defined(INTERFERENCE_SCHEDULE)
+// Switched by the TW_EVT_WIFI events.
+static DFH_TLS bool gWifiOn;
+#endif
+
+static void on_dfh_instance(int id, int current_time, uint32_t gen)
+{
+	if (gpTimerAgents[id].timerGen == gen)
+		gpTimerAgents[id].bInstanceDue = true;
+}
+
+static void on_map_refresh(int id, int current_time, uint32_t gen)
+{
+	gpTimerAgents[id].map_refresh_time = current_time;
+	timer_wheel_schedule(TW_EVT_MAP_REFRESH, id, current_time + 1600 * 2, 0);
+}
+
+#ifdef WIFI
+static void on_wifi(int id, int current_time, uint32_t gen)
+{
+#ifdef INTERFERENCE_SCHEDULE
+	// One event per window of the schedule.
+	int next;
+
+	interference_seek(current_time / 2 + 1);
+	next = interference_next_change();
+	if (next > 0)
+		timer_wheel_schedule(TW_EVT_WIFI, 0, (next - 1) * 2, 0);
+#else
+	gWifiOn = (id == 1);
+#endif
+}
+#endif
+
+// Arms the timers of all agents from their state at the start of run_simulation().
+static void schedule_agent_timers(Agent agents[], int num_agents)
+{
+	uint32_t base_clk;
+
+	timer_wheel_reset(0);
+	timer_wheel_register(TW_EVT_DFH_INSTANCE, on_dfh_instance);
+	timer_wheel_register(TW_EVT_MAP_REFRESH, on_map_refresh);
+	gpTimerAgents = agents;
+
+	for (int i = 1; i <= num_agents; i++)
+	{
+		agents[i].bInstanceDue = false;
+		agents[i].timerGen++;
+		timer_wheel_schedule(TW_EVT_DFH_INSTANCE, i, agents[i].instance_time, agents[i].timerGen);
+
+		// First current_time with (current_time + base_clk) % 3200 == 0.
+		base_clk = piconet_queues[i].stHoppingInfo.base_clk;
+		agents[i].map_refresh_time = -1;
+		timer_wheel_schedule(TW_EVT_MAP_REFRESH, i, (1600 * 2 - base_clk % (1600 * 2)) % (1600 * 2), 0);
+	}
+
+#if defined(WIFI) && defined(INTERFERENCE_SCHEDULE)
+	timer_wheel_register(TW_EVT_WIFI, on_wifi);
+	timer_wheel_schedule(TW_EVT_WIFI, 0, 0, 0);
+#elif defined(WIFI)
+	// WiFi is on for the episodes WIFI_START <= episode <= WIFI_END, episode = current_time / 2 + 1.
+	int wifi_on = (int)(WIFI_START);
+	if (wifi_on < WIFI_START)
+		wifi_on++;
+	gWifiOn = false;
+	timer_wheel_register(TW_EVT_WIFI, on_wifi);
+	timer_wheel_schedule(TW_EVT_WIFI, 1, (wifi_on - 1) * 2, 0);
+	timer_wheel_schedule(TW_EVT_WIFI, 0, (int)(WIFI_END) * 2, 0);
+#endif
+}
+#endif
+
+// Arms the instance timer of the agent. With TIMER_WHEEL the expiry arrives as an event.
+static void set_instance_time(Agent *agent, int time)
+{
+	agent->instance_time = time;
+#ifdef TIMER_WHEEL
+	agent->bInstanceDue = false;
+	agent->timerGen++;
+	timer_wheel_schedule(TW_EVT_DFH_INSTANCE, agent->id, time, agent->timerGen);
+#endif
+}
+
+static bool is_instance_due(Agent *agent, int current_time)
+{
+#ifdef TIMER_WHEEL
+	return agent->bInstanceDue;
+#else
+	return agent->instance_time <= current_time;
+#endif
+}
+
+// Brings the Q-value of the channel up to date with the decays counted by decay_unused_channels().
+static void settle_q_value(Agent *agent, int channel)
+{
+#ifdef LAZY_Q_DECAY
+	// Settled since the last refresh: the common case of the argmax scans over all channels.
+	if (agent->lastUsedTime[channel] == agent->qDecayEpoch)
+		return;
+
+	bool bUnused = (piconet_queues[agent->id].stHoppingInfo.available_channels[channel - 1] == false);
+	q_value_t *pQ = &(agent->q_table[E_ACTION_TYPE_DEFAULT][channel]);
+
+	// The side of the map the channel is on has not changed since the decays were counted: a channel is
+	// settled before it changes sides. Only a negative Q-value of an unused channel decays; it is multiplied
+	// once per decay, since pow(0.98, n) does not round the way the eager loop does.
+	if (bUnused)
+	{
+		for (; agent->lastUsedTime[channel] < agent->qDecayEpoch && *pQ < 0; agent->lastUsedTime[channel]++)
+			*pQ = Q_STORE(Q_LOAD(*pQ) * 0.98);
+	}
+	agent->lastUsedTime[channel] = agent->qDecayEpoch;
+#endif
+}
+
+// Settles all the Q-values once per map refresh, so the argmax scans read the table without settling each channel.
+static void settle_all_q_values(Agent *agent)
+{
+#ifdef LAZY_Q_DECAY
+	if (agent->qSettledEpoch == agent->qDecayEpoch)
+		return;
+
+	for (int i = 1; i <= gNum_channels; i++)
+		settle_q_value(agent, i);
+	agent->qSettledEpoch = agent->qDecayEpoch;
+#endif
+}
+
+// Switches the live map of the agent to pNewMap, settling the channels that change sides first.
+static void apply_ch_map(Agent *agent, bool *pChMap, const bool *pNewMap)
+{
+#ifdef LAZY_Q_DECAY
+	for (int i = 0; agent->qSettledEpoch != agent->qDecayEpoch && i < 79; i++)
+	{
+		if (pChMap[i] != pNewMap[i])
+			settle_q_value(agent, i + 1);
+	}
+#endif
+	memcpy(pChMap, pNewMap, sizeof(bool) * 79);
+}
+
+// Decays the negative Q-values of the channels outside the map, at each map refresh.
+static void decay_unused_channels(Agent *agent, S_HOPPING_INFO *pHopInfo)
+{
+#ifdef LAZY_Q_DECAY
+	// Only counted here. A Q-value is settled when it is read or written, or before its channel changes sides.
+	agent->qDecayEpoch++;
+#else
+	for (int i = 0; i < 79; i++)
+	{
+		if (pHopInfo->available_channels[i] == false && agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] < 0)
+		{
+			agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] = Q_STORE(Q_LOAD(agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1]) * 0.98);
+		}
+	}
+#endif
+}
+
+#ifdef WIFI
+#ifdef INTERFERENCE_SCHEDULE
+// Lists the channels of pMask once each, in the order of the APs, which is the order of the WiFi bands
+// without INTERFERENCE_CONFIG.
+static int list_wifi_channels(const uint64_t *pMask, int *pChannels)
+{
+	uint64_t listed[2] = {0, 0};
+	uint64_t bit;
+	int n = 0;
+
+	for (int k = 0; k < interference_ap_count(); k++)
+	{
+		for (int i = interference_ap(k)->first_ch; i <= interference_ap(k)->last_ch; i++)
+		{
+			bit = 1ULL << ((i - 1) & 63);
+			if ((pMask[(i - 1) >> 6] & bit) && !(listed[(i - 1) >> 6] & bit))
+			{
+				listed[(i - 1) >> 6] |= bit;
+				pChannels[n++] = i;
+			}
+		}
+	}
+	return n;
+}
+#endif
+
+// Keeps the WiFi channels at the bottom of the Q-table once WiFi is on.
+static void ban_wifi_channels(Agent *agent, int episode)
+{
+	int i;
+
+#ifdef INTERFERENCE_SCHEDULE
+	// Only the APs that have come up by this episode. The ban comes a refresh after WiFi turns on, so an AP
+	// may be down again by now; one that starts later is not banned ahead of time.
+	int channels[NUM_CHANNELS];
+	int n;
+
+	agent->wifiBanMask[0] = agent->wifiBanMask[1] = 0;
+	for (int k = 0; k < interference_ap_count(); k++)
+	{
+		if (interference_ap(k)->start > episode)
+			continue;
+		for (i = interference_ap(k)->first_ch; i <= interference_ap(k)->last_ch; i++)
+			agent->wifiBanMask[(i - 1) >> 6] |= 1ULL << ((i - 1) & 63);
+	}
+	n = list_wifi_channels(agent->wifiBanMask, channels);
+	for (int j = 0; j < n; j++)
+	{
+		i = channels[j];
+		settle_q_value(agent, i);
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(-RAND_MAX);
+	}
+#else
+	for (i = WIFI_CHANNEL_START; i <= WIFI_CHANNEL_END; i++)
+	{
+		settle_q_value(agent, i);
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(-RAND_MAX);
+	}
+
+#if NO_OF_WIFI > 1
+	for (i = WIFI_CHANNEL_11_START; i <= WIFI_CHANNEL_11_END; i++)
+	{
+		settle_q_value(agent, i);
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(-RAND_MAX);
+	}
+#endif
+
+#if NO_OF_WIFI > 2
+	for (i = WIFI_CHANNEL_1_START; i <= WIFI_CHANNEL_1_END; i++)
+	{
+		settle_q_value(agent, i);
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(-RAND_MAX);
+	}
+#endif
+#endif
+}
+
+// Puts the WiFi channels back in the map, around the average Q-value, once WiFi is off.
+static void unban_wifi_channels(Agent *agent, S_HOPPING_INFO *pHopInfo, double avgQvalue)
+{
+	int i;
+
+#ifdef INTERFERENCE_SCHEDULE
+	// The channels of the ban, whichever APs are up now.
+	int channels[NUM_CHANNELS];
+	int n = list_wifi_channels(agent->wifiBanMask, channels);
+
+	for (int j = 0; j < n; j++)
+	{
+		i = channels[j];
+		settle_q_value(agent, i);
+		pHopInfo->available_channels[i - 1] = true;
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(avgQvalue + ((DFH_RAND() % 100) * 0.00001));
+	}
+#else
+	for (i = WIFI_CHANNEL_START; i <= WIFI_CHANNEL_END; i++)
+	{
+		settle_q_value(agent, i);
+		pHopInfo->available_channels[i - 1] = true;
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(avgQvalue + ((DFH_RAND() % 100) * 0.00001));
+	}
+#if NO_OF_WIFI > 1
+	for (i = WIFI_CHANNEL_11_START; i <= WIFI_CHANNEL_11_END; i++)
+	{
+		settle_q_value(agent, i);
+		pHopInfo->available_channels[i - 1] = true;
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(avgQvalue + ((DFH_RAND() % 100) * 0.00001));
+	}
+#endif
+#if NO_OF_WIFI > 2
+	for (i = WIFI_CHANNEL_1_START; i <= WIFI_CHANNEL_1_END; i++)
+	{
+		settle_q_value(agent, i);
+		pHopInfo->available_channels[i - 1] = true;
+		agent->q_table[E_ACTION_TYPE_DEFAULT][i] = Q_STORE(avgQvalue + ((DFH_RAND() % 100) * 0.00001));
+	}
+#endif
+#endif
+}
+#endif
+
+// True at the 2-second AFH channel map updates of the piconet.
+static bool is_map_refresh_due(Agent *agent, S_HOPPING_INFO *pHopInfo, int current_time)
+{
+#ifdef TIMER_WHEEL
+	return agent->map_refresh_time == current_time;
+#else
+	return ((uint32_t)current_time + pHopInfo->base_clk) % (1600 * 2) == 0;
+#endif
 }
 
 int select_classical_action(Agent *agent, int current_time)
@@ -187,14 +570,20 @@ void printChMap(int id)
 	printf("\n");
 }
 
-double setChMapBasedOnQtable(bool *pChMap, double *pQtable, int noOfUsedCh)
+// With pSettle, the Q-values of its channels are settled as the sort takes them, before pChMap changes.
+static double set_ch_map(bool *pChMap, q_value_t *pQtable, int noOfUsedCh, Agent *pSettle)
 {
 	int i, j, temp;
 	int index[gNum_channels + 1];
 	double avgQvalue = 0;
 
+	PROF_BEGIN(PROF_MAP_REFRESH);
 	for (i = 1; i <= gNum_channels; i++)
+	{
+		if (pSettle != NULL)
+			settle_q_value(pSettle, i);
 		index[i] = i;
+	}
 
 	// Sort indices based on Q-table values
 	for (i = 1; i < gNum_channels; i++)
@@ -214,7 +603,7 @@ double setChMapBasedOnQtable(bool *pChMap, double *pQtable, int noOfUsedCh)
 	/*
 	for(i = 1; i <= NUM_CHANNELS;i++)
 	{
-		printf("%d, %f\n", index[i], pQtable[index[i]]);
+		printf("%d, %f\n", index[i], Q_LOAD(pQtable[index[i]]));
 	}
 	 */
 
@@ -223,7 +612,7 @@ double setChMapBasedOnQtable(bool *pChMap, double *pQtable, int noOfUsedCh)
 	for (i = gNum_channels; i > gNum_channels - noOfUsedCh; i--)
 	{
 		pChMap[index[i] - 1] = true;
-		avgQvalue += pQtable[index[i]];
+		avgQvalue += Q_LOAD(pQtable[index[i]]);
 	}
 
 #ifdef DEBUG
@@ -242,16 +631,27 @@ double setChMapBasedOnQtable(bool *pChMap, double *pQtable, int noOfUsedCh)
 
 	printf("\n");
 #endif // DEBUG
+	PROF_END(PROF_MAP_REFRESH);
 	return (avgQvalue / noOfUsedCh);
 }
 
+double setChMapBasedOnQtable(bool *pChMap, q_value_t *pQtable, int noOfUsedCh)
+{
+	return set_ch_map(pChMap, pQtable, noOfUsedCh, NULL);
+}
+
+// setChMapBasedOnQtable() on the Q-table of the agent.
+static double set_ch_map_of_agent(Agent *agent, bool *pChMap, int noOfUsedCh)
+{
+	return set_ch_map(pChMap, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), noOfUsedCh, agent);
+}
+
 int select_afh_rl_action(Agent *agent, int last_channel, int current_time)
 {
 	// int random;
 	bool bExpiry = false;
 	E_STATE_TIMER eTimerState = STATE_TIMER_INIT;
 	S_HOPPING_INFO *pHopInfo = &(piconet_queues[agent->id].stHoppingInfo);
-	int i;
 
 	agent->random_no_by_fh = select_classical_action(agent, current_time);
 	// random = select_channel_wo_remapping(agent->id, current_time, 2) + 1;
@@ -271,9 +671,9 @@ int select_afh_rl_action(Agent *agent, int last_channel, int current_time)
 				agent->eStateTimer = STATE_TIMER_WAIT_ARRIVAL;
 				agent->new_best_channel = get_best_channel_based_on_qtable(agent);
 				// Store new used channel
-				setChMapBasedOnQtable(agent->new_available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), gNum_channels);
+				set_ch_map_of_agent(agent, agent->new_available_channels, gNum_channels);
 
-				agent->instance_time = current_time + DEFAULT_DFH_INSTANSTIME;
+				set_instance_time(agent, current_time + DEFAULT_DFH_INSTANSTIME);
 				return agent->random_no_by_fh;
 			}
 		}
@@ -283,7 +683,7 @@ int select_afh_rl_action(Agent *agent, int last_channel, int current_time)
 		agent->last_succeed_time = current_time;
 	}
 
-	if (agent->instance_time <= current_time)
+	if (is_instance_due(agent, current_time))
 		bExpiry = true;
 
 	// Action based on timer expiration (instance)
@@ -294,9 +694,9 @@ int select_afh_rl_action(Agent *agent, int last_channel, int current_time)
 		{
 			agent->cur_best_channel = agent->new_best_channel;
 			// pHopInfo->available_channels = agent->new_available_channels;
-			memcpy(pHopInfo->available_channels, agent->new_available_channels, sizeof(bool) * 79);
+			apply_ch_map(agent, pHopInfo->available_channels, agent->new_available_channels);
 
-			agent->instance_time = current_time + DEFAULT_DFH_UPDATE_TIMEOUT;
+			set_instance_time(agent, current_time + DEFAULT_DFH_UPDATE_TIMEOUT);
 			agent->eStateTimer = STATE_TIMER_RUN;
 			eTimerState = STATE_TIMER_RUN;
 			if (agent->cur_hopping_mode == MODE_LEGACY)
@@ -318,17 +718,11 @@ int select_afh_rl_action(Agent *agent, int last_channel, int current_time)
 		// Generate Q-update message
 		else // agent->eStateTimer == STATE_TIMER_RUN
 		{
-			for (i = 0; i < 79; i++)
-			{
-				if (pHopInfo->available_channels[i] == false && agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] < 0)
-				{
-					agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] *= 0.98;
-				}
-			}
+			decay_unused_channels(agent, pHopInfo);
 
 			agent->new_best_channel = get_best_channel_based_on_qtable(agent);
-			setChMapBasedOnQtable(agent->new_available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), gNum_channels);
-			agent->instance_time = current_time + DEFAULT_DFH_INSTANSTIME;
+			set_ch_map_of_agent(agent, agent->new_available_channels, gNum_channels);
+			set_instance_time(agent, current_time + DEFAULT_DFH_INSTANSTIME);
 			agent->eStateTimer = STATE_TIMER_WAIT_ARRIVAL;
 			eTimerState = STATE_TIMER_WAIT_ARRIVAL;
 		}
@@ -362,7 +756,10 @@ int select_afh_rl_action(Agent *agent, int last_channel, int current_time)
 		return agent->random_no_by_fh;
 	}
 
-	if ((double)rand() / RAND_MAX < EPSILON_DIFF)
+#ifdef RARE_EVENT
+	rare_hop_mix(agent->random_no_by_fh, agent->cur_best_channel);
+#endif
+	if ((double)DFH_RAND() / RAND_MAX < EPSILON_DIFF)
 	{	//****************************** EXPLORATION by DIFFUSION?
 		// Exploration
 #if DEBUG_CH_STATE_1
@@ -388,7 +785,6 @@ int select_classical_afh_rl_action(Agent *agent, int current_time)
 {
 	S_HOPPING_INFO *pHopInfo = &(piconet_queues[agent->id].stHoppingInfo);
 	int numOfAvailCh = gNumOfAvailCh;
-	int i;
 	double avgQvalue;
 
 #ifdef DIFFUSIVE // For mixed cases, set AFH to use the minimum number of channels.
@@ -404,84 +800,41 @@ int select_classical_afh_rl_action(Agent *agent, int current_time)
 	// Update channel map every 2 seconds based on the base clock.
 	if (current_time == 0)
 	{
-		setChMapBasedOnQtable(pHopInfo->available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), gNum_channels);
+		set_ch_map_of_agent(agent, pHopInfo->available_channels, gNum_channels);
 		pHopInfo->noOfCh = gNum_channels;
 		if (agent->hopping_mode == MODE_AFH_RL)
 			agent->cur_best_channel = -1;
 	}
-	if (((uint32_t)current_time + pHopInfo->base_clk) % (1600 * 2) == 0)
+	if (is_map_refresh_due(agent, pHopInfo, current_time))
 	{
 		// printf("===%d====\n",current_time);
 
-		for (i = 0; i < 79; i++)
-		{
-			if (pHopInfo->available_channels[i] == false && agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] < 0)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] *= 0.98;
-			}
-		}
+		decay_unused_channels(agent, pHopInfo);
 
 #ifdef WIFI
 		// When WiFi turns on, ban its channels within 1 sec. Unban them 5 secs after WiFi turns off.
-		if (pHopInfo->bWifiStart == false && episode >= (WIFI_START + (1600)))
+		if (pHopInfo->bWifiStart == false && episode >= (WIFI_ON_EPISODE + (1600)))
 		{
 			pHopInfo->bWifiStart = true;
-
-			for (i = WIFI_CHANNEL_START; i <= WIFI_CHANNEL_END; i++)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = -RAND_MAX;
-			}
-
-#if NO_OF_WIFI > 1
-			for (i = WIFI_CHANNEL_11_START; i <= WIFI_CHANNEL_11_END; i++)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = -RAND_MAX;
-			}
-#endif
-
-#if NO_OF_WIFI > 2
-			for (i = WIFI_CHANNEL_1_START; i <= WIFI_CHANNEL_1_END; i++)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = -RAND_MAX;
-			}
-#endif
+			ban_wifi_channels(agent, episode);
 		}
 #endif
 
-		avgQvalue = setChMapBasedOnQtable(pHopInfo->available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), numOfAvailCh);
+		avgQvalue = set_ch_map_of_agent(agent, pHopInfo->available_channels, numOfAvailCh);
 
 		if (agent->hopping_mode == MODE_AFH_RL)
 			agent->cur_best_channel = get_best_channel_based_on_qtable(agent);
 #ifdef WIFI
 		// When WiFi turns on, ban its channels within 1 sec. Unban them 15 secs after WiFi turns off.
-		if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == false && episode >= (WIFI_END + (1600 * 15)))
+		if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == false && episode >= (WIFI_OFF_EPISODE + (1600 * 15)))
 		{
 			pHopInfo->bWifiStop = true;
 			numOfAvailCh = 40;
-
-			for (i = WIFI_CHANNEL_START; i <= WIFI_CHANNEL_END; i++)
-			{
-				pHopInfo->available_channels[i - 1] = true;
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = avgQvalue + ((rand() % 100) * 0.00001);
-			}
-#if NO_OF_WIFI > 1
-			for (i = WIFI_CHANNEL_11_START; i <= WIFI_CHANNEL_11_END; i++)
-			{
-				pHopInfo->available_channels[i - 1] = true;
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = avgQvalue + ((rand() % 100) * 0.00001);
-			}
-#endif
-#if NO_OF_WIFI > 2
-			for (i = WIFI_CHANNEL_1_START; i <= WIFI_CHANNEL_1_END; i++)
-			{
-				pHopInfo->available_channels[i - 1] = true;
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = avgQvalue + ((rand() % 100) * 0.00001);
-			}
+			unban_wifi_channels(agent, pHopInfo, avgQvalue);
 		}
-#endif
 		else
 		{
-			if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == true && episode <= (WIFI_END + (1600 * 15)))
+			if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == true && episode <= (WIFI_OFF_EPISODE + (1600 * 15)))
 			{
 				numOfAvailCh = 79;
 			}
@@ -493,7 +846,7 @@ int select_classical_afh_rl_action(Agent *agent, int current_time)
 
 	if (agent->hopping_mode == MODE_AFH_RL)
 	{
-		if ((double)rand() / RAND_MAX < EPSILON_DIFF)
+		if ((double)DFH_RAND() / RAND_MAX < EPSILON_DIFF)
 		{ //****************************** EXPLORATION by AFH
 			return (select_channel(agent->id, current_time, 2) + 1);
 		}
@@ -513,7 +866,6 @@ int select_classical_afh_action(Agent *agent, int current_time)
 {
 	S_HOPPING_INFO *pHopInfo = &(piconet_queues[agent->id].stHoppingInfo);
 	int numOfAvailCh = gNumOfAvailCh;
-	int i;
 	double avgQvalue;
 	int ch_afh = select_channel(agent->id, current_time, 2) + 1;
 
@@ -530,80 +882,37 @@ int select_classical_afh_action(Agent *agent, int current_time)
 	// Update channel map every 2 seconds based on the base clock.
 	if (current_time == 0)
 	{
-		setChMapBasedOnQtable(pHopInfo->available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), gNum_channels);
+		set_ch_map_of_agent(agent, pHopInfo->available_channels, gNum_channels);
 		pHopInfo->noOfCh = gNum_channels;
 	}
-	if (((uint32_t)current_time + pHopInfo->base_clk) % (1600 * 2) == 0)
+	if (is_map_refresh_due(agent, pHopInfo, current_time))
 	{
 		// printf("===%d====\n",current_time);
 #ifdef WIFI
-		for (i = 0; i < 79; i++)
-		{
-			if (pHopInfo->available_channels[i] == false && agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] < 0)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i + 1] *= 0.98;
-			}
-		}
+		decay_unused_channels(agent, pHopInfo);
 #endif
 #ifdef WIFI
 		// When WiFi turns on, ban its channels within 1 sec. Unban them 5 secs after WiFi turns off.
-		if (pHopInfo->bWifiStart == false && episode >= (WIFI_START + (1600)))
+		if (pHopInfo->bWifiStart == false && episode >= (WIFI_ON_EPISODE + (1600)))
 		{
 			pHopInfo->bWifiStart = true;
-
-			for (i = WIFI_CHANNEL_START; i <= WIFI_CHANNEL_END; i++)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = -RAND_MAX;
-			}
-
-#if NO_OF_WIFI > 1
-			for (i = WIFI_CHANNEL_11_START; i <= WIFI_CHANNEL_11_END; i++)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = -RAND_MAX;
-			}
-#endif
-
-#if NO_OF_WIFI > 2
-			for (i = WIFI_CHANNEL_1_START; i <= WIFI_CHANNEL_1_END; i++)
-			{
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = -RAND_MAX;
-			}
-#endif
+			ban_wifi_channels(agent, episode);
 		}
 #endif
 
-		avgQvalue = setChMapBasedOnQtable(pHopInfo->available_channels, &(agent->q_table[E_ACTION_TYPE_DEFAULT][0]), numOfAvailCh);
+		avgQvalue = set_ch_map_of_agent(agent, pHopInfo->available_channels, numOfAvailCh);
 
 #ifdef WIFI
 		// When WiFi turns on, ban its channels within 1 sec. Unban them 15 secs after WiFi turns off.
-		if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == false && episode >= (WIFI_END + (1600 * 15)))
+		if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == false && episode >= (WIFI_OFF_EPISODE + (1600 * 15)))
 		{
 			pHopInfo->bWifiStop = true;
 			numOfAvailCh = 40;
-
-			for (i = WIFI_CHANNEL_START; i <= WIFI_CHANNEL_END; i++)
-			{
-				pHopInfo->available_channels[i - 1] = true;
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = avgQvalue + ((rand() % 100) * 0.00001);
-			}
-#if NO_OF_WIFI > 1
-			for (i = WIFI_CHANNEL_11_START; i <= WIFI_CHANNEL_11_END; i++)
-			{
-				pHopInfo->available_channels[i - 1] = true;
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = avgQvalue + ((rand() % 100) * 0.00001);
-			}
-#endif
-#if NO_OF_WIFI > 2
-			for (i = WIFI_CHANNEL_1_START; i <= WIFI_CHANNEL_1_END; i++)
-			{
-				pHopInfo->available_channels[i - 1] = true;
-				agent->q_table[E_ACTION_TYPE_DEFAULT][i] = avgQvalue + ((rand() % 100) * 0.00001);
-			}
+			unban_wifi_channels(agent, pHopInfo, avgQvalue);
 		}
-#endif
 		else
 		{
-			if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == true && episode <= (WIFI_END + (1600 * 15)))
+			if (pHopInfo->bWifiStart == true && pHopInfo->bWifiStop == true && episode <= (WIFI_OFF_EPISODE + (1600 * 15)))
 			{
 				numOfAvailCh = 79;
 			}
@@ -616,7 +925,7 @@ int select_classical_afh_action(Agent *agent, int current_time)
 		if(agent->id == 1)
 		{
 			for(int i=1;i<=79;i++)
-				fprintf(pfQValueFile,"%02f ", agent->q_table[E_ACTION_TYPE_DEFAULT][i]);
+				fprintf(pfQValueFile,"%02f ", Q_LOAD(agent->q_table[E_ACTION_TYPE_DEFAULT][i]));
 			fprintf(pfQValueFile,"\n");
 		}
 		*/
@@ -649,6 +958,7 @@ int get_best_channel_based_on_qtable(Agent *agent)
 	int best_action = 1;
 	int i;
 
+	settle_all_q_values(agent);
 	for (i = 1; i <= gNum_channels; i++)
 	{
 		if (agent->q_table[E_ACTION_TYPE_DEFAULT][i] > agent->q_table[E_ACTION_TYPE_DEFAULT][best_action])
@@ -666,13 +976,18 @@ int select_diffusive_rl_action(Agent *agent, int last_channel, int current_time)
 	int sign, magnitude;
 	int explored_channel;
 	// int random;
+#if DEBUG_CH_STATE_1
 	int best_channel;
+#endif
 	bool bExpiry = false;
 	bool bTriggerUpdate = false;
 	E_STATE_TIMER eTimerState = STATE_TIMER_INIT;
 
 	agent->random_no_by_fh = select_classical_action(agent, current_time);
+#if DEBUG_CH_STATE_1
+	// Only logged. Otherwise a dead scan, which the compiler cannot drop once it settles Q-values.
 	best_channel = get_best_channel_based_on_qtable(agent);
+#endif
 	// random = select_channel_wo_remapping(agent->id, current_time, 2) + 1;
 	//  Check for consecutive collisions
 	if (agent->isCurChCollied == true)
@@ -688,7 +1003,7 @@ int select_diffusive_rl_action(Agent *agent, int last_channel, int current_time)
 				agent->cur_hopping_mode = MODE_LEGACY;
 				agent->eStateTimer = STATE_TIMER_WAIT_ARRIVAL;
 				agent->new_best_channel = get_best_channel_based_on_qtable(agent);
-				agent->instance_time = current_time + DEFAULT_DFH_INSTANSTIME;
+				set_instance_time(agent, current_time + DEFAULT_DFH_INSTANSTIME);
 				return agent->random_no_by_fh;
 			}
 		}
@@ -698,7 +1013,7 @@ int select_diffusive_rl_action(Agent *agent, int last_channel, int current_time)
 		agent->last_succeed_time = current_time;
 	}
 
-	if (agent->instance_time <= current_time)
+	if (is_instance_due(agent, current_time))
 		bExpiry = true;
 
 	// Action based on timer expiration (instance)
@@ -710,7 +1025,7 @@ int select_diffusive_rl_action(Agent *agent, int last_channel, int current_time)
 		{
 			// agent->cur_hopping_mode = MODE_DFH_RL;
 			agent->cur_best_channel = agent->new_best_channel;
-			agent->instance_time = current_time + DEFAULT_DFH_UPDATE_TIMEOUT;
+			set_instance_time(agent, current_time + DEFAULT_DFH_UPDATE_TIMEOUT);
 			agent->eStateTimer = STATE_TIMER_RUN;
 			eTimerState = STATE_TIMER_RUN;
 			if (agent->cur_hopping_mode == MODE_LEGACY)
@@ -734,7 +1049,7 @@ int select_diffusive_rl_action(Agent *agent, int last_channel, int current_time)
 		{
 			// agent->cur_hopping_mode = MODE_DFH_RL;
 			agent->new_best_channel = get_best_channel_based_on_qtable(agent);
-			agent->instance_time = current_time + DEFAULT_DFH_INSTANSTIME;
+			set_instance_time(agent, current_time + DEFAULT_DFH_INSTANSTIME);
 			agent->eStateTimer = STATE_TIMER_WAIT_ARRIVAL;
 			eTimerState = STATE_TIMER_WAIT_ARRIVAL;
 		}
@@ -783,17 +1098,20 @@ int select_diffusive_rl_action(Agent *agent, int last_channel, int current_time)
 		return agent->random_no_by_fh;
 	}
 
-	if ((double)rand() / RAND_MAX < EPSILON_DIFF)
+#ifdef RARE_EVENT
+	rare_hop_diffuse(last_channel, agent->cur_best_channel);
+#endif
+	if ((double)DFH_RAND() / RAND_MAX < EPSILON_DIFF)
 	{ //****************************** EXPLORATION by DIFFUSION?
-		// return rand() % NUM_CHANNELS; // Exploration
-		sign = rand() % 2;
+		// return DFH_RAND() % NUM_CHANNELS; // Exploration
+		sign = DFH_RAND() % 2;
 		if (sign == 0)
 			sign = -1; // else sign = 1;
 
 		if (HMAX == 1)
 			magnitude = 1; // This is a degenerate case.
 		else
-			magnitude = (rand() % HMAX) + 1;
+			magnitude = (DFH_RAND() % HMAX) + 1;
 
 		explored_channel = last_channel + (sign * magnitude);
 
@@ -851,7 +1169,7 @@ int select_legacy_rl_action(Agent *agent, int last_channel, int current_time)
 				agent->cur_hopping_mode = MODE_LEGACY;
 				agent->eStateTimer = STATE_TIMER_WAIT_ARRIVAL;
 				agent->new_best_channel = get_best_channel_based_on_qtable(agent);
-				agent->instance_time = current_time + DEFAULT_DFH_INSTANSTIME;
+				set_instance_time(agent, current_time + DEFAULT_DFH_INSTANSTIME);
 				return agent->random_no_by_fh;
 			}
 		}
@@ -861,7 +1179,7 @@ int select_legacy_rl_action(Agent *agent, int last_channel, int current_time)
 		agent->last_succeed_time = current_time;
 	}
 
-	if (agent->instance_time <= current_time)
+	if (is_instance_due(agent, current_time))
 		bExpiry = true;
 
 	// Action based on timer expiration (instance)
@@ -872,7 +1190,7 @@ int select_legacy_rl_action(Agent *agent, int last_channel, int current_time)
 		{
 			// agent->cur_hopping_mode = MODE_DFH_RL;
 			agent->cur_best_channel = agent->new_best_channel;
-			agent->instance_time = current_time + DEFAULT_DFH_UPDATE_TIMEOUT;
+			set_instance_time(agent, current_time + DEFAULT_DFH_UPDATE_TIMEOUT);
 			agent->eStateTimer = STATE_TIMER_RUN;
 			eTimerState = STATE_TIMER_RUN;
 			if (agent->cur_hopping_mode == MODE_LEGACY)
@@ -896,7 +1214,7 @@ int select_legacy_rl_action(Agent *agent, int last_channel, int current_time)
 		{
 			// agent->cur_hopping_mode = MODE_DFH_RL;
 			agent->new_best_channel = get_best_channel_based_on_qtable(agent);
-			agent->instance_time = current_time + DEFAULT_DFH_INSTANSTIME;
+			set_instance_time(agent, current_time + DEFAULT_DFH_INSTANSTIME);
 			agent->eStateTimer = STATE_TIMER_WAIT_ARRIVAL;
 			eTimerState = STATE_TIMER_WAIT_ARRIVAL;
 		}
@@ -931,7 +1249,10 @@ int select_legacy_rl_action(Agent *agent, int last_channel, int current_time)
 		return agent->random_no_by_fh;
 	}
 
-	if ((double)rand() / RAND_MAX < EPSILON_DIFF)
+#ifdef RARE_EVENT
+	rare_hop_mix(agent->random_no_by_fh, agent->cur_best_channel);
+#endif
+	if ((double)DFH_RAND() / RAND_MAX < EPSILON_DIFF)
 	{	//****************************** EXPLORATION by DIFFUSION?
 		// Exploration
 #if DEBUG_CH_STATE_1
@@ -953,12 +1274,13 @@ int select_legacy_rl_action(Agent *agent, int last_channel, int current_time)
 	}
 }
 
+#ifdef DIFFUSIVE_NEW_ACTION
 int choose_best_action(Agent *agent, int channel)
 {
 	// Choose the best action
 	if (agent->q_table[E_ACTION_TYPE_AFH][channel] == agent->q_table[E_ACTION_TYPE_DIFFUSIVE][channel])
 	{
-		return (rand() % 2);
+		return (DFH_RAND() % 2);
 		// return E_ACTION_TYPE_DIFFUSIVE;
 	}
 	else if (agent->q_table[E_ACTION_TYPE_AFH][channel] > agent->q_table[E_ACTION_TYPE_DIFFUSIVE][channel])
@@ -1000,14 +1322,14 @@ int select_diffusive_new_action(Agent *agent, int current_channel, int current_t
 
 	if (bDiffusive)
 	{
-		// return rand() % NUM_CHANNELS; // Exploration
+		// return DFH_RAND() % NUM_CHANNELS; // Exploration
 		sign = afh_chnnel % 2;
 		if (sign == 0)
 			sign = -1; // else sign = 1;
 		if (HMAX == 1)
 			magnitude = 1; // This is a degenerate case.
 		else
-			while ((magnitude = rand() % HMAX) == 0)
+			while ((magnitude = DFH_RAND() % HMAX) == 0)
 			{
 				// Hopping to the same channel is forbidden -- re-select.
 				;
@@ -1035,6 +1357,51 @@ int select_diffusive_new_action(Agent *agent, int current_channel, int current_t
 
 	return (bDiffusive);
 }
+#endif
+
+#ifdef WIFI
+// True while WiFi is on in this episode.
+static bool is_wifi_on(void)
+{
+#if defined(INTERFERENCE_SCHEDULE)
+	return interference_active();
+#elif defined(TIMER_WHEEL)
+	return gWifiOn;
+#else
+	return (episode >= WIFI_START && episode <= WIFI_END);
+#endif
+}
+
+// True if next_channel is inside a WiFi band while WiFi is on.
+bool is_wifi_interfered(int next_channel)
+{
+#ifdef TRACE_REPLAY
+	// Recorded interferers, on top of the WiFi bands or schedule.
+	if (trace_blocked(next_channel))
+		return true;
+#endif
+#ifdef INTERFERENCE_SCHEDULE
+	// A single bit test of the current window of the schedule.
+	return interference_blocked(next_channel);
+#else
+	return (is_wifi_on() && ((next_channel >= WIFI_CHANNEL_START && next_channel <= WIFI_CHANNEL_END) || (next_channel >= WIFI_CHANNEL_11_START && next_channel <= WIFI_CHANNEL_11_END) || (next_channel >= WIFI_CHANNEL_1_START && next_channel <= WIFI_CHANNEL_1_END)));
+#endif
+}
+#endif
+
+#if (PHYSICAL_MODE == RAYLEIGH_FADING_MODEL)
+static bool has_interferer(const Agent *agent, int id)
+{
+	return (agent->interferers_bitmap[id >> 6] >> (id & 63)) & 1;
+}
+
+static void add_interferer(Agent *agent, int id)
+{
+	agent->interferers[agent->interferer_count] = id;
+	agent->interferer_count++;
+	agent->interferers_bitmap[id >> 6] |= (1ULL << (id & 63));
+}
+#endif
 
 double calculate_reward(Agent agents[], int num_agents, int agent_id, int next_channel)
 {
@@ -1042,11 +1409,16 @@ double calculate_reward(Agent agents[], int num_agents, int agent_id, int next_c
 	agents[agent_id].isCurChCollied = false;
 
 	agents[agent_id].interferer_count = 0;
-	agents[agent_id].interferers_bitmap = 0;
+	memset(agents[agent_id].interferers_bitmap, 0, sizeof(agents[agent_id].interferers_bitmap));
 
+#ifdef TRAFFIC
+	// An idle piconet neither causes nor suffers collisions.
+	if (piconet_queues[agent_id].transmitting == false)
+		return 0;
+#endif
 #ifdef WIFI
 	// Collision is guaranteed due to WiFi interference.
-	if (episode >= WIFI_START && episode <= WIFI_END && ((next_channel >= WIFI_CHANNEL_START && next_channel <= WIFI_CHANNEL_END) || (next_channel >= WIFI_CHANNEL_11_START && next_channel <= WIFI_CHANNEL_11_END) || (next_channel >= WIFI_CHANNEL_1_START && next_channel <= WIFI_CHANNEL_1_END)))
+	if (is_wifi_interfered(next_channel))
 	{
 		// Other piconets are not involved, so only update the agent's own collision map.
 		if (agents[agent_id].isCurChCollied == false)
@@ -1058,8 +1430,17 @@ double calculate_reward(Agent agents[], int num_agents, int agent_id, int next_c
 	else
 	{ // If there is no WiFi, check for collisions with other piconets.
 #endif
+#ifdef MULTI_SLOT
+		// Only the packets on next_channel that overlap this one in time.
+		for (int i = multi_slot_next_overlap(agent_id, 0); i != 0; i = multi_slot_next_overlap(agent_id, i))
+#else
 		for (int i = 1; i <= num_agents; i++)
+#endif
 		{
+#ifdef TRAFFIC
+			if (piconet_queues[i].transmitting == false)
+				continue;
+#endif
 			if (i != agent_id && agents[i].current_channel == next_channel)
 			{
 				// collisions++; // Should we account for multiple collisions? In reality, this is impossible.
@@ -1092,12 +1473,8 @@ double calculate_reward(Agent agents[], int num_agents, int agent_id, int next_c
 				agents[agent_id].interferers[agents[agent_id].interferer_count] = i;
 				agents[agent_id].interferer_count++;
 
-				if ((agents[i].interferers_bitmap & (1 << agent_id)) == 0)
-				{
-					agents[i].interferers[agents[i].interferer_count] = agent_id;
-					agents[i].interferer_count++;
-					agents[i].interferers_bitmap |= (1 << agent_id);
-				}
+				if (has_interferer(&agents[i], agent_id) == false)
+					add_interferer(&agents[i], agent_id);
 #endif
 			}
 		}
@@ -1124,6 +1501,8 @@ void update_q_table(Agent *agent, int action, double reward, int current_time)
 	else if (agent->hopping_mode == MODE_DFH_RL || agent->hopping_mode == MODE_LEGACY_RL || agent->hopping_mode == MODE_AFH_RL)
 	{
 		// Uses diffusive action (selecting a nearby channel) as the main form of EXPLORATION.
+		// Settled here, not in the scan, which then stays small enough to inline.
+		settle_all_q_values(agent);
 		best_next_action = select_diffusive_best_action(agent, agent->last_channel);
 	}
 	else if (agent->hopping_mode == MODE_AFH)
@@ -1134,22 +1513,228 @@ void update_q_table(Agent *agent, int action, double reward, int current_time)
 		exit(777);
 	}
 
-	agent->q_table[E_ACTION_TYPE_DEFAULT][action] += ALPHA * (reward + GAMMA * agent->q_table[E_ACTION_TYPE_DEFAULT][best_next_action] - agent->q_table[E_ACTION_TYPE_DEFAULT][action]);
+	settle_q_value(agent, action);
+	settle_q_value(agent, best_next_action);
+	agent->q_table[E_ACTION_TYPE_DEFAULT][action] = Q_STORE(Q_LOAD(agent->q_table[E_ACTION_TYPE_DEFAULT][action]) + ALPHA * (reward + GAMMA * Q_LOAD(agent->q_table[E_ACTION_TYPE_DEFAULT][best_next_action]) - Q_LOAD(agent->q_table[E_ACTION_TYPE_DEFAULT][action])));
 	// agent->q_table[E_ACTION_TYPE_DEFAULT][action] += ALPHA * (reward - agent->q_table[E_ACTION_TYPE_DEFAULT][action]);
 
 	agent->cumulative_reward = reward + GAMMA * agent->cumulative_reward;
 	// if (agent->id == 1) fprintf(creward, "%d %lf\n", episode, agent->cumulative_reward);
 }
 
-void run_simulation(Agent agents[], int num_agents)
+int select_next_channel(Agent *agent, int current_time)
 {
-	int current_time;
 	int next_channel;
-	double reward;
+
+	// Added classical and diffusive modes.
+	if (agent->hopping_mode == MODE_LEGACY)
+	{
+		// Here, the Q-table is not consulted, but it is still being updated.
+#ifdef RARE_EVENT
+		rare_hop_map(piconet_queues[agent->id].stHoppingInfo.available_channels, piconet_queues[agent->id].stHoppingInfo.noOfCh);
+#endif
+		next_channel = select_classical_action(agent, current_time);
+	}
+	else if (agent->hopping_mode == MODE_DFH_RL)
+	{
+		// Primarily uses diffusive action (selecting a nearby channel). If a collision occurs, it consults the Q-table (below).
+		next_channel = select_diffusive_rl_action(agent, agent->current_channel, current_time);
+	}
+	else if (agent->hopping_mode == MODE_LEGACY_RL)
+	{
+		next_channel = select_legacy_rl_action(agent, agent->current_channel, current_time);
+	}
+	else if (agent->hopping_mode == MODE_AFH)
+	{
+		next_channel = select_classical_afh_action(agent, current_time);
+	}
+	else if (agent->hopping_mode == MODE_AFH_RL)
+	{
+		next_channel = select_afh_rl_action(agent, agent->current_channel, current_time);
+	}
+	else
+	{
+		printf("Unknown hopping mode. Exiting.\n");
+		exit(777);
+	}
+
+	if (next_channel > 79)
+	{
+		printf("invalid channel %d %d. Exiting.\n", agent->id, next_channel);
+		exit(777);
+	}
+
+	if (next_channel > gNum_channels || next_channel < 1)
+	{
+		printf("invalid channel %d %d. Exiting.\n", agent->id, next_channel);
+		exit(777);
+	}
+
+	return next_channel;
+}
+
+#ifdef SYNC_SLOT
+/*
+ * Synchronous slot semantics.
+ * In the sequential loop, agent i sees the new channels of agents < i and the old channels of agents > i.
+ * Here every agent decides from the state of the previous slot into a second buffer, and the collisions
+ * of the slot are resolved once all agents have chosen. The decisions are independent, so the first
+ * phase can run on several threads (OpenMP) for large populations.
+ */
+void run_sync_slot(Agent agents[], int num_agents, int current_time)
+{
+	static DFH_TLS int next_channels[NUM_AGENTS + 1];
+	// Agents on each channel, as a linked list through next_in_ch.
+	int first_in_ch[NUM_CHANNELS + 1];
+	int next_in_ch[NUM_AGENTS + 1];
+	int ch;
+
+	// Phase 1: learn from the previous slot and choose the next channel. Only agents[i] is written.
+#if defined(_OPENMP) && !defined(HOP_CACHE) && !defined(TIMER_WHEEL) && !defined(PROFILE) && !defined(DEBUG) && !DEBUG_CH_STATE_1
+	// DFH_RAND() is shared by all threads, so with more than one thread the draws are not reproducible.
+#pragma omp parallel for schedule(static) if (num_agents >= SYNC_SLOT_OMP_MIN)
+#endif
+	for (int i = 1; i <= num_agents; i++)
+	{
+		double reward;
+#if (PHYSICAL_MODE == RAYLEIGH_FADING_MODEL)
+		bool bDecoded;
+#endif
+
+		if (episode > 1)
+		{
+#if (PHYSICAL_MODE == RAYLEIGH_FADING_MODEL)
+			if (agents[i].isCurChCollied == true)
+			{
+				PROF_BEGIN(PROF_SINR);
+				bDecoded = determine_packet_outcome(i, i, agents[i].interferers, agents[i].interferer_count, agents);
+				PROF_END(PROF_SINR);
+				if (bDecoded == false)
+				{
+					collision_map[i]++;
+				}
+				else
+				{
+					agents[i].isCurChCollied = false;
+				}
+			}
+#endif
+			reward = (agents[i].isCurChCollied * -1);
+
+#if DEBUG_CH_STATE_1
+			fprintf(trajectory, "%s Channel %d, Col %d\n", agents[i].logStr, agents[i].current_channel, agents[i].isCurChCollied);
+#endif // DEBUG
+#ifdef TRAFFIC
+			if (traffic_complete(i, agents[i].isCurChCollied, current_time))
+#endif
+			{
+				PROF_BEGIN(PROF_Q_UPDATE);
+				update_q_table(&agents[i], agents[i].current_channel, reward, current_time);
+				PROF_END(PROF_Q_UPDATE);
+			}
+		}
+
+		PROF_BEGIN(PROF_HOP);
+		next_channels[i] = select_next_channel(&agents[i], current_time);
+		PROF_END(PROF_HOP);
+#ifdef TRAFFIC
+		traffic_start(i, current_time);
+#endif
+	}
+
+	// Phase 2: all agents switch at once, then the collisions of the slot are resolved.
+	PROF_BEGIN(PROF_COLLISION);
+	for (ch = 1; ch <= NUM_CHANNELS; ch++)
+		first_in_ch[ch] = 0;
+
+	for (int i = num_agents; i >= 1; i--)
+	{
+		agents[i].last_channel = agents[i].current_channel;
+		agents[i].current_channel = next_channels[i];
+		agents[i].last_action = E_ACTION_TYPE_DEFAULT;
+		agents[i].isCurChCollied = false;
+		agents[i].interferer_count = 0;
+		memset(agents[i].interferers_bitmap, 0, sizeof(agents[i].interferers_bitmap));
+#ifdef HEATMAP
+		heatmap[agents[i].current_channel]++;
+#endif
+
+#ifdef TRAFFIC
+		// An idle piconet does not occupy its channel.
+		if (piconet_queues[i].transmitting == false)
+			continue;
+#endif
+		next_in_ch[i] = first_in_ch[next_channels[i]];
+		first_in_ch[next_channels[i]] = i;
+	}
+
+	for (int i = 1; i <= num_agents; i++)
+	{
+		ch = agents[i].current_channel;
+
+#ifdef TRAFFIC
+		if (piconet_queues[i].transmitting == false)
+			continue;
+#endif
+#ifdef WIFI
+		if (is_wifi_interfered(ch))
+		{
+			collision_map[i]++;
+			agents[i].isCurChCollied = true;
+			continue;
+		}
+#endif
+		for (int j = first_in_ch[ch]; j != 0; j = next_in_ch[j])
+		{
+			if (j == i)
+				continue;
+
+			agents[i].isCurChCollied = true;
+#if (PHYSICAL_MODE == NONE_MODEL)
+			collision_map[i] = 1;
+#else
+			add_interferer(&agents[i], j);
+#endif
+		}
+	}
+	PROF_END(PROF_COLLISION);
+}
+#endif
+
+// Sets up the event sources of a run before its first episode.
+void run_simulation_begin(Agent agents[], int num_agents)
+{
+#ifdef INTERFERENCE_SCHEDULE
+	interference_load(gDefaultWifiAps, sizeof(gDefaultWifiAps) / sizeof(gDefaultWifiAps[0]));
+	interference_seek(1);
+#endif
+#ifdef TRACE_REPLAY
+	trace_open();
+#endif
+#ifdef TIMER_WHEEL
+	schedule_agent_timers(agents, num_agents);
+#endif
+#ifdef TRAFFIC
+	traffic_reset(num_agents);
+#endif
+#ifdef MULTI_SLOT
+	multi_slot_reset(num_agents);
+#endif
+}
+
+// Runs the episodes first to last of a run set up by run_simulation_begin(). dfh_step() runs a simulation
+// a few episodes at a time.
+void run_episodes(Agent agents[], int num_agents, int first, int last)
+{
+	int current_time;
+	int next_channel;
+	double reward;
 	int action;
-	// printf("Number of agents = %d\n", num_agents);
+#if (PHYSICAL_MODE == RAYLEIGH_FADING_MODEL)
+	bool bDecoded;
+#endif
 
-	for (episode = 1; episode <= MAX_EPISODES; episode++)
+	for (episode = first; episode <= last; episode++)
 	{
 
 		current_time = (episode - 1) * 2; // every
@@ -1164,13 +1749,47 @@ void run_simulation(Agent agents[], int num_agents)
 				total_collisions[i] = 0;
 				total_wifi_collisions[i] = 0;
 				prev_cols[i] = 0;
+#ifdef RUN_LENGTH
+				gCollisionRun[i] = 0;
+#endif
 			}
+#ifdef TRAFFIC
+			traffic_reset_stats(num_agents);
+#endif
+#ifdef RARE_EVENT
+			rare_event_reset();
+#endif
 		}
 
+		PROF_BEGIN(PROF_EVENTS);
+#ifdef TIMER_WHEEL
+		// Fires the events due in this episode; the agents only read the flags they set.
+		timer_wheel_advance(current_time);
+#elif defined(INTERFERENCE_SCHEDULE)
+		interference_seek(episode);
+#endif
+#ifdef TRACE_REPLAY
+		trace_seek(current_time);
+#endif
+		PROF_END(PROF_EVENTS);
+
+#ifdef SYNC_SLOT
+		if (gSyncSlot)
+		{
+			run_sync_slot(agents, num_agents, current_time);
+		}
+		else
+#endif
 		for (int i = 1; i <= num_agents; i++)
 		{
 			action = E_ACTION_TYPE_DEFAULT;
 
+#ifdef MULTI_SLOT
+			// The packet of the last hop still occupies its channel. It learns the outcome when it ends.
+			if (multi_slot_busy(i, current_time))
+				continue;
+#endif
+
 #ifdef DEBUG
 			fprintf(chan, "Agent %d\n", i);
 #endif
@@ -1183,7 +1802,10 @@ void run_simulation(Agent agents[], int num_agents)
 
 				if (agents[i].isCurChCollied == true)
 				{
-					if (determine_packet_outcome(i, i, agents[i].interferers, agents[i].interferer_count, agents) == false)
+					PROF_BEGIN(PROF_SINR);
+					bDecoded = determine_packet_outcome(i, i, agents[i].interferers, agents[i].interferer_count, agents);
+					PROF_END(PROF_SINR);
+					if (bDecoded == false)
 					{
 						collision_map[i]++;
 					}
@@ -1201,52 +1823,36 @@ void run_simulation(Agent agents[], int num_agents)
 					fprintf(trajectory, "%s Channel %d, Col %d\n", agents[i].logStr, agents[i].current_channel, agents[i].isCurChCollied);
 				}
 #endif // DEBUG
-				update_q_table(&agents[i], agents[i].current_channel, reward, current_time);
-			}
-
-			// Added classical and diffusive modes.
-			if (agents[i].hopping_mode == MODE_LEGACY)
-			{
-				// Here, the Q-table is not consulted, but it is still being updated.
-				next_channel = select_classical_action(&agents[i], current_time);
-			}
-			else if (agents[i].hopping_mode == MODE_DFH_RL)
-			{
-				// Primarily uses diffusive action (selecting a nearby channel). If a collision occurs, it consults the Q-table (below).
-				next_channel = select_diffusive_rl_action(&(agents[i]), agents[i].current_channel, current_time);
-			}
-			else if (agents[i].hopping_mode == MODE_LEGACY_RL)
-			{
-				next_channel = select_legacy_rl_action(&(agents[i]), agents[i].current_channel, current_time);
-			}
-			else if (agents[i].hopping_mode == MODE_AFH)
-			{
-				next_channel = select_classical_afh_action(&agents[i], current_time);
-			}
-			else if (agents[i].hopping_mode == MODE_AFH_RL)
-			{
-				next_channel = select_afh_rl_action(&(agents[i]), agents[i].current_channel, current_time);
-			}
-			else
-			{
-				printf("Unknown hopping mode. Exiting.\n");
-				exit(777);
-			}
-
-			if (next_channel > 79)
-			{
-				printf("invalid channel %d %d. Exiting.\n", i, next_channel);
-				exit(777);
+#ifdef TRAFFIC
+				// An idle piconet got no ACK in the last slot, so there is nothing to learn.
+				if (traffic_complete(i, agents[i].isCurChCollied, current_time))
+#endif
+				{
+					PROF_BEGIN(PROF_Q_UPDATE);
+					update_q_table(&agents[i], agents[i].current_channel, reward, current_time);
+					PROF_END(PROF_Q_UPDATE);
+				}
 			}
 
-			if (next_channel > gNum_channels || next_channel < 1)
-			{
-				printf("invalid channel %d %d. Exiting.\n", i, next_channel);
-				exit(777);
-			}
+			PROF_BEGIN(PROF_HOP);
+			next_channel = select_next_channel(&agents[i], current_time);
+			PROF_END(PROF_HOP);
 
+#ifdef TRAFFIC
+			// Decides whether the piconet sends in this slot before its collisions are checked.
+			traffic_start(i, current_time);
+#endif
+#ifdef MULTI_SLOT
+			multi_slot_place(i, next_channel, current_time);
+#endif
+#ifdef RARE_EVENT
+			// Expected collisions of the hop, before calculate_reward() counts those of the channel drawn.
+			rare_event_hop(agents, num_agents, agents[i].id, next_channel);
+#endif
 			// Checks for collisions on the newly selected channel.
+			PROF_BEGIN(PROF_COLLISION);
 			calculate_reward(agents, num_agents, agents[i].id, next_channel);
+			PROF_END(PROF_COLLISION);
 
 			// The current channel becomes the last channel, used as a reference for +-dx calculations.
 			agents[i].last_channel = agents[i].current_channel;
@@ -1271,20 +1877,38 @@ void run_simulation(Agent agents[], int num_agents)
 		// if (i == 1) fprintf(chan, "\n");
 #endif
 		// Collect collision statistics for the current episode.
+		PROF_BEGIN(PROF_STATS);
 		for (int i = 1; i <= num_agents; i++)
 		{
 			total_collisions[i] += (collision_map[i] ? 1 : 0);
+#ifdef RUN_LENGTH
+			run_length_track(&gCollisionRun[i], &gstRunHist, collision_map[i] != 0);
+#endif
+#ifdef COLLISION_LOG
+			collision_log_add(i, episode, collision_map[i] != 0);
+#endif
+#ifdef DETERMINISTIC
+			if (gpfHopHook != NULL)
+				gpfHopHook(i, agents[i].current_channel, episode);
+#endif
 
 #ifdef WIFI
-			if (episode >= WIFI_START && episode <= WIFI_END)
+			if (is_wifi_on())
 				total_wifi_collisions[i] += (collision_map[i] ? 1 : 0);
 #endif
 		}
+#ifdef RARE_EVENT
+		rare_event_episode(num_agents);
+#endif
 		// Reset collision statistics for the next episode.
 		for (int i = 1; i <= num_agents; i++)
 		{
 			collision_map[i] = 0;
 		}
+		PROF_END(PROF_STATS);
+#ifdef LIVE_STATS
+		live_stats_tick(episode, num_agents);
+#endif
 
 #ifdef HEATMAP
 		if (episode % 100 == 0)
@@ -1312,7 +1936,156 @@ void run_simulation(Agent agents[], int num_agents)
 	}
 }
 
-Agent gstAgents[NUM_AGENTS + 1];
+void run_simulation(Agent agents[], int num_agents)
+{
+	int last_episode = MAX_EPISODES;
+	// printf("Number of agents = %d\n", num_agents);
+
+	if (gRunEpisodes > 0)
+		last_episode = gRunEpisodes;
+#ifdef SWEEP_SCHEDULER
+	// Short calibration runs of the sweep scheduler.
+	if (gSweepCalibEpisodes > 0)
+		last_episode = gSweepCalibEpisodes;
+#endif
+
+#ifdef PROFILE
+	prof_run_begin();
+#endif
+#ifdef FAST_FORWARD
+	// LFH and AFH do not consult the Q-table to hop, so all channels are known in advance.
+	if (can_fast_forward(agents, num_agents))
+	{
+		run_fast_forward(agents, num_agents, last_episode);
+#ifdef PROFILE
+		prof_run_end(gModeDefault, gNum_channels, num_agents);
+#endif
+		return;
+	}
+#endif
+
+	run_simulation_begin(agents, num_agents);
+	run_episodes(agents, num_agents, 1, last_episode);
+#ifdef PROFILE
+	prof_run_end(gModeDefault, gNum_channels, num_agents);
+#endif
+}
+
+DFH_TLS Agent gstAgents[NUM_AGENTS + 1];
+
+// Same set-up as main() of marl_diffusion.c and marl_main() for any number of piconets, without the files
+// (bench/, dfh.c). Positions keep the density of the subway car of physical_model.h by stretching the car
+// with the number of piconets.
+void setup_piconets(int na, unsigned int seed)
+{
+	S_HOPPING_INFO *pHopInfo;
+	double length = SUBWAY_LENGTH * (na > 10 ? na / 10.0 : 1.0);
+
+	DFH_SRAND(seed);
+	memset(piconet_queues, 0, sizeof(piconet_queues));
+	for (int i = 1; i <= na; i++)
+	{
+		pHopInfo = &(piconet_queues[i].stHoppingInfo);
+		piconet_queues[i].startClock = DFH_RAND() % 1600;
+		// Beyond the table, the addresses differ in the UAP/LAP bits used by the hop kernel.
+		pHopInfo->bdAddr = bdAddr[i % 56] ^ ((uint64_t)(i / 56) * 0x9E3779B1ULL & 0xFFFFFFFFULL);
+		memset(pHopInfo->available_channels, 1, 79);
+		pHopInfo->noOfCh = 79;
+		pHopInfo->base_clk = ((DFH_RAND() % (1600 * 100)) & (0xffffffff - 1));
+
+		gstAgents[i].default_rand = DFH_RAND();
+		gstAgents[i].pos_x = ((double)DFH_RAND() / RAND_MAX) * length;
+		gstAgents[i].pos_y = ((double)DFH_RAND() / RAND_MAX) * SUBWAY_WIDTH;
+		gstAgents[i].tx_power_dbm = 4.0;
+	}
+}
+
+// Channel counts and map sizes as marl_main() sets them for a sweep point.
+void set_sweep_point(int mode, int nc, int hmax)
+{
+	gModeDefault = mode;
+	gNum_channels = nc;
+	HMAX = hmax;
+	if (mode == MODE_AFH || mode == MODE_AFH_RL)
+		gNumOfAvailCh = 20;
+	else
+		gNumOfAvailCh = nc;
+}
+
+// Repeats the current mode for the next HMAX (DFH) or map size (CH_MAP_SIZE), if any.
+void next_sweep_variant(void)
+{
+	switch (gModeDefault)
+	{
+	case MODE_DFH_RL:
+		
+		switch(HMAX)
+		{
+		case 5:
+			HMAX = 3;
+			gModeDefault--;
+			break;
+		case 3:
+			HMAX = 2;
+			gModeDefault--;
+			break;
+		case 2:
+			HMAX = 5;
+			break;
+		default:
+			break;
+		}
+		break;
+#ifdef CH_MAP_SIZE
+	case MODE_AFH:
+		if (gNumOfAvailCh < 79)
+		{
+			gNumOfAvailCh++;
+			gModeDefault--;
+		}
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
+#ifdef LIVE_STATS_SWEEP_LOOPS
+// Sweep points of the mode loop of marl_main() from the current mode, HMAX and map size.
+static int count_sweep_variants(void)
+{
+	int mode = gModeDefault, hmax = HMAX, avail = gNumOfAvailCh;
+	int n = 0;
+
+	for (gModeDefault = MODE_LEGACY; gModeDefault < MODE_DFH_RL + 1; gModeDefault++, n++)
+		next_sweep_variant();
+	gModeDefault = mode;
+	HMAX = hmax;
+	gNumOfAvailCh = avail;
+	return n;
+}
+#endif
+
+#ifdef SYNC_SLOT_COMPARE
+static DFH_TLS unsigned int gSyncBaseSeed;
+
+// Seed of the current sweep point (FNV-1a over its parameters), so that its sequential and synchronous
+// runs start from the same rand() state.
+static unsigned int sync_point_seed(int na, int nc)
+{
+#ifdef DIFFUSIVE
+	int point[] = {gModeDefault, nc, na, gNumOfAvailCh, HMAX, num_diff, gTargetCoexit};
+#else
+	int point[] = {gModeDefault, nc, na, gNumOfAvailCh, HMAX};
+#endif
+	const unsigned char *p = (const unsigned char *)point;
+	uint64_t hash = 0xCBF29CE484222325ULL ^ gSyncBaseSeed;
+
+	for (size_t i = 0; i < sizeof(point); i++)
+		hash = (hash ^ p[i]) * 0x100000001B3ULL;
+	return (unsigned int)(hash ^ (hash >> 32));
+}
+#endif
 
 int marl_main(void)
 {
@@ -1322,12 +2095,30 @@ int marl_main(void)
 	char trajectory_str[128];
 	char col_per_agent[256];
 	char *pPostStr;
-	int temp_index = 0;
 
 	float result_pcol[3];
+#ifdef SYNC_SLOT_COMPARE
+	double seq_pcol, sync_pcol;
+#endif
 	time_t now;
 	struct tm *t;
 	char filename[256];
+#ifdef RESULT_STORE
+	S_STORE_ROW stStoreRow;
+	float storeAgents[NUM_AGENTS];
+#endif
+#ifdef AGENT_STATS
+	S_AGENT_STATS stAgentStats;
+#endif
+#ifdef LIVE_STATS_SWEEP_LOOPS
+	// (na, nc) pairs of the loops below.
+#ifdef DIFFUSIVE
+	int numOfLivePairs = (NUM_AGENTS - 10 + 1) * (MODE_LEGACY_RL + 1 - MODE_AFH) * ((NUM_CHANNELS - 40) / 39 + 1);
+#else
+	int numOfLivePairs = (NUM_AGENTS - 10 + 1) * ((79 - 20) / 10 + 1);
+#endif
+	int livePair = 0;
+#endif
 
 	time(&now);
 	t = localtime(&now);
@@ -1338,15 +2129,62 @@ int marl_main(void)
 #else
 	strftime(filename, sizeof(filename), "pcol_%Y%m%d_%H%M%S.txt", t);
 #endif
-	srand(time(NULL));
+	DFH_SRAND(DFH_RAND_SEED());
+	// Memory of the agents, most of it the Q-tables (see Q_COMPACT).
+	printf("Agent %d bytes (Q-table %d bytes of %d-byte values), %d agents %d bytes\n", (int)sizeof(Agent), (int)sizeof(gstAgents[0].q_table),
+		(int)sizeof(q_value_t), NUM_AGENTS + 1, (int)sizeof(gstAgents));
+#ifdef SYNC_SLOT_COMPARE
+	gSyncSlot = false;
+	gSyncBaseSeed = DFH_RAND();
+#endif
 
 	pcol = fopen(filename, "w");
+#ifdef SYNC_SLOT_COMPARE
+	// Sequential vs. synchronous pcol of every sweep point.
+	strftime(filename, sizeof(filename), "psync_%Y%m%d_%H%M%S.txt", t);
+	psync = fopen(filename, "w");
+	fprintf(psync, "# mode nc na avail pcol_seq pcol_sync diff hmax");
+#endif
+#ifdef TRAFFIC
+	// Per-piconet latency and goodput of every sweep point.
+	strftime(filename, sizeof(filename), "traffic_%Y%m%d_%H%M%S.txt", t);
+	ptraffic = fopen(filename, "w");
+	fprintf(ptraffic, "# codec %s: mode nc na hmax piconet sdus delivered dropped avg_delay_ms max_delay_ms goodput_kbps pdus retx", gCodecProfiles[TRAFFIC_CODEC].name);
+#endif
+#ifdef RUN_LENGTH
+	// Histogram and CDF of the collided episodes in a row (retransmissions) of every sweep point.
+	strftime(filename, sizeof(filename), "retx_%Y%m%d_%H%M%S.txt", t);
+	pretx = fopen(filename, "w");
+	fprintf(pretx, "# mode nc na avail hmax, then run_length runs cdf (run_length.h)\n");
+#endif
+#ifdef AGENT_STATS
+	// Distribution of the per-agent pcol of every sweep point, which pcol then leaves out.
+	strftime(filename, sizeof(filename), "fair_%Y%m%d_%H%M%S.txt", t);
+	pfair = fopen(filename, "w");
+	fprintf(pfair, "# mode nc na avail hmax n jain mean min p05 q1 median q3 p95 max whisker_lo whisker_hi outliers, then its sketch (agent_stats.h)\n");
+#endif
+#ifdef RARE_EVENT
+	// pcol of every sweep point, counted and by its expectation over the draws of the hops or the fading.
+	strftime(filename, sizeof(filename), "rare_%Y%m%d_%H%M%S.txt", t);
+	prare = fopen(filename, "w");
+	fprintf(prare, "# mode nc na avail hmax pcol se pcol_rb se_rb variance_ratio batches (rare_event.h)\n");
+#endif
+#ifdef PROFILE
+	// Where the time of each sweep point goes.
+	strftime(filename, sizeof(filename), "prof_%Y%m%d_%H%M%S.txt", t);
+	prof_open(filename);
+#endif
 	//    pfQValueFile = fopen("qvalue.txt","w");
+#ifdef RESULT_STORE
+	// Every sweep point also goes to the columnar store, under the time of this sweep.
+	result_store_open(RESULT_STORE_FILE, NUM_AGENTS);
+	stStoreRow.run = now;
+#endif
 
 	// Store default values to ensure identical frequency hopping regardless of hopping mode.
 	for (int i = 1; i <= NUM_AGENTS; i++)
 	{
-		gstAgents[i].default_rand = rand();
+		gstAgents[i].default_rand = DFH_RAND();
 		// --- Initialize physical properties for a subway environment ---
 #if (PHYSICAL_MODE == RAYLEIGH_FADING_MODEL)
 		generate_valid_position(i, gstAgents, MIN_DISTANCE, SUBWAY_LENGTH, SUBWAY_WIDTH, &(gstAgents[i].pos_x), &(gstAgents[i].pos_y));
@@ -1356,9 +2194,26 @@ int marl_main(void)
 #ifdef SHUFFLE
 	fisherYatesShuffle(CHANNEL_SHUFFLE, NUM_CHANNELS);
 #endif
+#ifdef RESULT_CACHE
+	// Every sweep point restarts from the agents as set up here.
+	result_cache_begin();
+#endif
+#ifdef LIVE_STATS
+	live_stats_begin();
+#endif
 
+#ifdef SWEEP_SCHEDULER
+	// The first pass collects the sweep points and runs them in parallel, the second prints them in order.
+	for (sweep_begin(); gSweepPass != SWEEP_PASS_DONE; sweep_next_pass())
+#endif
+#ifdef ADAPTIVE_SWEEP
+	// Runs the sweep points chosen by the refinement. The loops below print them row by row.
+	adaptive_sweep_run();
+	for (int na = adaptive_sweep_next_na(0); na != 0; na = adaptive_sweep_next_na(na))
+#else
 	// To be used for the overall simulation (normal conditions).
 	for (int na = 10; na <= NUM_AGENTS; na++)
+#endif
 	// For partial simulation (to observe behavior with a specific number of agents).
 	// for (int na = NUM_AGENTS; na <= NUM_AGENTS; na++)
 	{
@@ -1372,12 +2227,19 @@ int marl_main(void)
 			{
 #else
 		// To observe the effect of the number of channels.
+#ifdef ADAPTIVE_SWEEP
+		for (int nc = adaptive_sweep_next_nc(na, 0); nc != 0; nc = adaptive_sweep_next_nc(na, nc))
+#else
 		for (int nc = 20; nc <= 79; nc = nc + 10)
+#endif
 		{
 #endif
 				// For partial simulation (to observe behavior with a specific number of channels).
 				// for (int nc = NUM_CHANNELS; nc <= NUM_CHANNELS; nc++) {
 				gNum_channels = nc;
+#ifdef LIVE_STATS_SWEEP_LOOPS
+				live_stats_pair(livePair++, numOfLivePairs, count_sweep_variants());
+#endif
 
 				// To iterate through an increasing number of diffusive piconets (0 is for baseline).
 				// for (int nd = 0; nd <= NUM_AGENTS; nd++) {
@@ -1457,8 +2319,44 @@ int marl_main(void)
 						// run_simulation(agents, NUM_AGENTS);
 
 						// The total_collisions array is initialized to all zeros in initialize_agents.
+#ifdef LIVE_STATS_SWEEP_LOOPS
+						live_stats_point(na, nc);
+#endif
+#ifdef SWEEP_SCHEDULER
+						if (gSweepPass == SWEEP_PASS_COLLECT)
+						{
+							sweep_add_job(na, nc);
+							next_sweep_variant();
+							continue;
+						}
+						sweep_load_result(na, nc);
+#elif defined(ADAPTIVE_SWEEP)
+						adaptive_sweep_load_result(na, nc);
+#elif defined(RESULT_CACHE)
+						if (!result_cache_load(na, nc))
+						{
+							initialize_agents(gstAgents, na);
+							run_simulation(gstAgents, na);
+							result_cache_store(na);
+						}
+#else
+#ifdef COLLISION_LOG
+#ifdef DIFFUSIVE
+						sprintf(filename, "collog_M%d_%d_%d_%d_hmax%d_d%d_c%d.bin", gModeDefault, nc, na, gNumOfAvailCh, HMAX, num_diff, gTargetCoexit);
+#else
+						sprintf(filename, "collog_M%d_%d_%d_%d_hmax%d.bin", gModeDefault, nc, na, gNumOfAvailCh, HMAX);
+#endif
+						collision_log_open(filename, na);
+#endif
+#ifdef SYNC_SLOT_COMPARE
+						DFH_SRAND(sync_point_seed(na, nc));
+#endif
 						initialize_agents(gstAgents, na);
 						run_simulation(gstAgents, na);
+#ifdef COLLISION_LOG
+						collision_log_close();
+#endif
+#endif
 
 						// fprintf(pcol, "pico1 = %f, pico10 = %f (nd = %d)\n", total_collisions[1] * 1.0 / (MAX_EPISODES - PERTURBATION), total_collisions[10] * 1.0 / (MAX_EPISODES - PERTURBATION), nd);
 #ifdef DIFFUSIVE
@@ -1487,17 +2385,23 @@ int marl_main(void)
 
 #endif
 						final_collision_tally = 0;
-						temp_index = 0;
+#ifdef AGENT_STATS
+						col_per_agent[0] = '\0';
+#else
+						int temp_index = 0;
+#endif
 						for (int i = 1; i <= NUM_AGENTS; i++)
 						{
+#ifndef AGENT_STATS
 							sprintf(&(col_per_agent[temp_index]), "%f ", (total_collisions[i] * 1.0 / (MAX_EPISODES - PERTURBATION)));
 							temp_index = strlen(col_per_agent);
+#endif
 							final_collision_tally += total_collisions[i];
 							// printf("%f ", total_collisions[i] * 1.0 / (MAX_EPISODES - PERTURBATION));
 							final_wifi_collision_tally += (double)(total_wifi_collisions[i]);
 						}
 
-						final_wifi_collision_tally = final_wifi_collision_tally / ((WIFI_END - WIFI_START) * na);
+						final_wifi_collision_tally = final_wifi_collision_tally / ((WIFI_OFF_EPISODE - WIFI_ON_EPISODE) * na);
 
 						// fprintf(pcol, "%d %d %f\n", na, nc, final_collision_tally * 1.0 / na / (MAX_EPISODES - PERTURBATION));
 						// if(nc == 79)
@@ -1510,40 +2414,80 @@ int marl_main(void)
 					printf("\nM%d %d %d %d %f %f hmax%d %s", gModeDefault, nc, na, gNumOfAvailCh, final_collision_tally * 1.0 / na / (MAX_EPISODES - PERTURBATION), final_wifi_collision_tally, HMAX, col_per_agent);
 					fprintf(pcol, "\nM%d %d %d %d %f %f hmax%d %s", gModeDefault, nc, na, gNumOfAvailCh, final_collision_tally * 1.0 / na / (MAX_EPISODES - PERTURBATION), final_wifi_collision_tally, HMAX, col_per_agent);
 #endif
-
-						switch (gModeDefault)
-						{
-						case MODE_DFH_RL:
-							
-							switch(HMAX)
-							{
-							case 5:
-								HMAX = 3;
-								gModeDefault--;
-								break;
-							case 3:
-								HMAX = 2;
-								gModeDefault--;
-								break;
-							case 2:
-								HMAX = 5;
-								break;
-							default:
-								break;
-							}
-							break;
-#ifdef CH_MAP_SIZE
-						case MODE_AFH:
-							if (gNumOfAvailCh < 79)
-							{
-								gNumOfAvailCh++;
-								gModeDefault--;
-							}
-							break;
+#ifdef LIVE_STATS_SWEEP_LOOPS
+						live_stats_point_done(final_collision_tally * 1.0 / na / (MAX_EPISODES - PERTURBATION));
 #endif
-						default:
-							break;
+#ifdef RESULT_STORE
+						stStoreRow.val[STORE_COL_MODE - STORE_COL_MODE] = gModeDefault;
+						stStoreRow.val[STORE_COL_NC - STORE_COL_MODE] = nc;
+						stStoreRow.val[STORE_COL_NA - STORE_COL_MODE] = na;
+						stStoreRow.val[STORE_COL_AVAIL - STORE_COL_MODE] = gNumOfAvailCh;
+						stStoreRow.val[STORE_COL_HMAX - STORE_COL_MODE] = HMAX;
+						stStoreRow.val[STORE_COL_DIFF - STORE_COL_MODE] = num_diff;
+#ifdef DIFFUSIVE
+						stStoreRow.val[STORE_COL_COEXIST - STORE_COL_MODE] = gTargetCoexit;
+#else
+						stStoreRow.val[STORE_COL_COEXIST - STORE_COL_MODE] = 0;
+#endif
+						stStoreRow.pcol = final_collision_tally * 1.0 / na / (MAX_EPISODES - PERTURBATION);
+						stStoreRow.wifi = final_wifi_collision_tally;
+						for (int i = 1; i <= NUM_AGENTS; i++)
+							storeAgents[i - 1] = total_collisions[i] * 1.0 / (MAX_EPISODES - PERTURBATION);
+						result_store_add(&stStoreRow, storeAgents);
+#endif
+#ifdef RUN_LENGTH
+						// Runs still open at the end of the run.
+						for (int i = 1; i <= na; i++)
+						{
+							if (gCollisionRun[i] > 0)
+								run_hist_add(&gstRunHist, gCollisionRun[i]);
+							gCollisionRun[i] = 0;
 						}
+						sprintf(col_per_agent, "M%d %d %d %d hmax%d", gModeDefault, nc, na, gNumOfAvailCh, HMAX);
+						run_hist_write(pretx, col_per_agent, &gstRunHist);
+						fflush(pretx);
+#endif
+#ifdef AGENT_STATS
+						agent_stats_reset(&stAgentStats);
+						for (int i = 1; i <= na; i++)
+							agent_stats_add(&stAgentStats, total_collisions[i] * 1.0 / (MAX_EPISODES - PERTURBATION));
+						sprintf(col_per_agent, "M%d %d %d %d hmax%d", gModeDefault, nc, na, gNumOfAvailCh, HMAX);
+						agent_stats_write(pfair, col_per_agent, &stAgentStats);
+						fflush(pfair);
+#endif
+#ifdef RARE_EVENT
+						sprintf(col_per_agent, "M%d %d %d %d hmax%d", gModeDefault, nc, na, gNumOfAvailCh, HMAX);
+						rare_event_write(prare, col_per_agent, na);
+						fflush(prare);
+#endif
+#ifdef TRAFFIC
+						sprintf(col_per_agent, "M%d %d %d hmax%d", gModeDefault, nc, na, HMAX);
+						traffic_report(ptraffic, col_per_agent, na);
+						fflush(ptraffic);
+#endif
+#ifdef SYNC_SLOT_COMPARE
+						// pcol keeps the sequential result. Run the same point again with synchronous slots.
+						seq_pcol = 0;
+						for (int i = 1; i <= na; i++)
+							seq_pcol += total_collisions[i];
+						seq_pcol = seq_pcol / na / (MAX_EPISODES - PERTURBATION);
+
+						gSyncSlot = true;
+						DFH_SRAND(sync_point_seed(na, nc));
+						initialize_agents(gstAgents, na);
+						run_simulation(gstAgents, na);
+						gSyncSlot = false;
+
+						sync_pcol = 0;
+						for (int i = 1; i <= na; i++)
+							sync_pcol += total_collisions[i];
+						sync_pcol = sync_pcol / na / (MAX_EPISODES - PERTURBATION);
+
+						fprintf(psync, "\nM%d %d %d %d %f %f %f hmax%d", gModeDefault, nc, na, gNumOfAvailCh, seq_pcol, sync_pcol, sync_pcol - seq_pcol, HMAX);
+						fflush(psync);
+#endif
+
+						next_sweep_variant();
 						/*
 						if(gModeDefault == MODE_AFH && gNumOfAvailCh < 79)
 						{
@@ -1570,13 +2514,46 @@ int marl_main(void)
 				}
 
 			}
+#ifdef SWEEP_SCHEDULER
+			if (gSweepPass == SWEEP_PASS_REPORT)
+#endif
 			fprintf(pcol, "\n", na);
 			// fflush(pcol);
+#ifdef RESULT_STORE
+			result_store_flush();
+#endif
 #ifdef DIFFUSIVE
 		} // for (gTargetCoexit = MODE_AFH; gTargetCoexit != MODE_LEGACY_RL ; gTargetCoexit = MODE_LEGACY_RL){
 #endif
 	}
 	fclose(pcol);
+#ifdef RESULT_STORE
+	result_store_close();
+#endif
+#ifdef RESULT_CACHE
+	result_cache_end();
+#endif
+#ifdef LIVE_STATS
+	live_stats_end();
+#endif
+#ifdef SYNC_SLOT_COMPARE
+	fclose(psync);
+#endif
+#ifdef PROFILE
+	prof_close();
+#endif
+#ifdef TRAFFIC
+	fclose(ptraffic);
+#endif
+#ifdef AGENT_STATS
+	fclose(pfair);
+#endif
+#ifdef RUN_LENGTH
+	fclose(pretx);
+#endif
+#ifdef RARE_EVENT
+	fclose(prare);
+#endif
 	//    fclose(pfQValueFile);
 
 	return 0;
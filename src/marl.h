@@ -8,10 +8,17 @@
 #ifndef MARL_H_
 #define MARL_H_
 
+// The builds of bench/ set these on the command line.
+#ifndef NUM_AGENTS
 #define NUM_AGENTS 10   // Maximum number of piconets
+#endif
 #define NUM_CHANNELS 79 // Maximum number of frequencies
+#ifndef MAX_EPISODES
 #define MAX_EPISODES 100000
+#endif
+#ifndef PERTURBATION
 #define PERTURBATION 2000
+#endif
 
 #define ALPHA 0.1
 #define GAMMA 0.9
@@ -41,10 +48,91 @@
 // #define DEBUG_CH_STATE_1 1
 //  Use to see the effect of Channel map size in AFH. Only applicable to AFH.
 // #define CH_MAP_SIZE
+//  Reuse hop sequences materialized per (BD_ADDR, base clock, channel map) across sweep points and modes.
+// #define HOP_CACHE
+//  Compute hop sequences HOP_BATCH_WIDTH clocks at a time with the branch-free (SSE4.1 when available) kernel.
+// #define HOP_BATCH
+//  Skip the per-episode loop when every agent is LFH or AFH (NONE_MODEL, no WiFi/trace output). Results are identical.
+// #define FAST_FORWARD
+//  Synchronous slots: all agents choose from the previous slot, then collisions are resolved (OpenMP with -fopenmp).
+// #define SYNC_SLOT
+//  With SYNC_SLOT, also run every sweep point sequentially, from the same seed, and write both pcol values to psync_*.txt.
+// #define SYNC_SLOT_COMPARE
+#define SYNC_SLOT_OMP_MIN 32 // Minimum number of agents before the synchronous slot is split across threads.
+//  Run the sweep points of marl_main in parallel worker processes (Linux). pcol keeps the sequential order.
+// #define SWEEP_SCHEDULER
+//  With SWEEP_SCHEDULER, share the sweep points with the other processes started in SHARD_DIR (sweep_shard.h), on this host or others.
+// #define SWEEP_SHARD
+//  Start the sweep of marl_main from a coarse (na, nc) grid and refine it where pcol bends or modes cross (adaptive_sweep.h).
+// #define ADAPTIVE_SWEEP
+//  With ADAPTIVE_SWEEP, also run the full grid and print how far the adaptive surface is off it, per mode.
+// #define ADAPTIVE_FIDELITY
+//  Keep the totals of every sweep point in RESULT_CACHE_DIR and run only the points not there (result_cache.h, DETERMINISTIC).
+// #define RESULT_CACHE
+//  Also append every sweep point to the columnar store RESULT_STORE_FILE (result_store.h), queried with tools/dfhq.
+// #define RESULT_STORE
+//  Write the fairness, quantiles and boxplot of the per-agent pcol to fair_<time>.txt instead of each agent to pcol (agent_stats.h).
+// #define AGENT_STATS
+//  Histogram and CDF of the collided episodes in a row of every agent (retransmissions) in retx_<time>.txt (run_length.h).
+// #define RUN_LENGTH
+//  Log the collision of every agent in every episode, one bit each, to collog_<point>.bin (collision_log.h), read with tools/col_log.
+// #define COLLISION_LOG
+//  Publish the sweep point, episode, slot rate, running pcol and memory in /dev/shm/dfh_live.<pid> (live_stats.h), shown by tools/dfh_top.
+// #define LIVE_STATS
+//  Also estimate pcol by the probability of each collision over the draw of its hop (NONE_MODEL), with batch-means errors, in rare_<time>.txt (rare_event.h).
+// #define RARE_EVENT
+//  Feed SDUs of a codec profile (traffic.h) through the piconet queues. Idle piconets do not collide.
+// #define TRAFFIC
+//  Packets of 1/3/5 slots (slotType argument) hold their channel and collide when their slot intervals overlap.
+// #define MULTI_SLOT
+//  Instance timers, AFH map refreshes, WiFi on/off and SDU arrivals are events of a timer wheel instead of per-slot checks.
+// #define TIMER_WHEEL
+//  With WIFI, take the blocked channels from the AP schedule in interference.cfg (interference.h) instead of the fixed bands.
+// #define INTERFERENCE_SCHEDULE
+//  With WIFI, also collide on the channels busy in the recorded trace TRACE_REPLAY_FILE (trace_replay.h, tools/trace_convert.c).
+// #define TRACE_REPLAY
+//  Count the decay of unused Q-values at each map refresh and apply it when a value is next used. Results are identical.
+// #define LAZY_Q_DECAY
+//  Compact Q-values: 1 = float, 2 = 16-bit fixed point (raises the pcol of DFH, see below). Double when not defined.
+// #define Q_COMPACT 1
+//  Keep the second Q-table row, used only by the experimental select_diffusive_new_action().
+// #define DIFFUSIVE_NEW_ACTION
+//  Count the cycles and calls of each phase of run_simulation() into prof_<time>.txt (profiler.h).
+// #define PROFILE
+//  With PROFILE, also read hardware counters with perf_event_open (Linux). Slows the profiled run.
+// #define PROFILE_PERF
+//  Seed rand() with DFH_SEED instead of the time, and report every hop to gpfHopHook (bench/golden.c).
+// #define DETERMINISTIC
+#ifndef DFH_SEED
+#define DFH_SEED 12345 // -DDFH_SEED=n for replicated runs
+#endif
+#ifdef DETERMINISTIC
+#define DFH_RAND_SEED() (DFH_SEED)
+#else
+#define DFH_RAND_SEED() ((unsigned int)time(NULL))
+#endif
+//  Build for libdfh (dfh.h, make lib): the state of the simulator is per thread, one simulation handle per thread.
+// #define DFH_LIB
+#ifdef DFH_LIB
+// rand() is shared by the threads. The generator of dfh.c draws the same sequence for each thread.
+#define DFH_TLS _Thread_local
+#define DFH_RAND() dfh_rand()
+#define DFH_SRAND(seed) dfh_srand(seed)
+extern int dfh_rand(void);
+extern void dfh_srand(unsigned int seed);
+#else
+#define DFH_TLS
+#define DFH_RAND() rand()
+#define DFH_SRAND(seed) srand(seed)
+#endif
+
 #define NONE_MODEL (0)
 #define RAYLEIGH_FADING_MODEL (1)
 
+// Can be given on the command line, e.g. -DPHYSICAL_MODE=NONE_MODEL.
+#ifndef PHYSICAL_MODE
 #define PHYSICAL_MODE (RAYLEIGH_FADING_MODEL)
+#endif
 
 typedef enum
 {
@@ -54,6 +142,51 @@ typedef enum
     E_ACTION_TYPE_MAX = 2
 } E_ACTION_TYPE;
 
+#ifdef DIFFUSIVE_NEW_ACTION
+#define Q_TABLE_ROWS E_ACTION_TYPE_MAX
+#else
+// Only E_ACTION_TYPE_DEFAULT is used.
+#define Q_TABLE_ROWS 1
+#endif
+
+// Q-values are read with Q_LOAD() and written with Q_STORE(). Comparisons work on the stored values.
+#if !defined(Q_COMPACT)
+typedef double q_value_t;
+#define Q_LOAD(q) (q)
+#define Q_STORE(x) (x)
+#elif Q_COMPACT == 1
+typedef float q_value_t;
+#define Q_LOAD(q) ((double)(q))
+#define Q_STORE(x) ((float)(x))
+#elif Q_COMPACT == 2
+typedef short q_value_t;
+// Q4.11. With rewards in [-1, 0] the Q-values stay within [-1 / (1 - GAMMA), 0] = [-10, 0].
+// It is not the same learner: the 0.98 decay of a map refresh does not move |Q| under 25 LSB (0.0122),
+// and an update is lost when |r + GAMMA Q' - Q| < 0.5 / (ALPHA * 2048) = 0.00244, so a channel hit once
+// never decays back to the untouched ones. Over DFH_SEED 1 .. 10 (DETERMINISTIC, 100k episodes, mean
+// pcol of the sweep points, 95 % intervals of the paired difference), DFH is raised by 0.014 +- 0.003
+// at hmax5 (0.044 -> 0.058), 0.023 at hmax2 (0.029 -> 0.053) and 0.024 at hmax3 (0.026 -> 0.050).
+// LFH, AFH, LFH_RL and AFH_RL move by at most 0.0022 (AFH_RL at hmax5, just outside its +- 0.0018);
+// with float every mode stays inside its interval. Q1.14 halves the DFH shift, but its [-2, 2] range
+// saturates the AFH maps.
+#define Q_FIXED_ONE 2048
+#define Q_LOAD(q) ((double)(q) / Q_FIXED_ONE)
+#define Q_STORE(x) q_to_fixed(x)
+static inline short q_to_fixed(double x)
+{
+    double v = x * Q_FIXED_ONE;
+
+    // Saturated, so the -RAND_MAX of a banned channel becomes the lowest value.
+    if (v <= -32768.0)
+        return -32768;
+    if (v >= 32767.0)
+        return 32767;
+    return (short)(v < 0 ? v - 0.5 : v + 0.5);
+}
+#else
+#error "Q_COMPACT is 1 (float) or 2 (16-bit fixed point)."
+#endif
+
 typedef enum
 {
     MODE_LEGACY = 0,
@@ -79,9 +212,18 @@ typedef struct
     int current_channel;
     int isCurChCollied;
     double cumulative_reward;
-    double q_table[E_ACTION_TYPE_MAX][NUM_CHANNELS + 1]; // Channel (frequency) 0 is not used.
-    // Variable to check for starvation. If a channel is not used for 10 seconds, its Q-table value is reset to 0.
+    q_value_t q_table[Q_TABLE_ROWS][NUM_CHANNELS + 1]; // Channel (frequency) 0 is not used.
+#ifdef LAZY_Q_DECAY
+    // qDecayEpoch counts the Q-value decays of the map refreshes, lastUsedTime[ch] how many of them the Q-value
+    // of ch has received. qSettledEpoch is the last decay for which all the Q-values were settled.
     int lastUsedTime[NUM_CHANNELS + 1];
+    int qDecayEpoch;
+    int qSettledEpoch;
+#endif
+#if defined(WIFI) && defined(INTERFERENCE_SCHEDULE)
+    // Channels of the APs banned by ban_wifi_channels(), which unban_wifi_channels() gives back.
+    uint64_t wifiBanMask[2];
+#endif
     // Current channel, remembered to select the next channel in the vicinity during a diffusive action.
     int last_channel;
     int isLastChCollied;
@@ -95,6 +237,11 @@ typedef struct
     // Time until settings are applied. The time when a new best action is determined and reflected.
     int instance_time;
     int default_rand;
+    // TIMER_WHEEL: set by the instance event. timerGen tells the current event from ones re-armed since.
+    bool bInstanceDue;
+    uint32_t timerGen;
+    // TIMER_WHEEL: current_time of the last channel map refresh event.
+    int map_refresh_time;
     E_STATE_TIMER eStateTimer;
     // Stores the random number generated for the current clock.
     int random_no_by_fh;
@@ -112,8 +259,14 @@ typedef struct
     double tx_power_dbm; // Transmission power (dBm)
     int interferers[NUM_AGENTS];
     int interferer_count;
-    uint64_t interferers_bitmap;
+    uint64_t interferers_bitmap[NUM_AGENTS / 64 + 1]; // Bit i: piconet i is in interferers[]
 
 } Agent;
 
+#ifdef DETERMINISTIC
+// Called with the channel of every agent at the end of each episode, when set.
+typedef void (*FP_HOP_HOOK)(int agent, int channel, int episode);
+extern DFH_TLS FP_HOP_HOOK gpfHopHook;
+#endif
+
 #endif /* MARL_H_ */
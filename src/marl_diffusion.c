@@ -9,6 +9,7 @@
 #include "marl.h"
 #include "marl_diffusion.h"
 #include "physical_model.h"
+#include "hop_cache.h"
 #define PACKET_TYPES 3
 
 #define PICONETS 40 // Number of piconets
@@ -39,7 +40,7 @@ extern int marl_main(void);
 
 typedef int (*FP_CAL_STATE)(Queue *pQ);
 // Initialize the queue for each piconet
-Queue piconet_queues[MAX_PICONNETS + 1];
+DFH_TLS Queue piconet_queues[MAX_PICONNETS + 1];
 
 const int packet_sizes[MAX_PICONNETS] = {83, 552, 1021}; // 3-DH1, 3-DH3, 3-DH5
 const int packet_durations[PACKET_TYPES] = {1, 3, 5};	 // Number of slots for 3-DH1, 3-DH3, 3-DH5
@@ -48,7 +49,7 @@ const int gPredefTime[MAX_PICONNETS] = {
 };
 // const int gPredefTime[MAX_PICONNETS] = {37, 208, 695, 443, 242, 1142, 1316, 1565, 1556, 184, };
 //  Initialize Q-table for each piconet
-double Q[MAX_PICONNETS][STATE_COUNT][PACKET_TYPES] = {
+DFH_TLS double Q[MAX_PICONNETS][STATE_COUNT][PACKET_TYPES] = {
 	{
 		{
 			0.0,
@@ -72,15 +73,15 @@ uint64_t bdAddr[56] = {
 	0x3d68594de6e5, 0x49b827634566, 0x6b9cb5d98a67, 0xd920873a6dea,
 	0xaec5fcf520ee, 0x2b4c25523770, 0x4f90b5742f2, 0x893039c73474};
 
-int gNumOfPiconets = PICONETS;
-int gSlotType = SLOT_TYPE;
-int gChannels = CHANNELS;
-int gPredefStartTime = 0;
-int gDefChUsedTime = 0;
+DFH_TLS int gNumOfPiconets = PICONETS;
+DFH_TLS int gSlotType = SLOT_TYPE;
+DFH_TLS int gChannels = CHANNELS;
+DFH_TLS int gPredefStartTime = 0;
+DFH_TLS int gDefChUsedTime = 0;
 
-bool gAvailable_channels[79];
+DFH_TLS bool gAvailable_channels[79];
 
-int select_channel(uint8_t picoId, int current_time, int duration)
+int select_channel(int picoId, int current_time, int duration)
 {
 	S_HOPPING_INFO *pHopInfo = &(piconet_queues[picoId].stHoppingInfo);
 	S_SELECTED_CH_INFO *pChInfo;
@@ -88,7 +89,11 @@ int select_channel(uint8_t picoId, int current_time, int duration)
 	pHopInfo->chInfoIndex = INC_CH_INDEX(pHopInfo->chInfoIndex);
 	pChInfo = &(pHopInfo->stChInfo[pHopInfo->chInfoIndex]);
 
+#ifdef HOP_CACHE
+	nextFreq = hop_cache_lookup(picoId, pHopInfo, current_time);
+#else
 	nextFreq = calculate_next_frequency(pHopInfo->bdAddr, ((uint32_t)current_time + pHopInfo->base_clk) << 1, pHopInfo->available_channels, pHopInfo->noOfCh);
+#endif
 
 	pChInfo->chId = nextFreq;
 	pChInfo->startClk = current_time;
@@ -98,7 +103,7 @@ int select_channel(uint8_t picoId, int current_time, int duration)
 	return nextFreq;
 }
 
-int select_channel_wo_remapping(uint8_t picoId, int current_time, int duration)
+int select_channel_wo_remapping(int picoId, int current_time, int duration)
 {
 	S_HOPPING_INFO *pHopInfo = &(piconet_queues[picoId].stHoppingInfo);
 	S_SELECTED_CH_INFO *pChInfo;
@@ -130,7 +135,7 @@ void generateRandomStartClock(int n, int *array)
 
 	for (int i = 0; i < n; i++)
 	{
-		array[i] = (rand() % 1600);
+		array[i] = (DFH_RAND() % 1600);
 	}
 }
 
@@ -149,6 +154,8 @@ void printQ(void)
 	}
 }
 
+// bench/ links the simulator with its own main().
+#ifndef DFH_NO_MAIN
 int main(int argc, char *argv[])
 {
 	// Initialize current time
@@ -199,7 +206,7 @@ int main(int argc, char *argv[])
 
 	printf("%d piconets, %d slotType, %d channels\n", gNumOfPiconets, gSlotType, gChannels);
 	// Initialize random seed
-	srand(time(NULL));
+	DFH_SRAND(DFH_RAND_SEED());
 
 	generateRandomStartClock(gNumOfPiconets, tempStartTime);
 
@@ -211,11 +218,20 @@ int main(int argc, char *argv[])
 		pQ->stHoppingInfo.bdAddr = bdAddr[piconet];
 		memset(pQ->stHoppingInfo.available_channels, 1, 79);
 		pQ->stHoppingInfo.noOfCh = 79;
-		// pQ->stHoppingInfo.base_clk = ((rand() % (1600*100))&(0xffffffff-1)) | ((pQ->startClock % 2));
-		pQ->stHoppingInfo.base_clk = ((rand() % (1600 * 100)) & (0xffffffff - 1));
+		// pQ->stHoppingInfo.base_clk = ((DFH_RAND() % (1600*100))&(0xffffffff-1)) | ((pQ->startClock % 2));
+		pQ->stHoppingInfo.base_clk = ((DFH_RAND() % (1600 * 100)) & (0xffffffff - 1));
 	}
 
 	memset(gAvailable_channels, 1, 79);
 
+#ifdef HOP_BATCH
+	if (hop_batch_selftest(100000, NULL) != 0)
+	{
+		printf("hop batch kernel does not match calculate_next_frequency. Exiting.\n");
+		exit(777);
+	}
+#endif
+
 	marl_main();
-}
\ No newline at end of file
+}
+#endif
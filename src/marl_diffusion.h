@@ -10,7 +10,9 @@
 
 #define MAX_DATA_Q 100
 #define MAX_CH_INFO 8
+#ifndef MAX_PICONNETS
 #define MAX_PICONNETS 40
+#endif
 
 typedef struct
 {
@@ -87,6 +89,6 @@ typedef struct
 
 } Queue;
 
-extern Queue piconet_queues[MAX_PICONNETS + 1];
+extern DFH_TLS Queue piconet_queues[MAX_PICONNETS + 1];
 
 #endif /* MARL_DIFFUSION_H_ */
\ No newline at end of file
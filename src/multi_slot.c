@@ -0,0 +1,132 @@
+/*
+ * Multi-slot packet collisions.
+ *
+ * A piconet sending a 3-DH1/3/5 packet of d slots holds its channel for [startClk, startClk + d + 1),
+ * the packet plus the return slot, i.e. 1, 2 or 3 episodes. The interval is written into the latest
+ * stChInfo record of the piconet, and each channel keeps the list of piconets whose last record is on
+ * it. A new packet is checked only against the packets on its channel whose interval overlaps it,
+ * so the cost per hop follows the occupancy of one channel instead of the number of piconets.
+ *
+ * Piconets whose packet has ended but which have not hopped yet stay on the list and are skipped by
+ * the overlap test; this also removes the collisions with the previous hop of agents > i that the
+ * sequential single-slot check reports.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "multi_slot.h"
+
+#ifdef MULTI_SLOT
+
+#if defined(TRAFFIC) || defined(SYNC_SLOT)
+#error "MULTI_SLOT is only implemented for the sequential loop without TRAFFIC, which has its own PDU lengths."
+#endif
+
+extern DFH_TLS int gSlotType;
+extern const int packet_durations[];
+
+// Piconets on each channel, doubly linked through gNextOnCh/gPrevOnCh (0 ends the list).
+static DFH_TLS int gChHead[NUM_CHANNELS + 1];
+static DFH_TLS int gNextOnCh[NUM_AGENTS + 1];
+static DFH_TLS int gPrevOnCh[NUM_AGENTS + 1];
+static DFH_TLS int gChOf[NUM_AGENTS + 1]; // 0: not on any list
+
+static S_SELECTED_CH_INFO *last_record(int id)
+{
+    S_HOPPING_INFO *pHopInfo = &(piconet_queues[id].stHoppingInfo);
+
+    return &(pHopInfo->stChInfo[pHopInfo->chInfoIndex]);
+}
+
+// Slots of the next packet: gSlotType 1, 2, 3 = 3-DH1, 3-DH3, 3-DH5; 4 = any of them.
+static int packet_slots(void)
+{
+    if (gSlotType >= 1 && gSlotType <= 3)
+        return packet_durations[gSlotType - 1];
+
+    return packet_durations[DFH_RAND() % 3];
+}
+
+static void unlink_piconet(int id)
+{
+    if (gChOf[id] == 0)
+        return;
+
+    if (gPrevOnCh[id] != 0)
+        gNextOnCh[gPrevOnCh[id]] = gNextOnCh[id];
+    else
+        gChHead[gChOf[id]] = gNextOnCh[id];
+    if (gNextOnCh[id] != 0)
+        gPrevOnCh[gNextOnCh[id]] = gPrevOnCh[id];
+
+    gChOf[id] = 0;
+}
+
+void multi_slot_reset(int num_agents)
+{
+    memset(gChHead, 0, sizeof(gChHead));
+    memset(gChOf, 0, sizeof(gChOf));
+
+    for (int i = 1; i <= num_agents; i++)
+    {
+        S_SELECTED_CH_INFO *pChInfo = last_record(i);
+
+        pChInfo->startClk = 0;
+        pChInfo->endClk = 0;
+        pChInfo->duration = 0;
+    }
+}
+
+// True while the packet of the last hop still occupies the episode starting at current_time.
+bool multi_slot_busy(int id, int current_time)
+{
+    return gChOf[id] != 0 && last_record(id)->endClk > (uint32_t)current_time;
+}
+
+// Records the packet sent on channel (1-based) from current_time and moves the piconet to its list.
+void multi_slot_place(int id, int channel, int current_time)
+{
+    S_SELECTED_CH_INFO *pChInfo = last_record(id);
+    int slots = packet_slots();
+
+    // The hop functions may have looked up more than one channel. Keep the one actually used.
+    pChInfo->chId = channel - 1;
+    pChInfo->startClk = current_time;
+    pChInfo->endClk = current_time + slots + 1;
+    pChInfo->duration = slots + 1;
+
+    unlink_piconet(id);
+    gChOf[id] = channel;
+    gPrevOnCh[id] = 0;
+    gNextOnCh[id] = gChHead[channel];
+    if (gChHead[channel] != 0)
+        gPrevOnCh[gChHead[channel]] = id;
+    gChHead[channel] = id;
+}
+
+// Next piconet after prev (0: first) on the channel of id whose packet overlaps the packet of id. 0 at the end.
+int multi_slot_next_overlap(int id, int prev)
+{
+    S_SELECTED_CH_INFO *pMine = last_record(id);
+    S_SELECTED_CH_INFO *pOther;
+    int other = (prev == 0) ? gChHead[gChOf[id]] : gNextOnCh[prev];
+
+    for (; other != 0; other = gNextOnCh[other])
+    {
+        if (other == id)
+            continue;
+
+        pOther = last_record(other);
+        if (pOther->startClk < pMine->endClk && pMine->startClk < pOther->endClk)
+            return other;
+    }
+
+    return 0;
+}
+
+#endif /* MULTI_SLOT */
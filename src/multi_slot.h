@@ -0,0 +1,16 @@
+/*
+ * multi_slot.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef MULTI_SLOT_H_
+#define MULTI_SLOT_H_
+
+extern void multi_slot_reset(int num_agents);
+extern bool multi_slot_busy(int id, int current_time);
+extern void multi_slot_place(int id, int channel, int current_time);
+extern int multi_slot_next_overlap(int id, int prev);
+
+#endif /* MULTI_SLOT_H_ */
@@ -29,7 +29,7 @@ double calculate_path_loss_db(double distance_m)
 // Function to generate power variation due to Rayleigh fading in dB
 double generate_rayleigh_fading_db()
 {
-    double u = ((double)rand() + 1.0) / ((double)RAND_MAX + 2.0);
+    double u = ((double)DFH_RAND() + 1.0) / ((double)RAND_MAX + 2.0);
     double fading_power_linear = -log(u);
     return 10.0 * log10(fading_power_linear);
 }
@@ -78,8 +78,8 @@ void generate_valid_position(
 
     if (current_agent_index == 1)
     {
-        temp_pos_x = ((double)rand() / RAND_MAX) * max_x;
-        temp_pos_y = ((double)rand() / RAND_MAX) * max_y;
+        temp_pos_x = ((double)DFH_RAND() / RAND_MAX) * max_x;
+        temp_pos_y = ((double)DFH_RAND() / RAND_MAX) * max_y;
         *new_pos_x = temp_pos_x;
         *new_pos_y = temp_pos_y;
     }
@@ -88,8 +88,8 @@ void generate_valid_position(
         position_ok = true;
 
         // 1. Generate a new temporary position
-        temp_pos_x = ((double)rand() / RAND_MAX) * max_x;
-        temp_pos_y = ((double)rand() / RAND_MAX) * max_y;
+        temp_pos_x = ((double)DFH_RAND() / RAND_MAX) * max_x;
+        temp_pos_y = ((double)DFH_RAND() / RAND_MAX) * max_y;
 
         // 2. Check the distance against all previously placed agents (from index 1 to current_agent_index-1)
         for (int j = 1; j < current_agent_index; j++)
@@ -0,0 +1,223 @@
+/*
+ * Per-phase profiler of run_simulation().
+ *
+ * PROF_BEGIN/PROF_END around the hot calls keep a small stack of active phases. Every boundary reads
+ * the time stamp counter (clock_gettime where there is none) once and charges the time since the
+ * previous boundary to the phase on top of the stack, so each phase gets its self time, its total time
+ * with the nested phases, and a call count. With PROFILE_PERF, a group of hardware counters opened with
+ * perf_event_open is read at the same boundaries; that is a system call per boundary and slows the
+ * short phases noticeably, so the cycle counts are best taken without it.
+ *
+ * prof_run_end() writes the phases of each sweep point and prof_close() the totals, to the prof_ file
+ * created next to the pcol file. Without PROFILE, the macros are empty and nothing here is compiled.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "profiler.h"
+
+#ifdef PROFILE
+
+#ifdef SWEEP_SCHEDULER
+#error "PROFILE counts in this process only. Disable SWEEP_SCHEDULER, whose runs are in worker processes."
+#endif
+
+#ifdef PROFILE_PERF
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+S_PROF_COUNTERS gProf;
+S_PROF_FRAME gProfStack[PROF_MAX_DEPTH];
+int gProfDepth = 1; // gProfStack[0] is PROF_RUN.
+uint64_t gProfMark;
+
+static FILE *gpProfFile;
+static S_PROF_COUNTERS gProfRunStart;
+static struct timespec gProfOpenTime;
+static uint64_t gProfOpenTicks;
+static int gNumOfProfRuns;
+
+static const char *gProfPhaseNames[PROF_PHASE_MAX] = {"run", "hop", "map_refresh", "q_update", "collision", "sinr", "events", "stats"};
+
+#ifdef PROFILE_PERF
+static int gPerfFd[PROF_NUM_PERF] = {-1, -1, -1};
+static uint64_t gPerfLast[PROF_NUM_PERF];
+
+static void perf_open(void)
+{
+    static const uint64_t config[PROF_NUM_PERF] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    struct perf_event_attr attr;
+
+    for (int k = 0; k < PROF_NUM_PERF; k++)
+    {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config[k];
+        attr.disabled = (k == 0);
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+        gPerfFd[k] = syscall(SYS_perf_event_open, &attr, 0, -1, (k == 0) ? -1 : gPerfFd[0], 0);
+        if (gPerfFd[k] < 0)
+        {
+            // Not fatal: containers and perf_event_paranoid often forbid it.
+            printf("profiler: perf_event_open failed, no hardware counters.\n");
+            for (int j = 0; j < k; j++)
+                close(gPerfFd[j]);
+            gPerfFd[0] = -1;
+            return;
+        }
+    }
+    ioctl(gPerfFd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void prof_perf_charge(int phase)
+{
+    uint64_t values[1 + PROF_NUM_PERF];
+
+    if (gPerfFd[0] < 0 || read(gPerfFd[0], values, sizeof(values)) != sizeof(values))
+        return;
+
+    // values[0] is the number of counters of the group.
+    for (int k = 0; k < PROF_NUM_PERF; k++)
+    {
+        gProf.perf[phase][k] += values[1 + k] - gPerfLast[k];
+        gPerfLast[k] = values[1 + k];
+    }
+}
+#endif
+
+static double elapsed_ns(const struct timespec *pFrom)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - pFrom->tv_sec) * 1e9 + (now.tv_nsec - pFrom->tv_nsec);
+}
+
+static void print_phases(const S_PROF_COUNTERS *pCur, const S_PROF_COUNTERS *pFrom)
+{
+    uint64_t self, total, calls;
+    uint64_t all = 0;
+
+    for (int p = 0; p < PROF_PHASE_MAX; p++)
+        all += pCur->self[p] - pFrom->self[p];
+
+    for (int p = 0; p < PROF_PHASE_MAX; p++)
+    {
+        calls = pCur->calls[p] - pFrom->calls[p];
+        total = pCur->total[p] - pFrom->total[p];
+        self = pCur->self[p] - pFrom->self[p];
+        if (calls == 0)
+            continue;
+
+        fprintf(gpProfFile, "%-12s %12llu %16llu %16llu %6.2f%% %10.1f", gProfPhaseNames[p], (unsigned long long)calls, (unsigned long long)total, (unsigned long long)self,
+                all ? self * 100.0 / all : 0.0, (double)total / calls);
+#ifdef PROFILE_PERF
+        for (int k = 0; k < PROF_NUM_PERF; k++)
+            fprintf(gpProfFile, " %14llu", (unsigned long long)(pCur->perf[p][k] - pFrom->perf[p][k]));
+#endif
+        fprintf(gpProfFile, "\n");
+    }
+}
+
+static void print_columns(void)
+{
+    fprintf(gpProfFile, "# phase calls total self self%% total/call");
+#ifdef PROFILE_PERF
+    fprintf(gpProfFile, " instructions cache_misses branch_misses");
+#endif
+    fprintf(gpProfFile, "\n");
+}
+
+void prof_open(const char *pFileName)
+{
+    gpProfFile = fopen(pFileName, "w");
+    if (gpProfFile == NULL)
+    {
+        printf("Can't create %s. Exiting.\n", pFileName);
+        exit(777);
+    }
+    fprintf(gpProfFile, "# run_simulation() phases in %s; self excludes the nested phases (map_refresh runs inside hop and q_update).\n", PROF_UNIT);
+
+    clock_gettime(CLOCK_MONOTONIC, &gProfOpenTime);
+    gProfOpenTicks = prof_now();
+    gProfStack[0].phase = PROF_RUN;
+#ifdef PROFILE_PERF
+    perf_open();
+#endif
+}
+
+void prof_run_begin(void)
+{
+    gProfRunStart = gProf;
+    gProfDepth = 1;
+    gProfStack[0].start = prof_now();
+    gProfMark = gProfStack[0].start;
+#ifdef PROFILE_PERF
+    // Counts since the last run are not charged to anything.
+    prof_perf_charge(PROF_RUN);
+    memcpy(gProf.perf, gProfRunStart.perf, sizeof(gProf.perf));
+#endif
+}
+
+void prof_run_end(int mode, int nc, int na)
+{
+    uint64_t now = prof_now();
+
+    gProf.self[PROF_RUN] += now - gProfMark;
+    gProf.total[PROF_RUN] += now - gProfStack[0].start;
+    gProf.calls[PROF_RUN]++;
+#ifdef PROFILE_PERF
+    prof_perf_charge(PROF_RUN);
+#endif
+
+    if (gpProfFile == NULL)
+        return;
+
+    fprintf(gpProfFile, "\n# M%d %d %d\n", mode, nc, na);
+    print_columns();
+    print_phases(&gProf, &gProfRunStart);
+    fflush(gpProfFile);
+    gNumOfProfRuns++;
+}
+
+void prof_close(void)
+{
+    static const S_PROF_COUNTERS stZero;
+    double ns;
+
+    if (gpProfFile == NULL)
+        return;
+
+    ns = elapsed_ns(&gProfOpenTime);
+    fprintf(gpProfFile, "\n# total of %d runs, %.3f s", gNumOfProfRuns, ns / 1e9);
+#if defined(__x86_64__) || defined(__i386__)
+    // The TSC rate converts the cycle counts to time.
+    fprintf(gpProfFile, ", %.3f GHz TSC", (prof_now() - gProfOpenTicks) / ns);
+#endif
+    fprintf(gpProfFile, "\n");
+    print_columns();
+    print_phases(&gProf, &stZero);
+    fclose(gpProfFile);
+    gpProfFile = NULL;
+
+#ifdef PROFILE_PERF
+    if (gPerfFd[0] >= 0)
+    {
+        for (int k = 0; k < PROF_NUM_PERF; k++)
+            close(gPerfFd[k]);
+        gPerfFd[0] = -1;
+    }
+#endif
+}
+
+#endif /* PROFILE */
@@ -0,0 +1,116 @@
+/*
+ * profiler.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+typedef enum
+{
+    PROF_RUN = 0,     // run_simulation(), time not spent in the phases below
+    PROF_HOP,         // select_next_channel()
+    PROF_MAP_REFRESH, // setChMapBasedOnQtable(), nested in the hop or a timer event
+    PROF_Q_UPDATE,    // update_q_table()
+    PROF_COLLISION,   // calculate_reward(), the collision pass of SYNC_SLOT
+    PROF_SINR,        // determine_packet_outcome()
+    PROF_EVENTS,      // Timer wheel, interference schedule and trace replay
+    PROF_STATS,       // Collision tally of the episode
+    PROF_PHASE_MAX
+} E_PROF_PHASE;
+
+#ifdef PROFILE
+
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define PROF_UNIT "cycles"
+#else
+#define PROF_UNIT "ns"
+#endif
+
+#define PROF_MAX_DEPTH 8
+// Hardware counters of PROFILE_PERF: instructions, cache misses, branch misses.
+#define PROF_NUM_PERF 3
+
+typedef struct
+{
+    uint64_t calls[PROF_PHASE_MAX];
+    uint64_t total[PROF_PHASE_MAX]; // Including the nested phases
+    uint64_t self[PROF_PHASE_MAX];
+    uint64_t perf[PROF_PHASE_MAX][PROF_NUM_PERF]; // Self counts
+} S_PROF_COUNTERS;
+
+typedef struct
+{
+    int phase;
+    uint64_t start;
+} S_PROF_FRAME;
+
+extern S_PROF_COUNTERS gProf;
+extern S_PROF_FRAME gProfStack[PROF_MAX_DEPTH];
+extern int gProfDepth;
+extern uint64_t gProfMark;
+
+extern void prof_open(const char *pFileName);
+extern void prof_close(void);
+extern void prof_run_begin(void);
+extern void prof_run_end(int mode, int nc, int na);
+#ifdef PROFILE_PERF
+extern void prof_perf_charge(int phase);
+#endif
+
+static inline uint64_t prof_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+// The time since the last mark goes to the phase on top of the stack.
+static inline void prof_begin(int phase)
+{
+    uint64_t now = prof_now();
+
+    gProf.self[gProfStack[gProfDepth - 1].phase] += now - gProfMark;
+#ifdef PROFILE_PERF
+    prof_perf_charge(gProfStack[gProfDepth - 1].phase);
+#endif
+    gProfStack[gProfDepth].phase = phase;
+    gProfStack[gProfDepth].start = now;
+    gProfDepth++;
+    gProfMark = now;
+}
+
+static inline void prof_end(int phase)
+{
+    uint64_t now = prof_now();
+
+    gProfDepth--;
+    gProf.self[phase] += now - gProfMark;
+    gProf.total[phase] += now - gProfStack[gProfDepth].start;
+    gProf.calls[phase]++;
+#ifdef PROFILE_PERF
+    prof_perf_charge(phase);
+#endif
+    gProfMark = now;
+}
+
+#define PROF_BEGIN(phase) prof_begin(phase)
+#define PROF_END(phase) prof_end(phase)
+
+#else
+
+#define PROF_BEGIN(phase)
+#define PROF_END(phase)
+
+#endif /* PROFILE */
+
+#endif /* PROFILER_H_ */
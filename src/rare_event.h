@@ -0,0 +1,33 @@
+/*
+ * rare_event.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef RARE_EVENT_H_
+#define RARE_EVENT_H_
+
+// Episodes per batch of the batch-means standard errors of rare_<time>.txt.
+#define RARE_EVENT_BATCH 1000
+// Channels a hop can take: 2 * HMAX diffusions and the best channel, or the channel map of LFH.
+#define RARE_HOP_MAX 79
+// Smallest channel map whose LFH hops are weighed as uniform over it. Below, the hop sequence is too far
+// from uniform and the estimate came out low.
+#define RARE_MAP_MIN_CHANNELS 40
+
+#ifdef RARE_EVENT
+// Called by the selection functions at their random draw: the hop is explore_channel with the probability
+// of exploration (EPSILON_DIFF) and exploit_channel otherwise, or the diffusion of +-1 .. HMAX channels
+// around center_channel instead of explore_channel. LFH draws no channel: its hop is taken to be each
+// channel of the map with probability 1 / noOfCh, from RARE_MAP_MIN_CHANNELS channels up.
+extern void rare_hop_mix(int explore_channel, int exploit_channel);
+extern void rare_hop_diffuse(int center_channel, int exploit_channel);
+extern void rare_hop_map(const bool *pChMap, int noOfCh);
+extern void rare_event_hop(Agent agents[], int num_agents, int agent_id, int next_channel);
+extern void rare_event_reset(void);
+extern void rare_event_episode(int num_agents);
+extern void rare_event_write(FILE *fp, const char *pKey, int num_agents);
+#endif
+
+#endif /* RARE_EVENT_H_ */
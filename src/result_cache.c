@@ -0,0 +1,252 @@
+/*
+ * Content-addressed cache of the sweep points of marl_main.
+ *
+ * A sweep point is named by a key: the text of everything its result depends on (mode, HMAX, na, nc,
+ * gNumOfAvailCh, num_diff, the coexisting mode, the seed, the episodes, the options and learning constants
+ * of marl.h, the constants of physical_model.h and RESULT_CACHE_KERNEL, the version of the simulation code)
+ * and a hash of the interference schedule or trace the run reads. The totals of the point are kept in
+ * RESULT_CACHE_DIR under the FNV-1a hash of the key. The key names no build, so a sweep run again, or
+ * rebuilt with other ranges of na, nc or modes in marl_main, only runs the points that are not there yet.
+ *
+ * For a cached result to be that of the sweep, a point must not depend on the points run before it. Each
+ * run restarts from the agents as marl_main set them up, and rand() is seeded from the key without the
+ * input files. The seed of the set-up itself must be fixed (DETERMINISTIC). With SWEEP_SCHEDULER, the jobs
+ * are looked up and seeded here too (sweep_run_job), so a point has the same result whichever way it ran.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "physical_model.h"
+#include "interference.h"
+#include "trace_replay.h"
+#include "result_cache.h"
+
+#ifdef RESULT_CACHE
+
+#ifndef DETERMINISTIC
+#error "RESULT_CACHE needs the positions and clocks of a fixed seed. Enable DETERMINISTIC."
+#endif
+#if defined(HEATMAP) || defined(TRAFFIC) || defined(SYNC_SLOT_COMPARE)
+#error "RESULT_CACHE only keeps the collision totals of a point. Disable HEATMAP, TRAFFIC and SYNC_SLOT_COMPARE."
+#endif
+
+#define RESULT_CACHE_KEY 1024
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+extern DFH_TLS int HMAX;
+extern DFH_TLS int gNum_channels;
+extern DFH_TLS int gNumOfAvailCh;
+extern DFH_TLS int gModeDefault;
+extern DFH_TLS int num_diff;
+#ifdef DIFFUSIVE
+extern DFH_TLS int gTargetCoexit;
+#endif
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+extern DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+extern DFH_TLS Agent gstAgents[NUM_AGENTS + 1];
+
+// Options of marl.h that change results. The fast paths don't.
+static const char gCacheFlags[] = ""
+#ifdef DIFFUSIVE
+    " DIFFUSIVE"
+#endif
+#ifdef ADAPTIVE
+    " ADAPTIVE"
+#endif
+#ifdef WIFI
+    " WIFI"
+#endif
+#ifdef SHUFFLE
+    " SHUFFLE"
+#endif
+#ifdef CH_MAP_SIZE
+    " CH_MAP_SIZE"
+#endif
+#ifdef SYNC_SLOT
+    " SYNC_SLOT"
+#endif
+#ifdef MULTI_SLOT
+    " MULTI_SLOT"
+#endif
+#ifdef INTERFERENCE_SCHEDULE
+    " INTERFERENCE_SCHEDULE"
+#endif
+#ifdef TRACE_REPLAY
+    " TRACE_REPLAY"
+#endif
+#ifdef DIFFUSIVE_NEW_ACTION
+    " DIFFUSIVE_NEW_ACTION"
+#endif
+#if defined(Q_COMPACT) && Q_COMPACT == 1
+    " Q_COMPACT=1"
+#elif defined(Q_COMPACT) && Q_COMPACT == 2
+    " Q_COMPACT=2"
+#endif
+    "";
+
+static Agent *gpCacheSnapshot;
+static uint64_t gCacheInputs; // Hash of the files the run reads
+static char gCacheKey[RESULT_CACHE_KEY]; // Key of the point last looked up
+static char gCachePath[256];
+static int gNumOfCacheHits;
+static int gNumOfCacheRuns;
+
+static uint64_t fnv1a(uint64_t hash, const void *pData, size_t size)
+{
+    const unsigned char *p = pData;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+#if defined(WIFI) && (defined(INTERFERENCE_SCHEDULE) || defined(TRACE_REPLAY))
+// Adds the bytes of a file to the hash. A missing file adds nothing.
+static uint64_t hash_file(uint64_t hash, const char *pPath)
+{
+    unsigned char buf[65536];
+    size_t size;
+    FILE *fp = fopen(pPath, "rb");
+
+    if (fp == NULL)
+        return hash;
+    while ((size = fread(buf, 1, sizeof(buf), fp)) > 0)
+        hash = fnv1a(hash, buf, size);
+    fclose(fp);
+    return hash;
+}
+#endif
+
+// Writes the key of the current sweep point (globals of marl_main) to gCacheKey, without the input files.
+static void make_key(int na, int nc)
+{
+#ifdef DIFFUSIVE
+    int coexist = gTargetCoexit;
+#else
+    int coexist = 0;
+#endif
+
+    snprintf(gCacheKey, sizeof(gCacheKey),
+             "v%d kernel %s mode %d hmax %d na %d nc %d avail %d diff %d coexist %d seed %u agents %d episodes %d perturbation %d"
+             " flags%s learn %g %g %g %g %d %d %d phys %d %g %g %g %g %g %g %g %g %g",
+             RESULT_CACHE_VERSION, RESULT_CACHE_KERNEL, gModeDefault, HMAX, na, nc, gNumOfAvailCh, num_diff, coexist, DFH_SEED,
+             NUM_AGENTS, MAX_EPISODES, PERTURBATION, gCacheFlags, ALPHA, GAMMA, EPSILON, EPSILON_DIFF, DFH_TIMEOUT,
+             DEFAULT_DFH_INSTANSTIME, DEFAULT_DFH_UPDATE_TIMEOUT, PHYSICAL_MODE, SUBWAY_LENGTH, SUBWAY_WIDTH, MIN_DISTANCE,
+             PATH_LOSS_EXPONENT, REFERENCE_PATH_LOSS, THERMAL_NOISE_DBM, SINR_THRESHOLD_DB, MY_DEVICE_DISTANCE,
+             BODY_ATTENUATION_DB);
+}
+
+// To be called once marl_main has set the agents up, before the first sweep point.
+void result_cache_begin(void)
+{
+    gpCacheSnapshot = malloc(sizeof(gstAgents));
+    if (gpCacheSnapshot == NULL)
+    {
+        printf("cache: out of memory. Exiting.\n");
+        exit(777);
+    }
+    memcpy(gpCacheSnapshot, gstAgents, sizeof(gstAgents));
+
+    gCacheInputs = FNV_OFFSET;
+#if defined(WIFI) && defined(INTERFERENCE_SCHEDULE)
+    gCacheInputs = hash_file(gCacheInputs, INTERFERENCE_CONFIG);
+#endif
+#if defined(WIFI) && defined(TRACE_REPLAY)
+    gCacheInputs = hash_file(gCacheInputs, TRACE_REPLAY_FILE);
+#endif
+
+    if (mkdir(RESULT_CACHE_DIR, 0777) != 0 && errno != EEXIST)
+    {
+        printf("cache: can't create %s. Exiting.\n", RESULT_CACHE_DIR);
+        exit(777);
+    }
+    gNumOfCacheHits = 0;
+    gNumOfCacheRuns = 0;
+}
+
+// Loads the totals of the current sweep point as run_simulation() would leave them and returns true, or
+// returns false with the agents and rand() ready for the run of the point.
+bool result_cache_load(int na, int nc)
+{
+    char line[RESULT_CACHE_KEY];
+    uint64_t hash;
+    bool bHit = false;
+    FILE *fp;
+
+    make_key(na, nc);
+    hash = fnv1a(gCacheInputs, gCacheKey, strlen(gCacheKey));
+    snprintf(gCachePath, sizeof(gCachePath), "%s/%016llx", RESULT_CACHE_DIR, (unsigned long long)hash);
+
+    fp = fopen(gCachePath, "r");
+    if (fp != NULL)
+    {
+        // The key is kept in the file, in case two keys share a hash.
+        if (fgets(line, sizeof(line), fp) != NULL && strncmp(line, gCacheKey, strlen(gCacheKey)) == 0 && line[strlen(gCacheKey)] == '\n')
+        {
+            memset(total_collisions, 0, sizeof(total_collisions));
+            memset(total_wifi_collisions, 0, sizeof(total_wifi_collisions));
+            bHit = true;
+            for (int i = 1; i <= na && bHit; i++)
+                bHit = (fscanf(fp, "%d %d", &total_collisions[i], &total_wifi_collisions[i]) == 2);
+        }
+        fclose(fp);
+    }
+    if (bHit)
+    {
+        gNumOfCacheHits++;
+        return true;
+    }
+
+    gNumOfCacheRuns++;
+    memcpy(gstAgents, gpCacheSnapshot, sizeof(gstAgents));
+    hash = fnv1a(FNV_OFFSET, gCacheKey, strlen(gCacheKey));
+    DFH_SRAND((unsigned int)(hash ^ (hash >> 32)));
+    return false;
+}
+
+// Stores the totals of the point last looked up by result_cache_load(), once run_simulation() returned.
+void result_cache_store(int na)
+{
+    char tmpPath[sizeof(gCachePath) + 32];
+    FILE *fp;
+
+    // Written aside and renamed, so sweeps sharing the directory never read half a file.
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d", gCachePath, (int)getpid());
+    fp = fopen(tmpPath, "w");
+    if (fp == NULL)
+    {
+        printf("cache: can't write %s. Exiting.\n", tmpPath);
+        exit(777);
+    }
+    fprintf(fp, "%s\n", gCacheKey);
+    for (int i = 1; i <= na; i++)
+        fprintf(fp, "%d %d\n", total_collisions[i], total_wifi_collisions[i]);
+    fclose(fp);
+    if (rename(tmpPath, gCachePath) != 0)
+    {
+        printf("cache: can't rename %s. Exiting.\n", tmpPath);
+        exit(777);
+    }
+}
+
+void result_cache_end(void)
+{
+    printf("\ncache: %d sweep points from %s, %d run\n", gNumOfCacheHits, RESULT_CACHE_DIR, gNumOfCacheRuns);
+    free(gpCacheSnapshot);
+    gpCacheSnapshot = NULL;
+}
+
+#endif /* RESULT_CACHE */
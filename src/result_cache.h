@@ -0,0 +1,27 @@
+/*
+ * result_cache.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef RESULT_CACHE_H_
+#define RESULT_CACHE_H_
+
+#include <stdbool.h>
+
+// Directory of the cached sweep points, relative to the working directory. One file per key.
+#define RESULT_CACHE_DIR ".dfh_cache"
+#define RESULT_CACHE_VERSION 3 // Of the key and the file format.
+// Version of the simulation the cached points were run with. The Makefile sets it to the checksum of src/, so any
+// change of the sources starts a new set of points. Built otherwise, every build starts its own.
+#ifndef RESULT_CACHE_KERNEL
+#define RESULT_CACHE_KERNEL __DATE__ " " __TIME__
+#endif
+
+extern void result_cache_begin(void);
+extern bool result_cache_load(int na, int nc);
+extern void result_cache_store(int na);
+extern void result_cache_end(void);
+
+#endif /* RESULT_CACHE_H_ */
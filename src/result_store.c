@@ -0,0 +1,216 @@
+/*
+ * Append-only columnar store of the sweep results (result_store.h).
+ *
+ * marl_main adds a row for every sweep point it reports, the fields of its pcol line in columns and the
+ * pcol of each agent as a fixed-width array, and appends the rows of a piconet count as one block. Blocks are
+ * only ever appended: a block cut short by a crash is dropped when the file is opened next, so the file
+ * always ends on a whole block. tools/dfhq maps the file and reads the columns in place.
+ *
+ * Any number of sweeps may append to the same file. The file is opened with O_APPEND, and the header, the
+ * dropping of a partial block and every block append are done under an exclusive flock(), so a block is
+ * never cut by another writer and only a block no live writer is appending can be dropped.
+ *
+ * The writer uses nothing of the simulator, so tools/dfhq links it to import pcol files.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "result_store.h"
+
+#ifdef RESULT_STORE
+
+static int gStoreFd = -1;
+static uint32_t gStoreWidth;
+static S_STORE_ROW *gpStoreRows;
+static float *gpStoreAgents;
+static uint8_t *gpStoreBlock;
+static uint32_t gNumOfStoreRows;
+static char gStorePath[256];
+static uint64_t gStoreEnd; // End of the last whole block seen under the lock
+
+static void lock_store(int op)
+{
+    while (flock(gStoreFd, op) != 0)
+    {
+        if (errno != EINTR)
+        {
+            printf("store: can't lock the store. Exiting.\n");
+            exit(777);
+        }
+    }
+}
+
+// Writes all of size bytes at the end of the file.
+static int append_store(const void *pData, size_t size)
+{
+    const uint8_t *p = pData;
+    ssize_t n;
+
+    while (size > 0)
+    {
+        n = write(gStoreFd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static void check_header(void)
+{
+    S_STORE_HEADER stHeader;
+
+    if (pread(gStoreFd, &stHeader, sizeof(stHeader), 0) != sizeof(stHeader) || stHeader.magic != STORE_MAGIC || stHeader.version != STORE_VERSION)
+    {
+        printf("store: %s is not a result store of version %d. Exiting.\n", gStorePath, STORE_VERSION);
+        exit(777);
+    }
+    if (stHeader.width != gStoreWidth)
+    {
+        printf("store: %s holds %u agents per row, not %u. Exiting.\n", gStorePath, stHeader.width, gStoreWidth);
+        exit(777);
+    }
+}
+
+// With the lock held: moves gStoreEnd over the whole blocks other writers appended since, and drops what
+// follows them. Every writer appends under the lock, so that can only be a block whose writer died.
+static void settle_store(void)
+{
+    S_STORE_BLOCK stBlock;
+    struct stat st;
+
+    if (fstat(gStoreFd, &st) != 0)
+    {
+        printf("store: can't read %s. Exiting.\n", gStorePath);
+        exit(777);
+    }
+    while (pread(gStoreFd, &stBlock, sizeof(stBlock), gStoreEnd) == sizeof(stBlock) && stBlock.magic == STORE_BLOCK_MAGIC &&
+           stBlock.size == store_column_offset(STORE_COL_MAX, stBlock.numOfRows, gStoreWidth) && gStoreEnd + stBlock.size <= (uint64_t)st.st_size)
+        gStoreEnd += stBlock.size;
+
+    if (gStoreEnd != (uint64_t)st.st_size && ftruncate(gStoreFd, gStoreEnd) != 0)
+    {
+        printf("store: can't drop the partial block of %s. Exiting.\n", gStorePath);
+        exit(777);
+    }
+}
+
+void result_store_open(const char *pPath, int width)
+{
+    S_STORE_HEADER stHeader = {STORE_MAGIC, STORE_VERSION, width, 0};
+    struct stat st;
+
+    gStoreWidth = width;
+    snprintf(gStorePath, sizeof(gStorePath), "%s", pPath);
+    gStoreFd = open(pPath, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (gStoreFd < 0)
+    {
+        printf("store: can't create %s. Exiting.\n", pPath);
+        exit(777);
+    }
+
+    lock_store(LOCK_EX);
+    if (fstat(gStoreFd, &st) != 0)
+    {
+        printf("store: can't read %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    if (st.st_size == 0 && append_store(&stHeader, sizeof(stHeader)) != 0)
+    {
+        printf("store: can't create %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    check_header();
+    gStoreEnd = sizeof(stHeader);
+    settle_store();
+    lock_store(LOCK_UN);
+
+    gpStoreRows = malloc(STORE_BLOCK_ROWS * sizeof(S_STORE_ROW));
+    gpStoreAgents = malloc((size_t)STORE_BLOCK_ROWS * width * sizeof(float));
+    gpStoreBlock = malloc(store_column_offset(STORE_COL_MAX, STORE_BLOCK_ROWS, width));
+    if (gpStoreRows == NULL || gpStoreAgents == NULL || gpStoreBlock == NULL)
+    {
+        printf("store: out of memory. Exiting.\n");
+        exit(777);
+    }
+    gNumOfStoreRows = 0;
+}
+
+void result_store_add(const S_STORE_ROW *pRow, const float *pAgents)
+{
+    gpStoreRows[gNumOfStoreRows] = *pRow;
+    memcpy(&gpStoreAgents[(size_t)gNumOfStoreRows * gStoreWidth], pAgents, gStoreWidth * sizeof(float));
+    if (++gNumOfStoreRows == STORE_BLOCK_ROWS)
+        result_store_flush();
+}
+
+// Appends the rows added so far as one block.
+void result_store_flush(void)
+{
+    uint64_t rows = gNumOfStoreRows, size = store_column_offset(STORE_COL_MAX, rows, gStoreWidth);
+    S_STORE_BLOCK *pBlock = (S_STORE_BLOCK *)gpStoreBlock;
+    int64_t *pRun;
+    int32_t *pVal;
+    double *pPcol, *pWifi;
+
+    if (rows == 0)
+        return;
+    memset(gpStoreBlock, 0, size);
+    pBlock->magic = STORE_BLOCK_MAGIC;
+    pBlock->numOfRows = rows;
+    pBlock->size = size;
+
+    pRun = (int64_t *)(gpStoreBlock + store_column_offset(STORE_COL_RUN, rows, gStoreWidth));
+    pPcol = (double *)(gpStoreBlock + store_column_offset(STORE_COL_PCOL, rows, gStoreWidth));
+    pWifi = (double *)(gpStoreBlock + store_column_offset(STORE_COL_WIFI, rows, gStoreWidth));
+    for (uint64_t r = 0; r < rows; r++)
+    {
+        pRun[r] = gpStoreRows[r].run;
+        pPcol[r] = gpStoreRows[r].pcol;
+        pWifi[r] = gpStoreRows[r].wifi;
+    }
+    for (int c = STORE_COL_MODE; c <= STORE_COL_COEXIST; c++)
+    {
+        pVal = (int32_t *)(gpStoreBlock + store_column_offset(c, rows, gStoreWidth));
+        for (uint64_t r = 0; r < rows; r++)
+            pVal[r] = gpStoreRows[r].val[c - STORE_COL_MODE];
+    }
+    memcpy(gpStoreBlock + store_column_offset(STORE_COL_AGENTS, rows, gStoreWidth), gpStoreAgents, rows * gStoreWidth * sizeof(float));
+
+    lock_store(LOCK_EX);
+    settle_store();
+    if (append_store(gpStoreBlock, size) != 0)
+    {
+        if (ftruncate(gStoreFd, gStoreEnd) != 0)
+            printf("store: can't drop the partial block of %s.\n", gStorePath);
+        printf("store: can't append %llu rows. Exiting.\n", (unsigned long long)rows);
+        exit(777);
+    }
+    gStoreEnd += size;
+    lock_store(LOCK_UN);
+    gNumOfStoreRows = 0;
+}
+
+void result_store_close(void)
+{
+    if (gStoreFd < 0)
+        return;
+    result_store_flush();
+    close(gStoreFd);
+    gStoreFd = -1;
+    free(gpStoreRows);
+    free(gpStoreAgents);
+    free(gpStoreBlock);
+}
+
+#endif /* RESULT_STORE */
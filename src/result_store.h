@@ -0,0 +1,91 @@
+/*
+ * result_store.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef RESULT_STORE_H_
+#define RESULT_STORE_H_
+
+// Columnar store of the sweep results (RESULT_STORE), queried with tools/dfhq. The file is a header and
+// blocks appended one after the other. A block holds the rows of up to STORE_BLOCK_ROWS sweep points
+// column by column, in the order of E_STORE_COLUMN, each column padded to 8 bytes.
+#define RESULT_STORE_FILE "results.dfhc"
+#define STORE_MAGIC 0x43484644       // "DFHC"
+#define STORE_BLOCK_MAGIC 0x42484644 // "DFHB"
+#define STORE_VERSION 1
+#define STORE_BLOCK_ROWS 4096
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width; // Per-agent values of a row, the NUM_AGENTS of the build that created the file
+    uint32_t reserved;
+} S_STORE_HEADER;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t numOfRows;
+    uint64_t size; // Bytes of the block, this header included
+} S_STORE_BLOCK;
+
+typedef enum
+{
+    STORE_COL_RUN = 0, // int64: start time of the sweep, as in the name of its pcol file
+    STORE_COL_MODE,    // int32 columns: the fields of a pcol line and the coexistence of DIFFUSIVE
+    STORE_COL_NC,
+    STORE_COL_NA,
+    STORE_COL_AVAIL,
+    STORE_COL_HMAX,
+    STORE_COL_DIFF,
+    STORE_COL_COEXIST,
+    STORE_COL_PCOL,   // double
+    STORE_COL_WIFI,   // double
+    STORE_COL_AGENTS, // float[width]: pcol of agents 1..width, as in the pcol line
+    STORE_COL_MAX
+} E_STORE_COLUMN;
+
+#define STORE_NUM_INT_COLS (STORE_COL_COEXIST - STORE_COL_MODE + 1)
+
+typedef struct
+{
+    int64_t run;
+    int32_t val[STORE_NUM_INT_COLS]; // By E_STORE_COLUMN - STORE_COL_MODE
+    double pcol;
+    double wifi;
+} S_STORE_ROW;
+
+static inline uint64_t store_column_size(int column, uint64_t rows, uint64_t width)
+{
+    uint64_t bytes;
+
+    if (column == STORE_COL_RUN || column == STORE_COL_PCOL || column == STORE_COL_WIFI)
+        bytes = 8 * rows;
+    else if (column == STORE_COL_AGENTS)
+        bytes = 4 * rows * width;
+    else
+        bytes = 4 * rows;
+    return (bytes + 7) & ~(uint64_t)7;
+}
+
+// Offset of a column from the start of its block. STORE_COL_MAX gives the size of the block.
+static inline uint64_t store_column_offset(int column, uint64_t rows, uint64_t width)
+{
+    uint64_t offset = sizeof(S_STORE_BLOCK);
+
+    for (int c = 0; c < column; c++)
+        offset += store_column_size(c, rows, width);
+    return offset;
+}
+
+#ifdef RESULT_STORE
+extern void result_store_open(const char *pPath, int width);
+extern void result_store_add(const S_STORE_ROW *pRow, const float *pAgents);
+extern void result_store_flush(void);
+extern void result_store_close(void);
+#endif
+
+#endif /* RESULT_STORE_H_ */
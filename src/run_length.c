@@ -0,0 +1,97 @@
+/*
+ * Run lengths of consecutive collided episodes (run_length.h).
+ *
+ * An episode that collides is a packet that has to be sent again, so a run of k collided episodes of an
+ * agent is a packet retransmitted k times. With RUN_LENGTH, each agent counts its current run in the
+ * statistics loop of run_episodes() (and of the FAST_FORWARD engine); a run that ends goes into one
+ * histogram shared by all the agents of the run, at the cost of an increment and a bucket index. Runs
+ * are counted from PERTURBATION, as total_collisions is, and the runs still open at the end are added
+ * when the sweep point is reported.
+ *
+ * marl_main writes the histogram and CDF of every sweep point to retx_<time>.txt. Histograms of the same
+ * point merge by adding their buckets; tools/retx_merge merges the files of replicated runs.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "run_length.h"
+
+#ifdef RUN_LENGTH
+
+#if defined(SWEEP_SCHEDULER) || defined(ADAPTIVE_SWEEP) || defined(RESULT_CACHE)
+#error "RUN_LENGTH needs the run of every sweep point in marl_main. Disable SWEEP_SCHEDULER, ADAPTIVE_SWEEP and RESULT_CACHE."
+#endif
+
+void run_hist_reset(S_RUN_HIST *pHist)
+{
+    memset(pHist, 0, sizeof(*pHist));
+}
+
+void run_hist_merge(S_RUN_HIST *pTo, const S_RUN_HIST *pFrom)
+{
+    pTo->count += pFrom->count;
+    pTo->sum += pFrom->sum;
+    if (pFrom->max > pTo->max)
+        pTo->max = pFrom->max;
+    for (int b = 0; b < RUN_HIST_BUCKETS; b++)
+        pTo->buckets[b] += pFrom->buckets[b];
+}
+
+// Smallest run length of the bucket.
+int run_hist_value(int bucket)
+{
+    int shift;
+
+    if (bucket < 2 * RUN_HIST_SUB)
+        return bucket;
+    shift = bucket / RUN_HIST_SUB - 1;
+    return (bucket % RUN_HIST_SUB + RUN_HIST_SUB) << shift;
+}
+
+// A header line after pKey, then "run_length runs cdf" for each bucket in use and a blank line.
+void run_hist_write(FILE *fp, const char *pKey, const S_RUN_HIST *pHist)
+{
+    long long cumulative = 0;
+
+    fprintf(fp, "# %s runs %lld episodes %lld mean %f max %d\n", pKey, pHist->count, pHist->sum, pHist->count ? (double)pHist->sum / pHist->count : 0.0,
+            pHist->max);
+    for (int b = 0; b < RUN_HIST_BUCKETS; b++)
+    {
+        if (pHist->buckets[b] == 0)
+            continue;
+        cumulative += pHist->buckets[b];
+        fprintf(fp, "%d %lld %f\n", run_hist_value(b), pHist->buckets[b], (double)cumulative / pHist->count);
+    }
+    fprintf(fp, "\n");
+}
+
+// Reads the next block of run_hist_write(). Returns false at the end of the file.
+bool run_hist_read(FILE *fp, char *pKey, int keySize, S_RUN_HIST *pHist)
+{
+    char line[512], *pRuns;
+    long long count;
+    int value;
+    double cdf;
+
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        pRuns = strstr(line, " runs ");
+        if (strncmp(line, "# ", 2) != 0 || pRuns == NULL || strncmp(line, "# mode", 6) == 0)
+            continue;
+
+        run_hist_reset(pHist);
+        snprintf(pKey, keySize, "%.*s", (int)(pRuns - line - 2), line + 2);
+        sscanf(pRuns, " runs %*d episodes %lld mean %*f max %d", &pHist->sum, &pHist->max);
+        while (fgets(line, sizeof(line), fp) != NULL && sscanf(line, "%d %lld %lf", &value, &count, &cdf) == 3)
+        {
+            pHist->buckets[run_hist_bucket(value)] += count;
+            pHist->count += count;
+        }
+        return true;
+    }
+    return false;
+}
+
+#endif /* RUN_LENGTH */
@@ -0,0 +1,64 @@
+/*
+ * run_length.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef RUN_LENGTH_H_
+#define RUN_LENGTH_H_
+
+// Histogram of run lengths in HDR-style buckets: exact below 2 * RUN_HIST_SUB, then RUN_HIST_SUB buckets
+// per power of two (within 1 / RUN_HIST_SUB of the value).
+#define RUN_HIST_SUB_BITS 5
+#define RUN_HIST_SUB (1 << RUN_HIST_SUB_BITS)
+#define RUN_HIST_BUCKETS ((32 - RUN_HIST_SUB_BITS) * RUN_HIST_SUB)
+
+typedef struct
+{
+    long long count; // Runs
+    long long sum;   // Collided episodes in the runs
+    int max;
+    long long buckets[RUN_HIST_BUCKETS];
+} S_RUN_HIST;
+
+static inline int run_hist_bucket(unsigned int value)
+{
+    int shift;
+
+    if (value < 2 * RUN_HIST_SUB)
+        return value;
+    shift = (31 - __builtin_clz(value)) - RUN_HIST_SUB_BITS;
+    return (shift + 1) * RUN_HIST_SUB + (int)(value >> shift) - RUN_HIST_SUB;
+}
+
+static inline void run_hist_add(S_RUN_HIST *pHist, int value)
+{
+    pHist->count++;
+    pHist->sum += value;
+    if (value > pHist->max)
+        pHist->max = value;
+    pHist->buckets[run_hist_bucket(value)]++;
+}
+
+// Counts one episode of an agent: a run of collided episodes goes to the histogram at the first clean one.
+static inline void run_length_track(int *pRun, S_RUN_HIST *pHist, bool bCollided)
+{
+    if (bCollided)
+        (*pRun)++;
+    else if (*pRun > 0)
+    {
+        run_hist_add(pHist, *pRun);
+        *pRun = 0;
+    }
+}
+
+#ifdef RUN_LENGTH
+extern void run_hist_reset(S_RUN_HIST *pHist);
+extern void run_hist_merge(S_RUN_HIST *pTo, const S_RUN_HIST *pFrom);
+extern int run_hist_value(int bucket);
+extern void run_hist_write(FILE *fp, const char *pKey, const S_RUN_HIST *pHist);
+extern bool run_hist_read(FILE *fp, char *pKey, int keySize, S_RUN_HIST *pHist);
+#endif
+
+#endif /* RUN_LENGTH_H_ */
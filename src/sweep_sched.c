@@ -0,0 +1,649 @@
+/*
+ * Work-stealing scheduler for the sweep points of marl_main.
+ *
+ * marl_main runs its loops twice. The first pass only records every sweep point (job). The jobs are
+ * then costed with short calibration runs, dealt out longest-first to one queue per worker process,
+ * and run in parallel; a worker whose queue is empty steals from the tail of the queue with the most
+ * estimated work left. The second pass walks the same loops and prints the stored results, so pcol
+ * keeps the order of the sequential sweep whatever the number of workers.
+ *
+ * The simulator state is global, hence worker processes (fork) with the queues and results in shared
+ * memory instead of threads. Each job restarts from the same agent snapshot with DFH_SRAND(seed + job),
+ * so the results do not depend on which worker ran it. With RESULT_CACHE, the jobs found in the cache
+ * are loaded before the others are dealt out, and a job runs as marl_main would run it: seeded from its
+ * key, and stored in the cache.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "sweep_sched.h"
+#include "sweep_shard.h"
+#include "result_cache.h"
+#include "live_stats.h"
+
+#ifdef SWEEP_SCHEDULER
+
+#ifdef HEATMAP
+#error "SWEEP_SCHEDULER writes no per-episode files. Disable HEATMAP."
+#endif
+#ifdef TRAFFIC
+#error "SWEEP_SCHEDULER only collects the collision totals. Disable TRAFFIC."
+#endif
+#ifdef SYNC_SLOT_COMPARE
+#error "SYNC_SLOT_COMPARE runs both passes of a point from the same seed in marl_main. Disable SWEEP_SCHEDULER."
+#endif
+
+extern DFH_TLS int HMAX;
+extern DFH_TLS int episode;
+extern DFH_TLS int gNum_channels;
+extern DFH_TLS int gNumOfAvailCh;
+extern DFH_TLS int gModeDefault;
+extern DFH_TLS int num_diff;
+#ifdef DIFFUSIVE
+extern DFH_TLS int gTargetCoexit;
+#endif
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+extern DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+extern DFH_TLS Agent gstAgents[NUM_AGENTS + 1];
+extern void initialize_agents(Agent agents[], int num_agents);
+extern void run_simulation(Agent agents[], int num_agents);
+
+typedef struct
+{
+    volatile int lock;
+    int head; // Next job of the owner (largest remaining estimate)
+    int tail; // One past the last job. Thieves take tail - 1.
+    double estRemaining;
+} __attribute__((aligned(SWEEP_CACHE_LINE))) S_SWEEP_QUEUE;
+
+// Written only by its worker, one cache line each.
+typedef struct
+{
+    int cpu;
+    int jobsDone;
+    int jobsStolen;
+    double busySec;
+    double estSec;
+} __attribute__((aligned(SWEEP_CACHE_LINE))) S_SWEEP_WORKER_STAT;
+
+E_SWEEP_PASS gSweepPass = SWEEP_PASS_DONE;
+// Non-zero limits run_simulation() to this many episodes (calibration runs only).
+int gSweepCalibEpisodes = 0;
+
+static S_SWEEP_JOB *gpSweepJobs = NULL;
+static int gNumOfSweepJobs = 0;
+static int gSweepJobCapacity = 0;
+static int gSweepCursor = 0;
+static int gSweepHmax;
+static unsigned int gSweepSeed;
+static Agent *gpAgentSnapshot = NULL;
+static S_SWEEP_RESULT *gpResults;
+
+// Local workers. SWEEP_SHARD runs the jobs in shard_run() instead.
+#ifndef SWEEP_SHARD
+static int gNumOfJobsToRun = 0; // Jobs not loaded from RESULT_CACHE
+static int gNumOfWorkers;
+// CPUs of the affinity mask of the sweep (taskset, cgroup cpusets), which the workers are dealt over.
+static int gSweepCpus[CPU_SETSIZE];
+static int gNumOfSweepCpus;
+static S_SWEEP_QUEUE *gpQueues;
+static int *gpQueueJobs; // gNumOfWorkers rows of gNumOfSweepJobs entries
+static S_SWEEP_WORKER_STAT *gpWorkerStats;
+#endif
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *alloc_shared(size_t size)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (p == MAP_FAILED)
+    {
+        printf("sweep: cannot map %zu bytes of shared memory. Exiting.\n", size);
+        exit(777);
+    }
+    memset(p, 0, size);
+    return p;
+}
+
+// Sets the globals of marl_main as they were when the job was recorded.
+static void apply_job(const S_SWEEP_JOB *pJob)
+{
+    gNum_channels = pJob->nc;
+    gModeDefault = pJob->mode;
+    HMAX = pJob->hmax;
+    gNumOfAvailCh = pJob->numOfAvailCh;
+    num_diff = pJob->numDiff;
+#ifdef DIFFUSIVE
+    gTargetCoexit = pJob->targetCoexist;
+#endif
+}
+
+#ifdef LIVE_STATS
+// pcol of the totals of a job, as marl_main prints it.
+static double job_pcol(const int *pCollisions, int na)
+{
+    long long sum = 0;
+
+    for (int i = 1; i <= na; i++)
+        sum += pCollisions[i];
+    return sum * 1.0 / na / (MAX_EPISODES - PERTURBATION);
+}
+#endif
+
+// Sets the agents and rand() for the run of the job. False if the totals were loaded from RESULT_CACHE instead.
+static bool prepare_job(int job, int num_episodes)
+{
+#ifdef RESULT_CACHE
+    if (num_episodes == 0)
+        return !result_cache_load(gpSweepJobs[job].na, gpSweepJobs[job].nc);
+#endif
+    memcpy(gstAgents, gpAgentSnapshot, sizeof(gstAgents));
+    DFH_SRAND(gSweepSeed + job);
+    return true;
+}
+
+// Runs the job from the agent snapshot. Returns the elapsed time per episode, 0 if the job was in RESULT_CACHE.
+double sweep_run_job(int job, int num_episodes)
+{
+    S_SWEEP_JOB *pJob = &gpSweepJobs[job];
+    double start;
+
+    apply_job(pJob);
+#ifdef LIVE_STATS
+    if (num_episodes == 0)
+        live_stats_point(pJob->na, pJob->nc);
+#endif
+    if (!prepare_job(job, num_episodes))
+    {
+#ifdef LIVE_STATS
+        live_stats_point_done(job_pcol(total_collisions, pJob->na));
+#endif
+        return 0;
+    }
+    gSweepCalibEpisodes = num_episodes;
+
+    start = now_sec();
+    initialize_agents(gstAgents, pJob->na);
+    run_simulation(gstAgents, pJob->na);
+#ifdef RESULT_CACHE
+    if (num_episodes == 0)
+        result_cache_store(pJob->na);
+#endif
+#ifdef LIVE_STATS
+    if (num_episodes == 0)
+        live_stats_point_done(job_pcol(total_collisions, pJob->na));
+#endif
+
+    gSweepCalibEpisodes = 0;
+    return (now_sec() - start) / (episode - 1);
+}
+
+#ifndef SWEEP_SHARD
+static void lock_queue(S_SWEEP_QUEUE *pQueue)
+{
+    while (__sync_lock_test_and_set(&pQueue->lock, 1))
+    {
+        while (pQueue->lock)
+            ;
+    }
+}
+
+static void unlock_queue(S_SWEEP_QUEUE *pQueue)
+{
+    __sync_lock_release(&pQueue->lock);
+}
+
+// Keeps the totals run_simulation() left (or RESULT_CACHE loaded) as the result of the job.
+static void store_result(int job, int worker, double sec)
+{
+    S_SWEEP_RESULT *pResult = &gpResults[job];
+
+    memcpy(pResult->total_collisions, total_collisions, sizeof(pResult->total_collisions));
+    memcpy(pResult->total_wifi_collisions, total_wifi_collisions, sizeof(pResult->total_wifi_collisions));
+    pResult->worker = worker;
+    pResult->sec = sec;
+    __sync_synchronize();
+    pResult->done = 1;
+}
+
+/*
+ * Per-episode cost of a mode is modeled as c1 * na + c2 * na^2 (collision checks are quadratic),
+ * fitted from calibration runs at the smallest and largest population of that mode.
+ */
+static void calibrate_jobs(void)
+{
+    bool bDone[MODE_MAX * MODE_MAX] = {false};
+
+    for (int j = 0; j < gNumOfSweepJobs; j++)
+    {
+        int key = gpSweepJobs[j].mode * MODE_MAX + gpSweepJobs[j].targetCoexist;
+        int jobMin = j, jobMax = j;
+        double t1, t2, n1, n2, c1, c2;
+
+        if (bDone[key] || gpResults[j].done)
+            continue;
+        bDone[key] = true;
+
+        for (int k = j + 1; k < gNumOfSweepJobs; k++)
+        {
+            if (gpSweepJobs[k].mode * MODE_MAX + gpSweepJobs[k].targetCoexist != key || gpResults[k].done)
+                continue;
+            if (gpSweepJobs[k].na < gpSweepJobs[jobMin].na)
+                jobMin = k;
+            if (gpSweepJobs[k].na > gpSweepJobs[jobMax].na)
+                jobMax = k;
+        }
+
+        n1 = gpSweepJobs[jobMin].na;
+        n2 = gpSweepJobs[jobMax].na;
+        t1 = sweep_run_job(jobMin, SWEEP_CALIB_EPISODES);
+        t2 = (jobMax == jobMin) ? t1 : sweep_run_job(jobMax, SWEEP_CALIB_EPISODES);
+
+        if (n2 > n1)
+        {
+            c2 = (t2 / n2 - t1 / n1) / (n2 - n1);
+            c1 = t1 / n1 - c2 * n1;
+            if (c2 < 0)
+            {
+                c2 = 0;
+                c1 = (t1 / n1 > t2 / n2) ? t1 / n1 : t2 / n2;
+            }
+            else if (c1 < 0)
+            {
+                c1 = 0;
+                c2 = t2 / (n2 * n2);
+            }
+        }
+        else
+        {
+            c1 = t1 / n1;
+            c2 = 0;
+        }
+
+        for (int k = j; k < gNumOfSweepJobs; k++)
+        {
+            if (gpSweepJobs[k].mode * MODE_MAX + gpSweepJobs[k].targetCoexist == key && !gpResults[k].done)
+                gpSweepJobs[k].estCost = (c1 * gpSweepJobs[k].na + c2 * gpSweepJobs[k].na * gpSweepJobs[k].na) * MAX_EPISODES;
+        }
+    }
+}
+
+// Longest estimate first, each job to the worker with the least estimated work so far.
+static void deal_jobs(void)
+{
+    int order[gNumOfSweepJobs];
+    int temp, w, n = 0;
+
+    for (int j = 0; j < gNumOfSweepJobs; j++)
+    {
+        if (!gpResults[j].done)
+            order[n++] = j;
+    }
+
+    for (int i = 1; i < n; i++)
+    {
+        for (int j = i; j > 0 && gpSweepJobs[order[j]].estCost > gpSweepJobs[order[j - 1]].estCost; j--)
+        {
+            temp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = temp;
+        }
+    }
+
+    for (int j = 0; j < n; j++)
+    {
+        w = 0;
+        for (int k = 1; k < gNumOfWorkers; k++)
+        {
+            if (gpQueues[k].estRemaining < gpQueues[w].estRemaining)
+                w = k;
+        }
+        gpQueueJobs[w * gNumOfSweepJobs + gpQueues[w].tail] = order[j];
+        gpQueues[w].tail++;
+        gpQueues[w].estRemaining += gpSweepJobs[order[j]].estCost;
+    }
+}
+
+static int take_job(int w)
+{
+    S_SWEEP_QUEUE *pQueue = &gpQueues[w];
+    int job = -1;
+
+    lock_queue(pQueue);
+    if (pQueue->head < pQueue->tail)
+    {
+        job = gpQueueJobs[w * gNumOfSweepJobs + pQueue->head];
+        pQueue->head++;
+        pQueue->estRemaining -= gpSweepJobs[job].estCost;
+    }
+    unlock_queue(pQueue);
+
+    return job;
+}
+
+static int steal_job(int w)
+{
+    int victim;
+    int job;
+
+    for (;;)
+    {
+        victim = -1;
+        for (int k = 0; k < gNumOfWorkers; k++)
+        {
+            if (k == w || gpQueues[k].head >= gpQueues[k].tail)
+                continue;
+            if (victim < 0 || gpQueues[k].estRemaining > gpQueues[victim].estRemaining)
+                victim = k;
+        }
+        if (victim < 0)
+            return -1;
+
+        job = -1;
+        lock_queue(&gpQueues[victim]);
+        if (gpQueues[victim].head < gpQueues[victim].tail)
+        {
+            gpQueues[victim].tail--;
+            job = gpQueueJobs[victim * gNumOfSweepJobs + gpQueues[victim].tail];
+            gpQueues[victim].estRemaining -= gpSweepJobs[job].estCost;
+        }
+        unlock_queue(&gpQueues[victim]);
+
+        if (job >= 0)
+            return job;
+    }
+}
+
+static void read_sweep_cpus(void)
+{
+    cpu_set_t cpus;
+
+    gNumOfSweepCpus = 0;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0)
+        return;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &cpus))
+            gSweepCpus[gNumOfSweepCpus++] = cpu;
+    }
+}
+
+static void run_worker(int w)
+{
+    S_SWEEP_WORKER_STAT stStat = {0};
+    cpu_set_t cpus;
+    bool bStolen;
+    double start;
+    int job;
+
+    stStat.cpu = -1;
+    if (gNumOfSweepCpus > 0)
+    {
+        stStat.cpu = gSweepCpus[w % gNumOfSweepCpus];
+        CPU_ZERO(&cpus);
+        CPU_SET(stStat.cpu, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+            stStat.cpu = -1;
+    }
+#ifdef LIVE_STATS
+    live_stats_fork(gpQueues[w].tail - gpQueues[w].head);
+#endif
+
+    for (;;)
+    {
+        bStolen = false;
+        job = take_job(w);
+        if (job < 0)
+        {
+            job = steal_job(w);
+            bStolen = true;
+        }
+        if (job < 0)
+            break;
+
+        start = now_sec();
+        sweep_run_job(job, 0);
+        store_result(job, w, now_sec() - start);
+
+        stStat.jobsDone++;
+        stStat.jobsStolen += bStolen;
+        stStat.busySec += gpResults[job].sec;
+        stStat.estSec += gpSweepJobs[job].estCost;
+        gpWorkerStats[w] = stStat;
+    }
+
+    gpWorkerStats[w] = stStat;
+#ifdef LIVE_STATS
+    live_stats_end();
+#endif
+}
+
+#ifdef LIVE_STATS
+// Records the jobs finished (or loaded from RESULT_CACHE) since the last call in the segment of the sweep.
+static void publish_done_jobs(void)
+{
+    for (int j = 0; j < gNumOfSweepJobs; j++)
+    {
+        if (gpSweepJobs[j].bPublished || !gpResults[j].done)
+            continue;
+        gpSweepJobs[j].bPublished = true;
+        apply_job(&gpSweepJobs[j]);
+        live_stats_point(gpSweepJobs[j].na, gpSweepJobs[j].nc);
+        live_stats_point_done(job_pcol(gpResults[j].total_collisions, gpSweepJobs[j].na));
+    }
+}
+#endif
+
+static void run_jobs(void)
+{
+    pid_t pids[gNumOfWorkers];
+    int status;
+    double start = now_sec();
+
+    gpQueues = alloc_shared(sizeof(S_SWEEP_QUEUE) * gNumOfWorkers);
+    gpQueueJobs = alloc_shared(sizeof(int) * gNumOfWorkers * gNumOfSweepJobs);
+    gpWorkerStats = alloc_shared(sizeof(S_SWEEP_WORKER_STAT) * gNumOfWorkers);
+
+    deal_jobs();
+
+    // Buffered output would otherwise be written once more by every worker.
+    fflush(NULL);
+    for (int w = 0; w < gNumOfWorkers; w++)
+    {
+        pids[w] = fork();
+        if (pids[w] < 0)
+        {
+            printf("sweep: fork failed. Exiting.\n");
+            exit(777);
+        }
+        if (pids[w] == 0)
+        {
+            run_worker(w);
+            _exit(0);
+        }
+    }
+
+    for (int w = 0; w < gNumOfWorkers; w++)
+    {
+        pid_t pid;
+
+#ifdef LIVE_STATS
+        // Meanwhile, the segment of the sweep records the jobs the workers finish.
+        while ((pid = waitpid(pids[w], &status, WNOHANG)) == 0)
+        {
+            publish_done_jobs();
+            usleep(LIVE_STATS_INTERVAL_MS * 1000);
+        }
+#else
+        pid = waitpid(pids[w], &status, 0);
+#endif
+        if (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            printf("sweep: worker %d failed. Exiting.\n", w);
+            exit(777);
+        }
+    }
+
+    printf("\nsweep: %d of %d jobs on %d workers in %.2f s", gNumOfJobsToRun, gNumOfSweepJobs, gNumOfWorkers, now_sec() - start);
+    for (int w = 0; w < gNumOfWorkers; w++)
+    {
+        printf("\nsweep: worker %d cpu %d jobs %d stolen %d busy %.2f s est %.2f s", w, gpWorkerStats[w].cpu, gpWorkerStats[w].jobsDone, gpWorkerStats[w].jobsStolen, gpWorkerStats[w].busySec, gpWorkerStats[w].estSec);
+    }
+    printf("\n");
+
+    munmap(gpQueues, sizeof(S_SWEEP_QUEUE) * gNumOfWorkers);
+    munmap(gpQueueJobs, sizeof(int) * gNumOfWorkers * gNumOfSweepJobs);
+    munmap(gpWorkerStats, sizeof(S_SWEEP_WORKER_STAT) * gNumOfWorkers);
+}
+#endif /* SWEEP_SHARD */
+
+void sweep_begin(void)
+{
+    gSweepPass = SWEEP_PASS_COLLECT;
+    gNumOfSweepJobs = 0;
+    gSweepCursor = 0;
+    gSweepHmax = HMAX;
+    gSweepSeed = DFH_RAND();
+
+    if (gpAgentSnapshot == NULL)
+        gpAgentSnapshot = (Agent *)malloc(sizeof(gstAgents));
+    if (gpAgentSnapshot == NULL)
+    {
+        printf("sweep: out of memory. Exiting.\n");
+        exit(777);
+    }
+    memcpy(gpAgentSnapshot, gstAgents, sizeof(gstAgents));
+}
+
+void sweep_next_pass(void)
+{
+    if (gSweepPass == SWEEP_PASS_REPORT)
+    {
+        munmap(gpResults, sizeof(S_SWEEP_RESULT) * gNumOfSweepJobs);
+        gSweepPass = SWEEP_PASS_DONE;
+        return;
+    }
+
+    gpResults = alloc_shared(sizeof(S_SWEEP_RESULT) * gNumOfSweepJobs);
+#ifdef LIVE_STATS
+    live_stats_total(gNumOfSweepJobs);
+#endif
+#ifdef SWEEP_SHARD
+    // The jobs are shared with the other processes of SHARD_DIR instead of local workers.
+    if (!shard_run(gpSweepJobs, gNumOfSweepJobs, gpAgentSnapshot, &gSweepSeed, gpResults))
+    {
+        // Another process prints the sweep.
+        munmap(gpResults, sizeof(S_SWEEP_RESULT) * gNumOfSweepJobs);
+        gSweepPass = SWEEP_PASS_DONE;
+        return;
+    }
+#else
+    gNumOfJobsToRun = gNumOfSweepJobs;
+#ifdef RESULT_CACHE
+    for (int j = 0; j < gNumOfSweepJobs; j++)
+    {
+        apply_job(&gpSweepJobs[j]);
+        if (result_cache_load(gpSweepJobs[j].na, gpSweepJobs[j].nc))
+        {
+            store_result(j, -1, 0);
+            gNumOfJobsToRun--;
+        }
+    }
+#endif
+    read_sweep_cpus();
+    gNumOfWorkers = SWEEP_WORKERS;
+    if (gNumOfWorkers <= 0)
+        gNumOfWorkers = (gNumOfSweepCpus > 0) ? gNumOfSweepCpus : sysconf(_SC_NPROCESSORS_ONLN);
+    if (gNumOfWorkers > gNumOfJobsToRun)
+        gNumOfWorkers = gNumOfJobsToRun;
+
+    if (gNumOfJobsToRun > 0)
+    {
+        calibrate_jobs();
+        run_jobs();
+    }
+#ifdef LIVE_STATS
+    publish_done_jobs();
+#endif
+#endif
+
+    // The second pass must toggle HMAX exactly as the first one did.
+    HMAX = gSweepHmax;
+    gSweepPass = SWEEP_PASS_REPORT;
+}
+
+void sweep_add_job(int na, int nc)
+{
+    S_SWEEP_JOB *pJob;
+
+    if (gNumOfSweepJobs == gSweepJobCapacity)
+    {
+        gSweepJobCapacity = (gSweepJobCapacity == 0) ? 64 : gSweepJobCapacity * 2;
+        gpSweepJobs = (S_SWEEP_JOB *)realloc(gpSweepJobs, sizeof(S_SWEEP_JOB) * gSweepJobCapacity);
+        if (gpSweepJobs == NULL)
+        {
+            printf("sweep: out of memory. Exiting.\n");
+            exit(777);
+        }
+    }
+
+    pJob = &gpSweepJobs[gNumOfSweepJobs++];
+    pJob->na = na;
+    pJob->nc = nc;
+    pJob->mode = gModeDefault;
+    pJob->hmax = HMAX;
+    pJob->numOfAvailCh = gNumOfAvailCh;
+    pJob->numDiff = num_diff;
+#ifdef DIFFUSIVE
+    pJob->targetCoexist = gTargetCoexit;
+#else
+    pJob->targetCoexist = 0;
+#endif
+    pJob->estCost = 0;
+    pJob->bPublished = false;
+}
+
+// Loads the totals of the next job as if run_simulation() had just returned.
+void sweep_load_result(int na, int nc)
+{
+    S_SWEEP_JOB *pJob;
+    S_SWEEP_RESULT *pResult;
+
+    if (gSweepCursor >= gNumOfSweepJobs)
+    {
+        printf("sweep: more sweep points than recorded jobs. Exiting.\n");
+        exit(777);
+    }
+
+    pJob = &gpSweepJobs[gSweepCursor];
+    pResult = &gpResults[gSweepCursor];
+    if (pJob->na != na || pJob->nc != nc || pJob->mode != gModeDefault || pJob->hmax != HMAX || pResult->done == 0)
+    {
+        printf("sweep: result %d does not match the sweep point (na %d nc %d M%d). Exiting.\n", gSweepCursor, na, nc, gModeDefault);
+        exit(777);
+    }
+
+    memcpy(total_collisions, pResult->total_collisions, sizeof(pResult->total_collisions));
+    memcpy(total_wifi_collisions, pResult->total_wifi_collisions, sizeof(pResult->total_wifi_collisions));
+    gSweepCursor++;
+}
+
+#endif /* SWEEP_SCHEDULER */
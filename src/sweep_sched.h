@@ -0,0 +1,57 @@
+/*
+ * sweep_sched.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef SWEEP_SCHED_H_
+#define SWEEP_SCHED_H_
+
+#include <stdbool.h>
+
+// Number of worker processes. 0 uses one worker per CPU the process may run on (sched_getaffinity).
+#define SWEEP_WORKERS 0
+// Episodes per calibration run used to estimate the cost of each sweep point.
+#define SWEEP_CALIB_EPISODES 200
+#define SWEEP_CACHE_LINE 64
+
+typedef enum
+{
+    SWEEP_PASS_COLLECT = 0, // marl_main only records the sweep points.
+    SWEEP_PASS_REPORT,      // marl_main prints the results of the workers in the original order.
+    SWEEP_PASS_DONE
+} E_SWEEP_PASS;
+
+typedef struct
+{
+    int na;
+    int nc;
+    int mode;
+    int hmax;
+    int numOfAvailCh;
+    int numDiff;
+    int targetCoexist;
+    double estCost; // Estimated run time in seconds, from the calibration runs.
+    bool bPublished; // Recorded in the live stats of the sweep (LIVE_STATS)
+} S_SWEEP_JOB;
+
+typedef struct
+{
+    volatile int done;
+    int worker; // -1: loaded from RESULT_CACHE
+    double sec;
+    int total_collisions[NUM_AGENTS + 1];
+    int total_wifi_collisions[NUM_AGENTS + 1];
+} S_SWEEP_RESULT;
+
+extern E_SWEEP_PASS gSweepPass;
+extern int gSweepCalibEpisodes;
+
+extern void sweep_begin(void);
+extern void sweep_next_pass(void);
+extern void sweep_add_job(int na, int nc);
+extern void sweep_load_result(int na, int nc);
+extern double sweep_run_job(int job, int num_episodes);
+
+#endif /* SWEEP_SCHED_H_ */
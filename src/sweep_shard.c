@@ -0,0 +1,466 @@
+/*
+ * Sweep sharded across processes through a shared directory (sweep_shard.h).
+ *
+ * With SWEEP_SHARD, the collect pass of SWEEP_SCHEDULER hands its jobs to SHARD_DIR instead of forking
+ * workers. Any number of processes, on one host or on hosts sharing the filesystem, run the same build in
+ * the same directory. The first one writes the job list with its seed, agent snapshot and the hop clocks of
+ * the piconets (drawn from the time of day unless DETERMINISTIC); the others check that their own sweep is
+ * the same and take all of them, so every job runs from the same state with DFH_SRAND(seed + job) wherever it
+ * runs.
+ *
+ * A job is claimed by creating claims/<job> with O_EXCL, and its totals are written to a temporary file
+ * renamed to results/<job>, so a result is either whole or missing. A SIGALRM timer touches the claim
+ * while the job runs. A claim older than SHARD_STALE_SEC is renamed away by one process (rename is atomic)
+ * and claimed again; if it turns out to have been renewed meanwhile, it is put back. Should a job still run
+ * twice, both runs write the same result. Once every result is in, the process that creates merged runs
+ * the report pass of marl_main, printing the whole sweep to its pcol; the others leave theirs empty.
+ * Removing merged and starting a process again prints the sweep again without running anything.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "sweep_sched.h"
+#include "sweep_shard.h"
+
+#ifdef SWEEP_SHARD
+
+#ifndef SWEEP_SCHEDULER
+#error "SWEEP_SHARD shares the jobs of SWEEP_SCHEDULER. Enable SWEEP_SCHEDULER."
+#endif
+
+#define SHARD_PATH 512
+#define SHARD_LINE (16 * (NUM_AGENTS + 1) + 64)
+
+extern DFH_TLS int total_collisions[NUM_AGENTS + 1];
+extern DFH_TLS int total_wifi_collisions[NUM_AGENTS + 1];
+
+// Hop sequence of a piconet, set by main() from its seed, which the agent snapshot does not hold.
+typedef struct
+{
+    uint64_t bdAddr;
+    uint32_t base_clk;
+    int32_t startClock;
+} S_SHARD_CLOCK;
+
+static char gShardHost[64];
+static int gShardPid;
+static char gShardToken[128]; // <host>.<pid>, for the names of the files of this process
+static volatile int gClaimFd = -1;
+
+static void shard_path(char *pPath, const char *pName)
+{
+    snprintf(pPath, SHARD_PATH, "%s/%s", SHARD_DIR, pName);
+}
+
+static void job_path(char *pPath, const char *pKind, int job)
+{
+    snprintf(pPath, SHARD_PATH, "%s/%s/%d", SHARD_DIR, pKind, job);
+}
+
+static void format_job(char *pLine, size_t size, int job, const S_SWEEP_JOB *pJob)
+{
+    snprintf(pLine, size, "%d %d %d %d %d %d %d %d", job, pJob->na, pJob->nc, pJob->mode, pJob->hmax, pJob->numOfAvailCh, pJob->numDiff,
+             pJob->targetCoexist);
+}
+
+static void make_dir(const char *pPath)
+{
+    if (mkdir(pPath, 0755) != 0 && errno != EEXIST)
+    {
+        printf("shard: can't create %s. Exiting.\n", pPath);
+        exit(777);
+    }
+}
+
+// Creates the file with O_EXCL and writes "<host> <pid>". Returns the open descriptor, -1 if it exists.
+static int create_exclusive(const char *pPath)
+{
+    char owner[128];
+    int fd = open(pPath, O_CREAT | O_EXCL | O_WRONLY, 0644);
+
+    if (fd < 0)
+    {
+        if (errno != EEXIST)
+        {
+            printf("shard: can't create %s. Exiting.\n", pPath);
+            exit(777);
+        }
+        return -1;
+    }
+    snprintf(owner, sizeof(owner), "%s %d\n", gShardHost, gShardPid);
+    if (write(fd, owner, strlen(owner)) < 0)
+    {
+        printf("shard: can't write %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    return fd;
+}
+
+/*
+ * Job list
+ */
+// Writes jobs.txt and the snapshot, unless another process has. The list is linked into place whole.
+static void publish_jobs(const S_SWEEP_JOB *pJobs, int numOfJobs, const Agent *pSnapshot, unsigned int seed)
+{
+    char path[SHARD_PATH], tmp[SHARD_PATH + 160], snapshot[SHARD_PATH], name[256], line[128];
+    S_SHARD_CLOCK clocks[NUM_AGENTS + 1] = {{0}};
+    FILE *fp;
+
+    shard_path(path, "jobs.txt");
+    if (access(path, F_OK) == 0)
+        return;
+
+    for (int i = 1; i <= NUM_AGENTS; i++)
+    {
+        clocks[i].bdAddr = piconet_queues[i].stHoppingInfo.bdAddr;
+        clocks[i].base_clk = piconet_queues[i].stHoppingInfo.base_clk;
+        clocks[i].startClock = piconet_queues[i].startClock;
+    }
+    snprintf(name, sizeof(name), "agents.%s.bin", gShardToken);
+    shard_path(snapshot, name);
+    fp = fopen(snapshot, "wb");
+    if (fp == NULL || fwrite(pSnapshot, sizeof(Agent), NUM_AGENTS + 1, fp) != NUM_AGENTS + 1 ||
+        fwrite(clocks, sizeof(S_SHARD_CLOCK), NUM_AGENTS + 1, fp) != NUM_AGENTS + 1 || fclose(fp) != 0)
+    {
+        printf("shard: can't write %s. Exiting.\n", snapshot);
+        exit(777);
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.%s", path, gShardToken);
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+    {
+        printf("shard: can't write %s. Exiting.\n", tmp);
+        exit(777);
+    }
+    fprintf(fp, "# dfh shard %d agents %d episodes %d perturbation %d agent_bytes %d seed %u jobs %d snapshot %s\n", SHARD_VERSION, NUM_AGENTS,
+            MAX_EPISODES, PERTURBATION, (int)sizeof(Agent), seed, numOfJobs, name);
+    fprintf(fp, "# job na nc mode hmax avail diff coexist\n");
+    for (int j = 0; j < numOfJobs; j++)
+    {
+        format_job(line, sizeof(line), j, &pJobs[j]);
+        fprintf(fp, "%s\n", line);
+    }
+    if (fclose(fp) != 0)
+    {
+        printf("shard: can't write %s. Exiting.\n", tmp);
+        exit(777);
+    }
+
+    if (link(tmp, path) != 0)
+    {
+        // Another process published first: its list and snapshot are the ones of the sweep.
+        if (errno != EEXIST)
+        {
+            printf("shard: can't create %s. Exiting.\n", path);
+            exit(777);
+        }
+        unlink(snapshot);
+    }
+    unlink(tmp);
+}
+
+// Checks that jobs.txt is the sweep of this process and takes its seed, snapshot and hop clocks.
+static void join_jobs(const S_SWEEP_JOB *pJobs, int numOfJobs, Agent *pSnapshot, unsigned int *pSeed)
+{
+    char path[SHARD_PATH], snapshot[SHARD_PATH], name[256], line[128], expected[128];
+    int version, agents, episodes, perturbation, agentBytes, jobs;
+    S_SHARD_CLOCK clocks[NUM_AGENTS + 1];
+    FILE *fp;
+
+    shard_path(path, "jobs.txt");
+    fp = fopen(path, "r");
+    if (fp == NULL || fgets(line, sizeof(line), fp) == NULL ||
+        sscanf(line, "# dfh shard %d agents %d episodes %d perturbation %d agent_bytes %d seed %u jobs %d snapshot %255s", &version, &agents,
+               &episodes, &perturbation, &agentBytes, pSeed, &jobs, name) != 8)
+    {
+        printf("shard: can't read %s. Exiting.\n", path);
+        exit(777);
+    }
+    if (version != SHARD_VERSION || agents != NUM_AGENTS || episodes != MAX_EPISODES || perturbation != PERTURBATION ||
+        agentBytes != (int)sizeof(Agent) || jobs != numOfJobs)
+    {
+        printf("shard: %s is another sweep (%d jobs of %d agents, %d episodes). Exiting.\n", path, jobs, agents, episodes);
+        exit(777);
+    }
+    for (int j = 0; j < numOfJobs;)
+    {
+        if (fgets(line, sizeof(line), fp) == NULL)
+        {
+            printf("shard: %s ends at job %d. Exiting.\n", path, j);
+            exit(777);
+        }
+        if (line[0] == '#')
+            continue;
+        line[strcspn(line, "\r\n")] = '\0';
+        format_job(expected, sizeof(expected), j, &pJobs[j]);
+        if (strcmp(line, expected) != 0)
+        {
+            printf("shard: job %s of %s is %s here. Exiting.\n", line, path, expected);
+            exit(777);
+        }
+        j++;
+    }
+    fclose(fp);
+
+    shard_path(snapshot, name);
+    fp = fopen(snapshot, "rb");
+    if (fp == NULL || fread(pSnapshot, sizeof(Agent), NUM_AGENTS + 1, fp) != NUM_AGENTS + 1 ||
+        fread(clocks, sizeof(S_SHARD_CLOCK), NUM_AGENTS + 1, fp) != NUM_AGENTS + 1)
+    {
+        printf("shard: can't read %s. Exiting.\n", snapshot);
+        exit(777);
+    }
+    fclose(fp);
+    for (int i = 1; i <= NUM_AGENTS; i++)
+    {
+        piconet_queues[i].stHoppingInfo.bdAddr = clocks[i].bdAddr;
+        piconet_queues[i].stHoppingInfo.base_clk = clocks[i].base_clk;
+        piconet_queues[i].startClock = clocks[i].startClock;
+    }
+}
+
+/*
+ * Claims
+ */
+static void heartbeat(int sig)
+{
+    (void)sig;
+    if (gClaimFd >= 0)
+        futimens(gClaimFd, NULL);
+}
+
+static void set_heartbeat(int sec)
+{
+    struct itimerval timer = {{sec, 0}, {sec, 0}};
+
+    setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+// Moves a stale claim out of the way. False if another process did, or if the claim was renewed since.
+static bool reclaim(const char *pClaim, const struct stat *pSeen)
+{
+    char moved[SHARD_PATH + 160];
+    struct stat st;
+
+    snprintf(moved, sizeof(moved), "%s.stale.%s", pClaim, gShardToken);
+    if (rename(pClaim, moved) != 0)
+        return false;
+    if (stat(moved, &st) == 0 && st.st_ino == pSeen->st_ino && st.st_mtime == pSeen->st_mtime)
+    {
+        unlink(moved);
+        return true;
+    }
+    // Not the claim that was seen stale: put it back, unless a new one is there already.
+    link(moved, pClaim);
+    unlink(moved);
+    return false;
+}
+
+// Returns the descriptor of the claim of the job, -1 if a live process holds it.
+static int claim_job(int job, int *pNumOfReclaimed)
+{
+    char path[SHARD_PATH];
+    struct stat st;
+    int fd;
+
+    job_path(path, "claims", job);
+    fd = create_exclusive(path);
+    if (fd >= 0 || stat(path, &st) != 0 || time(NULL) - st.st_mtime <= SHARD_STALE_SEC)
+        return fd;
+    if (!reclaim(path, &st))
+        return -1;
+    fd = create_exclusive(path);
+    if (fd >= 0)
+    {
+        printf("shard: job %d was claimed %ld s ago by a process that is gone, running it again\n", job, (long)(time(NULL) - st.st_mtime));
+        (*pNumOfReclaimed)++;
+    }
+    return fd;
+}
+
+static void release_job(int job, int fd)
+{
+    char path[SHARD_PATH];
+
+    close(fd);
+    job_path(path, "claims", job);
+    unlink(path);
+}
+
+/*
+ * Results
+ */
+static bool has_result(int job)
+{
+    char path[SHARD_PATH];
+
+    job_path(path, "results", job);
+    return access(path, F_OK) == 0;
+}
+
+static void write_result(int job, const S_SWEEP_JOB *pJob, double sec)
+{
+    char path[SHARD_PATH], tmp[SHARD_PATH + 160], line[128];
+    FILE *fp;
+
+    job_path(path, "results", job);
+    snprintf(tmp, sizeof(tmp), "%s.%s", path, gShardToken);
+    fp = fopen(tmp, "w");
+    if (fp == NULL)
+    {
+        printf("shard: can't write %s. Exiting.\n", tmp);
+        exit(777);
+    }
+    format_job(line, sizeof(line), job, pJob);
+    fprintf(fp, "%s\ncollisions", line);
+    for (int i = 1; i <= NUM_AGENTS; i++)
+        fprintf(fp, " %d", total_collisions[i]);
+    fprintf(fp, "\nwifi");
+    for (int i = 1; i <= NUM_AGENTS; i++)
+        fprintf(fp, " %d", total_wifi_collisions[i]);
+    fprintf(fp, "\n# %s %d %.2f s\n", gShardHost, gShardPid, sec);
+    if (fclose(fp) != 0 || rename(tmp, path) != 0)
+    {
+        printf("shard: can't write %s. Exiting.\n", path);
+        exit(777);
+    }
+}
+
+static void read_counts(FILE *fp, const char *pPath, const char *pName, int counts[])
+{
+    static char line[SHARD_LINE];
+    char *p;
+
+    if (fgets(line, sizeof(line), fp) == NULL || strncmp(line, pName, strlen(pName)) != 0)
+    {
+        printf("shard: no %s in %s. Exiting.\n", pName, pPath);
+        exit(777);
+    }
+    p = line + strlen(pName);
+    for (int i = 1; i <= NUM_AGENTS; i++)
+        counts[i] = strtol(p, &p, 10);
+}
+
+static void read_result(int job, const S_SWEEP_JOB *pJob, S_SWEEP_RESULT *pResult)
+{
+    char path[SHARD_PATH], line[128], expected[128];
+    FILE *fp;
+
+    job_path(path, "results", job);
+    format_job(expected, sizeof(expected), job, pJob);
+    fp = fopen(path, "r");
+    if (fp == NULL || fgets(line, sizeof(line), fp) == NULL || strncmp(line, expected, strlen(expected)) != 0)
+    {
+        printf("shard: %s is not the result of job %s. Exiting.\n", path, expected);
+        exit(777);
+    }
+    read_counts(fp, path, "collisions", pResult->total_collisions);
+    read_counts(fp, path, "wifi", pResult->total_wifi_collisions);
+    fclose(fp);
+    pResult->done = 1;
+}
+
+// Runs the jobs nobody else runs until every result is in. True if this process prints the sweep.
+bool shard_run(S_SWEEP_JOB *pJobs, int numOfJobs, Agent *pSnapshot, unsigned int *pSeed, S_SWEEP_RESULT *pResults)
+{
+    struct sigaction stAction;
+    char path[SHARD_PATH], owner[128] = "";
+    int numOfRun = 0, numOfReclaimed = 0, numOfLeft, first, job, fd;
+    bool bClaimed;
+    double start;
+    struct timespec t0, t1;
+    FILE *fp;
+
+    gethostname(gShardHost, sizeof(gShardHost) - 1);
+    gShardPid = getpid();
+    snprintf(gShardToken, sizeof(gShardToken), "%s.%d", gShardHost, gShardPid);
+
+    make_dir(SHARD_DIR);
+    shard_path(path, "claims");
+    make_dir(path);
+    shard_path(path, "results");
+    make_dir(path);
+    publish_jobs(pJobs, numOfJobs, pSnapshot, *pSeed);
+    join_jobs(pJobs, numOfJobs, pSnapshot, pSeed);
+
+    memset(&stAction, 0, sizeof(stAction));
+    stAction.sa_handler = heartbeat;
+    stAction.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &stAction, NULL);
+
+    // Processes start at different jobs so that they rarely race for the same claim.
+    first = (numOfJobs > 0) ? gShardPid % numOfJobs : 0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do
+    {
+        numOfLeft = 0;
+        bClaimed = false;
+        for (int k = 0; k < numOfJobs; k++)
+        {
+            job = (first + k) % numOfJobs;
+            if (has_result(job))
+                continue;
+            numOfLeft++;
+            fd = claim_job(job, &numOfReclaimed);
+            if (fd < 0)
+                continue;
+            // The job may have been finished between the look at its result and the claim.
+            if (!has_result(job))
+            {
+                gClaimFd = fd;
+                set_heartbeat(SHARD_HEARTBEAT_SEC);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                start = t1.tv_sec + t1.tv_nsec * 1e-9;
+                sweep_run_job(job, 0);
+                clock_gettime(CLOCK_MONOTONIC, &t1);
+                write_result(job, &pJobs[job], t1.tv_sec + t1.tv_nsec * 1e-9 - start);
+                set_heartbeat(0);
+                gClaimFd = -1;
+                numOfRun++;
+            }
+            release_job(job, fd);
+            numOfLeft--;
+            bClaimed = true;
+        }
+        if (numOfLeft > 0 && !bClaimed)
+            sleep(SHARD_POLL_SEC);
+    } while (numOfLeft > 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("\nshard: %d of %d jobs of %s run here (%d of them reclaimed) in %.2f s\n", numOfRun, numOfJobs, SHARD_DIR, numOfReclaimed,
+           (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+
+    shard_path(path, "merged");
+    fd = create_exclusive(path);
+    if (fd < 0)
+    {
+        fp = fopen(path, "r");
+        if (fp != NULL)
+        {
+            if (fgets(owner, sizeof(owner), fp) != NULL)
+                owner[strcspn(owner, "\r\n")] = '\0';
+            fclose(fp);
+        }
+        printf("shard: the sweep is printed by %s\n", owner);
+        return false;
+    }
+    close(fd);
+    for (int j = 0; j < numOfJobs; j++)
+        read_result(j, &pJobs[j], &pResults[j]);
+    return true;
+}
+
+#endif /* SWEEP_SHARD */
@@ -0,0 +1,28 @@
+/*
+ * sweep_shard.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef SWEEP_SHARD_H_
+#define SWEEP_SHARD_H_
+
+// Directory shared by the processes of a sweep (SWEEP_SHARD), on a filesystem all of them see:
+//   jobs.txt                 the sweep points, with the seed and the agent snapshot of the sweep
+//   agents.<host>.<pid>.bin  the agent snapshot and the hop clocks of the piconets, written by the process that
+//                            created jobs.txt
+//   claims/<job>             "<host> <pid>" of the process running the job, touched every SHARD_HEARTBEAT_SEC
+//   results/<job>            the totals of the job
+//   merged                   "<host> <pid>" of the process that printed the sweep to its pcol
+#define SHARD_DIR "sweep_shard"
+#define SHARD_VERSION 2
+#define SHARD_HEARTBEAT_SEC 10
+// A claim not touched for this long belongs to a process that is gone, and its job is run again.
+#define SHARD_STALE_SEC 60
+// Wait between two looks at the jobs claimed by other processes.
+#define SHARD_POLL_SEC 2
+
+extern bool shard_run(S_SWEEP_JOB *pJobs, int numOfJobs, Agent *pSnapshot, unsigned int *pSeed, S_SWEEP_RESULT *pResults);
+
+#endif /* SWEEP_SHARD_H_ */
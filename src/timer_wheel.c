@@ -0,0 +1,156 @@
+/*
+ * Hierarchical timer wheel.
+ *
+ * Level 0 holds the next 256 ticks, one bucket per tick. Level 1 holds the following 64 blocks of
+ * 256 ticks and is cascaded into level 0 when a block starts; anything later waits in an overflow
+ * list that is redistributed every 64 blocks. timer_wheel_advance() at the start of an episode fires
+ * every event due up to that episode, so the agents only look at flags set by their own events.
+ *
+ * Events come from a fixed pool. A handler that re-arms a timer passes a new generation number and
+ * ignores events carrying an old one, so nothing has to be removed from a bucket.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "timer_wheel.h"
+
+#ifdef TIMER_WHEEL
+
+#define TW_LEVEL0_SIZE (1 << TW_LEVEL0_BITS)
+#define TW_LEVEL1_SIZE (1 << TW_LEVEL1_BITS)
+#define TW_NONE (-1)
+
+typedef struct
+{
+    int tick;
+    int id;
+    uint32_t gen;
+    uint8_t type;
+    int next;
+} S_TW_EVENT;
+
+static DFH_TLS S_TW_EVENT gTwEvents[TW_MAX_EVENTS];
+static DFH_TLS int gTwFree;
+static DFH_TLS int gTwLevel0[TW_LEVEL0_SIZE];
+static DFH_TLS int gTwLevel1[TW_LEVEL1_SIZE];
+static DFH_TLS int gTwOverflow;
+static DFH_TLS int gTwTick; // Last tick processed
+static DFH_TLS FP_TW_HANDLER gTwHandlers[TW_EVT_MAX];
+
+static void insert_event(int ev)
+{
+    S_TW_EVENT *pEvent = &gTwEvents[ev];
+    int delta;
+    int *pHead;
+
+    if (pEvent->tick <= gTwTick)
+        pEvent->tick = gTwTick + 1;
+
+    // Level 1 buckets are cascaded when their block starts, so the block must start within 64 blocks.
+    delta = pEvent->tick - gTwTick;
+    if (delta <= TW_LEVEL0_SIZE)
+        pHead = &gTwLevel0[pEvent->tick & (TW_LEVEL0_SIZE - 1)];
+    else if ((pEvent->tick & ~(TW_LEVEL0_SIZE - 1)) - gTwTick <= TW_LEVEL0_SIZE * TW_LEVEL1_SIZE)
+        pHead = &gTwLevel1[(pEvent->tick >> TW_LEVEL0_BITS) & (TW_LEVEL1_SIZE - 1)];
+    else
+        pHead = &gTwOverflow;
+
+    pEvent->next = *pHead;
+    *pHead = ev;
+}
+
+// Re-inserts every event of the list relative to the current tick.
+static void redistribute(int *pHead)
+{
+    int ev = *pHead;
+    int next;
+
+    *pHead = TW_NONE;
+    for (; ev != TW_NONE; ev = next)
+    {
+        next = gTwEvents[ev].next;
+        insert_event(ev);
+    }
+}
+
+void timer_wheel_reset(int current_time)
+{
+    for (int i = 0; i < TW_LEVEL0_SIZE; i++)
+        gTwLevel0[i] = TW_NONE;
+    for (int i = 0; i < TW_LEVEL1_SIZE; i++)
+        gTwLevel1[i] = TW_NONE;
+    gTwOverflow = TW_NONE;
+
+    for (int i = 0; i < TW_MAX_EVENTS - 1; i++)
+        gTwEvents[i].next = i + 1;
+    gTwEvents[TW_MAX_EVENTS - 1].next = TW_NONE;
+    gTwFree = 0;
+
+    // Events due at current_time fire on the next advance.
+    gTwTick = current_time / TW_TICK_SLOTS - 1;
+}
+
+void timer_wheel_register(E_TW_EVENT type, FP_TW_HANDLER handler)
+{
+    gTwHandlers[type] = handler;
+}
+
+// Fires at the first episode whose current_time >= time.
+void timer_wheel_schedule(E_TW_EVENT type, int id, int time, uint32_t gen)
+{
+    int ev = gTwFree;
+
+    if (ev == TW_NONE)
+    {
+        printf("timer wheel: out of events (%d). Exiting.\n", TW_MAX_EVENTS);
+        exit(777);
+    }
+    gTwFree = gTwEvents[ev].next;
+
+    gTwEvents[ev].tick = (time + TW_TICK_SLOTS - 1) / TW_TICK_SLOTS;
+    gTwEvents[ev].id = id;
+    gTwEvents[ev].gen = gen;
+    gTwEvents[ev].type = type;
+    insert_event(ev);
+}
+
+void timer_wheel_advance(int current_time)
+{
+    int last = current_time / TW_TICK_SLOTS;
+    int ev, next;
+    S_TW_EVENT stEvent;
+
+    while (gTwTick < last)
+    {
+        // Cascade before the tick counts as processed, so events of this very tick land in level 0.
+        if (((gTwTick + 1) & (TW_LEVEL0_SIZE - 1)) == 0)
+        {
+            if ((((gTwTick + 1) >> TW_LEVEL0_BITS) & (TW_LEVEL1_SIZE - 1)) == 0)
+                redistribute(&gTwOverflow);
+            redistribute(&gTwLevel1[((gTwTick + 1) >> TW_LEVEL0_BITS) & (TW_LEVEL1_SIZE - 1)]);
+        }
+        gTwTick++;
+
+        ev = gTwLevel0[gTwTick & (TW_LEVEL0_SIZE - 1)];
+        gTwLevel0[gTwTick & (TW_LEVEL0_SIZE - 1)] = TW_NONE;
+        for (; ev != TW_NONE; ev = next)
+        {
+            next = gTwEvents[ev].next;
+            stEvent = gTwEvents[ev];
+
+            // Back to the pool first, the handler may schedule the next event.
+            gTwEvents[ev].next = gTwFree;
+            gTwFree = ev;
+
+            if (gTwHandlers[stEvent.type] != NULL)
+                gTwHandlers[stEvent.type](stEvent.id, gTwTick * TW_TICK_SLOTS, stEvent.gen);
+        }
+    }
+}
+
+#endif /* TIMER_WHEEL */
@@ -0,0 +1,34 @@
+/*
+ * timer_wheel.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+// One tick is one episode (2 slots).
+#define TW_TICK_SLOTS 2
+#define TW_LEVEL0_BITS 8 // 256 ticks
+#define TW_LEVEL1_BITS 6 // 64 x 256 ticks, later events wait in an overflow list
+#define TW_MAX_EVENTS (MAX_PICONNETS * 8 + 64)
+
+typedef enum
+{
+    TW_EVT_DFH_INSTANCE = 0, // instance_time of an RL agent
+    TW_EVT_MAP_REFRESH,      // 2-second AFH channel map update of a piconet
+    TW_EVT_WIFI,             // WiFi on (id 1) / off (id 0)
+    TW_EVT_SDU_ARRIVAL,      // Next SDU of a piconet (TRAFFIC)
+    TW_EVT_MAX
+} E_TW_EVENT;
+
+// Called with the current_time of the episode the event fires in and the generation given to timer_wheel_schedule.
+typedef void (*FP_TW_HANDLER)(int id, int time, uint32_t gen);
+
+extern void timer_wheel_reset(int current_time);
+extern void timer_wheel_register(E_TW_EVENT type, FP_TW_HANDLER handler);
+extern void timer_wheel_schedule(E_TW_EVENT type, int id, int time, uint32_t gen);
+extern void timer_wheel_advance(int current_time);
+
+#endif /* TIMER_WHEEL_H_ */
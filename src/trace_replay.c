@@ -0,0 +1,118 @@
+/*
+ * Trace-driven interference replay.
+ *
+ * TRACE_REPLAY_FILE holds the busy channels of every slot of a recorded capture (see
+ * tools/trace_convert.c). The file is never read into memory: a window of TRACE_WINDOW_SLOTS records is
+ * mapped read-only and moved along with current_time, so traces larger than RAM replay from the page
+ * cache and the collision check reads the record in place. A trace shorter than the run wraps around.
+ *
+ * An episode collides with the trace if either of its two slots is busy on the channel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "trace_replay.h"
+
+#ifdef TRACE_REPLAY
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef WIFI
+#error "TRACE_REPLAY feeds the external interference check of WIFI."
+#endif
+
+uint64_t gTraceMask[2];
+
+static int gTraceFd = -1;
+static uint64_t gNumOfTraceSlots;
+static uint8_t *gpTraceMap;
+static size_t gTraceMapLen;
+static const S_TRACE_RECORD *gpTraceWin;
+static uint64_t gTraceWinFirst, gTraceWinSlots;
+
+void trace_open(void)
+{
+    S_TRACE_HEADER stHeader;
+    struct stat st;
+
+    if (gTraceFd >= 0)
+        return;
+
+    gTraceFd = open(TRACE_REPLAY_FILE, O_RDONLY);
+    if (gTraceFd < 0)
+    {
+        printf("Can't open trace %s. Exiting.\n", TRACE_REPLAY_FILE);
+        exit(777);
+    }
+    if (read(gTraceFd, &stHeader, sizeof(stHeader)) != sizeof(stHeader) || stHeader.magic != TRACE_MAGIC || stHeader.version != TRACE_VERSION || stHeader.numOfSlots == 0)
+    {
+        printf("%s is not a version %d trace. Exiting.\n", TRACE_REPLAY_FILE, TRACE_VERSION);
+        exit(777);
+    }
+    if (fstat(gTraceFd, &st) != 0 || (uint64_t)st.st_size < sizeof(stHeader) + stHeader.numOfSlots * sizeof(S_TRACE_RECORD))
+    {
+        printf("%s is shorter than its %llu slots. Exiting.\n", TRACE_REPLAY_FILE, (unsigned long long)stHeader.numOfSlots);
+        exit(777);
+    }
+    gNumOfTraceSlots = stHeader.numOfSlots;
+}
+
+static void map_window(uint64_t slot)
+{
+    uint64_t offset = sizeof(S_TRACE_HEADER) + slot * sizeof(S_TRACE_RECORD);
+    uint64_t aligned = offset & ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+    void *pMap;
+
+    if (gpTraceMap != NULL)
+        munmap(gpTraceMap, gTraceMapLen);
+
+    gTraceWinFirst = slot;
+    gTraceWinSlots = gNumOfTraceSlots - slot;
+    if (gTraceWinSlots > TRACE_WINDOW_SLOTS)
+        gTraceWinSlots = TRACE_WINDOW_SLOTS;
+    gTraceMapLen = (offset - aligned) + gTraceWinSlots * sizeof(S_TRACE_RECORD);
+
+    pMap = mmap(NULL, gTraceMapLen, PROT_READ, MAP_SHARED, gTraceFd, aligned);
+    if (pMap == MAP_FAILED)
+    {
+        printf("Can't map %s at slot %llu. Exiting.\n", TRACE_REPLAY_FILE, (unsigned long long)slot);
+        exit(777);
+    }
+    // Read ahead; pages behind the window are dropped with it.
+    madvise(pMap, gTraceMapLen, MADV_SEQUENTIAL);
+
+    gpTraceMap = pMap;
+    gpTraceWin = (const S_TRACE_RECORD *)(gpTraceMap + (offset - aligned));
+}
+
+static const S_TRACE_RECORD *trace_record(uint64_t slot)
+{
+    slot %= gNumOfTraceSlots;
+    if (gpTraceMap == NULL || slot < gTraceWinFirst || slot >= gTraceWinFirst + gTraceWinSlots)
+        map_window(slot);
+
+    return &gpTraceWin[slot - gTraceWinFirst];
+}
+
+// Called once per episode, before the agents hop.
+void trace_seek(int current_time)
+{
+    const S_TRACE_RECORD *pRecord = trace_record(current_time);
+
+    gTraceMask[0] = pRecord->mask[0];
+    gTraceMask[1] = pRecord->mask[1];
+
+    // The return slot may sit in the next window; the first record has been copied already.
+    pRecord = trace_record(current_time + 1);
+    gTraceMask[0] |= pRecord->mask[0];
+    gTraceMask[1] |= pRecord->mask[1];
+}
+
+#endif /* TRACE_REPLAY */
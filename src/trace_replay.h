@@ -0,0 +1,44 @@
+/*
+ * trace_replay.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef TRACE_REPLAY_H_
+#define TRACE_REPLAY_H_
+
+// Binary trace written by tools/trace_convert: a header, then one record per slot.
+#define TRACE_REPLAY_FILE "trace.bin"
+#define TRACE_MAGIC 0x54484644 // "DFHT"
+#define TRACE_VERSION 1
+// Slots of the trace mapped at a time (16 bytes each).
+#define TRACE_WINDOW_SLOTS (1 << 20)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t numOfSlots;
+} S_TRACE_HEADER;
+
+// Record of a slot: bit (channel - 1) of mask[2] is set for a busy channel.
+typedef struct
+{
+    uint64_t mask[2];
+} S_TRACE_RECORD;
+
+#ifdef TRACE_REPLAY
+// Busy channels of the two slots of the current episode.
+extern uint64_t gTraceMask[2];
+
+extern void trace_open(void);
+extern void trace_seek(int current_time);
+
+static inline bool trace_blocked(int channel)
+{
+    return (gTraceMask[(channel - 1) >> 6] >> ((channel - 1) & 63)) & 1;
+}
+#endif
+
+#endif /* TRACE_REPLAY_H_ */
@@ -0,0 +1,249 @@
+/*
+ * Packet-level traffic on top of the slot loop.
+ *
+ * Every piconet receives SDUs of its codec profile into data_queue, segments the SDU at the head
+ * into 3-DH1/3/5 PDUs in tx_queue, and sends the PDU at the head of tx_queue. A piconet with nothing
+ * to send is idle (transmitting == false): calculate_reward() neither counts it as an interferer nor
+ * gives it a collision. The outcome of a slot is known at the agent's next turn, the same moment the
+ * Q-table learns it, and a collided PDU is sent again. Both queues are fixed rings in Queue, so the
+ * engine does not allocate.
+ *
+ * One episode is one master/slave slot pair (1.25 ms). A 3-DH3 PDU occupies two episodes and a
+ * 3-DH5 PDU three; it fails if any of them collides.
+ *
+ * With TIMER_WHEEL the SDU arrivals are events, and traffic_start() only segments and sends.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "afh.h"
+#include "marl.h"
+#include "marl_diffusion.h"
+#include "traffic.h"
+#include "timer_wheel.h"
+
+#ifdef TRAFFIC
+
+extern DFH_TLS int episode;
+
+const S_CODEC_PROFILE gCodecProfiles[TRAFFIC_CODEC_MAX] = {
+    {"SBC", 14.5, 595},
+    {"LDAC", 7.5, 930},
+    {"VBR", 23.219, 639},
+    {"CONSTANT", 1.25, 83},
+};
+
+// 3-DH1, 3-DH3, 3-DH5
+static const int gPduSizes[3] = {83, 552, 1021};
+static const int gPduEpisodes[3] = {1, 2, 3};
+
+// Totals of the statistics window that Queue only keeps per second.
+static DFH_TLS double gMaxDelay[MAX_PICONNETS + 1];
+static DFH_TLS double gBytesDelivered[MAX_PICONNETS + 1];
+static DFH_TLS int gWindowStart;
+
+static void segment_sdu(Queue *pQ)
+{
+    DataPacket *pSdu = &(pQ->data_queue[pQ->data_queue_front]);
+    DataPacket *pPdu;
+    int remaining = pSdu->size;
+    int type;
+
+    while (remaining > 0 && pQ->tx_queue_size < TRAFFIC_TX_Q)
+    {
+        // Smallest packet type that carries the rest, else the largest one.
+        type = (remaining > gPduSizes[1]) ? 2 : ((remaining > gPduSizes[0]) ? 1 : 0);
+
+        pPdu = &(pQ->tx_queue[(pQ->tx_queue_index + pQ->tx_queue_size) % TRAFFIC_TX_Q]);
+        pPdu->type = type;
+        pPdu->size = (remaining < gPduSizes[type]) ? remaining : gPduSizes[type];
+        pPdu->arrival_time = pSdu->arrival_time;
+        pPdu->sdu_generation_time = pSdu->sdu_generation_time;
+        pPdu->remaining_time = gPduEpisodes[type];
+        pPdu->collision = false;
+        pPdu->channel = 0;
+        pQ->tx_queue_size++;
+
+        remaining -= pPdu->size;
+    }
+
+    pQ->data_queue_front = (pQ->data_queue_front + 1) % MAX_DATA_Q;
+    pQ->data_queue_size--;
+}
+
+// Moves the SDUs that have arrived by current_time into data_queue.
+static void receive_sdus(Queue *pQ, int current_time)
+{
+    const S_CODEC_PROFILE *pCodec = &gCodecProfiles[TRAFFIC_CODEC];
+    double now = current_time * TRAFFIC_SLOT_MS;
+    DataPacket *pSdu;
+
+    while (pQ->next_arrival_time <= now)
+    {
+        pQ->numOfSduGenerated++;
+        if (pQ->data_queue_size == MAX_DATA_Q)
+        {
+            pQ->numOfLossDueToQdelay++;
+        }
+        else
+        {
+            pSdu = &(pQ->data_queue[pQ->data_queue_rear]);
+            pSdu->size = pCodec->size;
+            pSdu->arrival_time = pQ->next_arrival_time;
+            pSdu->sdu_generation_time = pQ->next_arrival_time;
+            pQ->data_queue_rear = (pQ->data_queue_rear + 1) % MAX_DATA_Q;
+            pQ->data_queue_size++;
+        }
+        pQ->next_arrival_time += pCodec->interval;
+    }
+}
+
+#ifdef TIMER_WHEEL
+static void schedule_arrival(int id)
+{
+    // One slot early against rounding; an event that finds nothing due is re-armed for the next episode.
+    timer_wheel_schedule(TW_EVT_SDU_ARRIVAL, id, (int)(piconet_queues[id].next_arrival_time / TRAFFIC_SLOT_MS) - 1, 0);
+}
+
+static void on_sdu_arrival(int id, int current_time, uint32_t gen)
+{
+    receive_sdus(&(piconet_queues[id]), current_time);
+    schedule_arrival(id);
+}
+#endif
+
+void traffic_reset(int num_agents)
+{
+    Queue *pQ;
+
+    for (int i = 1; i <= num_agents; i++)
+    {
+        pQ = &(piconet_queues[i]);
+        pQ->data_queue_front = 0;
+        pQ->data_queue_rear = 0;
+        pQ->data_queue_size = 0;
+        pQ->tx_queue_size = 0;
+        pQ->tx_queue_index = 0;
+        pQ->transmitting = false;
+        // Same first arrival as main(): the start clock staggers the codecs of the piconets.
+        pQ->next_arrival_time = pQ->startClock * TRAFFIC_SLOT_MS;
+#ifdef TIMER_WHEEL
+        schedule_arrival(i);
+#endif
+    }
+#ifdef TIMER_WHEEL
+    timer_wheel_register(TW_EVT_SDU_ARRIVAL, on_sdu_arrival);
+#endif
+    traffic_reset_stats(num_agents);
+}
+
+void traffic_reset_stats(int num_agents)
+{
+    Queue *pQ;
+
+    for (int i = 1; i <= num_agents; i++)
+    {
+        pQ = &(piconet_queues[i]);
+        pQ->numOfSduGenerated = 0;
+        pQ->numOfLossDueToQdelay = 0;
+        pQ->avgDelay = 0;
+        pQ->avgDelayInSec = 0;
+        pQ->numOfSdus = 0;
+        pQ->numOfSdusPerSec = 0;
+        pQ->collisions = 0;
+        pQ->collisionsPerSec = 0;
+        pQ->total_transmissions = 0;
+        pQ->numOfTxPerSec = 0;
+        pQ->maxDelayPerSec = 0;
+        gMaxDelay[i] = 0;
+        gBytesDelivered[i] = 0;
+    }
+    gWindowStart = episode;
+}
+
+// Called at the agent's turn, after it has chosen the channel of this episode.
+void traffic_start(int id, int current_time)
+{
+    Queue *pQ = &(piconet_queues[id]);
+
+    // Per-second counters restart on every second of simulated time.
+    if (current_time % 1600 == 0)
+    {
+        pQ->numOfSdusPerSec = 0;
+        pQ->collisionsPerSec = 0;
+        pQ->numOfTxPerSec = 0;
+        pQ->maxDelayPerSec = 0;
+    }
+
+#ifndef TIMER_WHEEL
+    receive_sdus(pQ, current_time);
+#endif
+
+    if (pQ->tx_queue_size == 0 && pQ->data_queue_size > 0)
+        segment_sdu(pQ);
+
+    pQ->transmitting = (pQ->tx_queue_size > 0);
+}
+
+// Outcome of the slot sent in the previous episode. Returns false if the piconet was idle.
+bool traffic_complete(int id, bool bCollided, int current_time)
+{
+    Queue *pQ = &(piconet_queues[id]);
+    DataPacket *pPdu;
+    double delay;
+
+    if (pQ->transmitting == false)
+        return false;
+
+    pPdu = &(pQ->tx_queue[pQ->tx_queue_index]);
+    pPdu->collision |= bCollided;
+    if (--pPdu->remaining_time > 0)
+        return true;
+
+    pQ->total_transmissions++;
+    pQ->numOfTxPerSec++;
+    if (pPdu->collision)
+    {
+        // NAK: send the same PDU again.
+        pQ->collisions++;
+        pQ->collisionsPerSec++;
+        pPdu->remaining_time = gPduEpisodes[pPdu->type];
+        pPdu->collision = false;
+        return true;
+    }
+
+    gBytesDelivered[id] += pPdu->size;
+    pQ->tx_queue_index = (pQ->tx_queue_index + 1) % TRAFFIC_TX_Q;
+    pQ->tx_queue_size--;
+
+    if (pQ->tx_queue_size == 0)
+    {
+        // Last segment acknowledged: the SDU is delivered.
+        delay = current_time * TRAFFIC_SLOT_MS - pPdu->arrival_time;
+        pQ->numOfSdus++;
+        pQ->numOfSdusPerSec++;
+        pQ->avgDelay += (delay - pQ->avgDelay) / pQ->numOfSdus;
+        if (delay > pQ->maxDelayPerSec)
+            pQ->maxDelayPerSec = delay;
+        if (delay > gMaxDelay[id])
+            gMaxDelay[id] = delay;
+    }
+
+    return true;
+}
+
+void traffic_report(FILE *fp, const char *prefix, int num_agents)
+{
+    Queue *pQ;
+    double seconds = (episode - gWindowStart) * 2 * TRAFFIC_SLOT_MS / 1000.0;
+
+    for (int i = 1; i <= num_agents; i++)
+    {
+        pQ = &(piconet_queues[i]);
+        fprintf(fp, "\n%s %d %d %d %.0f %f %f %f %d %d", prefix, i, pQ->numOfSduGenerated, pQ->numOfSdus, pQ->numOfLossDueToQdelay, pQ->avgDelay, gMaxDelay[i], (seconds > 0) ? gBytesDelivered[i] * 8 / 1000.0 / seconds : 0, pQ->total_transmissions, pQ->collisions);
+    }
+}
+
+#endif /* TRAFFIC */
@@ -0,0 +1,38 @@
+/*
+ * traffic.h
+ *
+ * Created on: 2026. 10. 19.
+ * Author: widen
+ */
+
+#ifndef TRAFFIC_H_
+#define TRAFFIC_H_
+
+#define TRAFFIC_CODEC_SBC 0      // 14.5 ms, 595 bytes
+#define TRAFFIC_CODEC_LDAC 1     // 7.5 ms, 930 bytes
+#define TRAFFIC_CODEC_VBR 2      // 23.219 ms, 639 bytes
+#define TRAFFIC_CODEC_CONSTANT 3 // 1.25 ms, 83 bytes
+#define TRAFFIC_CODEC_MAX 4
+
+// Codec profile of every piconet.
+#define TRAFFIC_CODEC TRAFFIC_CODEC_SBC
+#define TRAFFIC_SLOT_MS 0.625
+// Size of the PDU ring (tx_queue) of a piconet.
+#define TRAFFIC_TX_Q 30
+
+typedef struct
+{
+    const char *name;
+    double interval; // SDU arrival interval (ms)
+    int size;        // SDU size (bytes)
+} S_CODEC_PROFILE;
+
+extern const S_CODEC_PROFILE gCodecProfiles[TRAFFIC_CODEC_MAX];
+
+extern void traffic_reset(int num_agents);
+extern void traffic_reset_stats(int num_agents);
+extern void traffic_start(int id, int current_time);
+extern bool traffic_complete(int id, bool bCollided, int current_time);
+extern void traffic_report(FILE *fp, const char *prefix, int num_agents);
+
+#endif /* TRAFFIC_H_ */
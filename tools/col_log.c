@@ -0,0 +1,288 @@
+/*
+ * Reads the collision logs written by COLLISION_LOG (src/collision_log.h).
+ *
+ *   col_log <collog_*.bin> info
+ *   col_log <collog_*.bin> rate <first> <last> [<agent>...]  collision rate of each agent over the episodes
+ *   col_log <collog_*.bin> window <size> [<agent>]           rate of the agent (all agents) per window
+ *   col_log <collog_*.bin> streaks <agent> [<min>]           collided episodes in a row: first episode, length
+ *   col_log <collog_*.bin> bits <agent> <first> <last>       one 0/1 per episode
+ *
+ * Episodes count from 1, perturbation included, and windows are inclusive. The log is mapped and only
+ * the blocks a window cuts are read bit by bit: the collisions of the blocks it covers come from the
+ * index. A log without an index (a run that did not finish) is read up to its last whole block.
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/collision_log.h"
+
+static S_COLLOG_HEADER gstHeader;
+static const uint8_t *gpData;    // Block 0
+static const uint32_t *gpIndex;  // NULL without an index
+static uint64_t gNumOfEpisodes;
+static uint64_t gRowWords;       // 64-bit words of the row of an agent in a block
+
+static void map_log(const char *pPath)
+{
+    const uint8_t *pMap;
+    uint64_t numOfBlocks;
+    struct stat st;
+    int fd = open(pPath, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(S_COLLOG_HEADER))
+    {
+        printf("col_log: can't read %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+    {
+        printf("col_log: can't map %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    memcpy(&gstHeader, pMap, sizeof(gstHeader));
+    if (gstHeader.magic != COLLOG_MAGIC || gstHeader.version != COLLOG_VERSION || gstHeader.numOfAgents == 0 ||
+        gstHeader.blockEpisodes == 0 || gstHeader.blockEpisodes % 64 != 0)
+    {
+        printf("col_log: %s is not a collision log of version %d. Exiting.\n", pPath, COLLOG_VERSION);
+        exit(777);
+    }
+    gpData = pMap + sizeof(S_COLLOG_HEADER);
+    gRowWords = gstHeader.blockEpisodes / 64;
+
+    numOfBlocks = (st.st_size - sizeof(S_COLLOG_HEADER)) / COLLOG_BLOCK_BYTES(gstHeader.numOfAgents, gstHeader.blockEpisodes);
+    if (gstHeader.indexOffset != 0)
+    {
+        numOfBlocks = (gstHeader.numOfEpisodes + gstHeader.blockEpisodes - 1) / gstHeader.blockEpisodes;
+        if (gstHeader.indexOffset + numOfBlocks * gstHeader.numOfAgents * sizeof(uint32_t) > (uint64_t)st.st_size)
+        {
+            printf("col_log: the index of %s is cut. Exiting.\n", pPath);
+            exit(777);
+        }
+        gpIndex = (const uint32_t *)(pMap + gstHeader.indexOffset);
+        gNumOfEpisodes = gstHeader.numOfEpisodes;
+    }
+    else
+        gNumOfEpisodes = numOfBlocks * gstHeader.blockEpisodes;
+}
+
+static const uint64_t *row(int agent, uint64_t block)
+{
+    return (const uint64_t *)(gpData + block * COLLOG_BLOCK_BYTES(gstHeader.numOfAgents, gstHeader.blockEpisodes)) + (uint64_t)(agent - 1) * gRowWords;
+}
+
+static bool bit(int agent, uint64_t episode)
+{
+    uint64_t k = episode - 1;
+    const uint64_t *pRow = row(agent, k / gstHeader.blockEpisodes);
+
+    k %= gstHeader.blockEpisodes;
+    return (pRow[k / 64] >> (k % 64)) & 1;
+}
+
+// Set bits lo .. hi (inclusive) of a row.
+static uint64_t count_row(const uint64_t *pRow, uint64_t lo, uint64_t hi)
+{
+    uint64_t count = 0, word;
+
+    for (uint64_t w = lo / 64; w <= hi / 64; w++)
+    {
+        word = pRow[w];
+        if (w == lo / 64)
+            word &= ~0ULL << (lo % 64);
+        if (w == hi / 64 && hi % 64 != 63)
+            word &= (1ULL << (hi % 64 + 1)) - 1;
+        count += __builtin_popcountll(word);
+    }
+    return count;
+}
+
+// Collisions of the agent in episodes first .. last.
+static uint64_t count_collisions(int agent, uint64_t first, uint64_t last)
+{
+    uint64_t be = gstHeader.blockEpisodes, count = 0, lo, hi;
+
+    for (uint64_t b = (first - 1) / be; b <= (last - 1) / be; b++)
+    {
+        lo = (b * be + 1 < first) ? first - b * be - 1 : 0;
+        hi = ((b + 1) * be > last) ? last - b * be - 1 : be - 1;
+        if (gpIndex != NULL && lo == 0 && hi == be - 1)
+            count += gpIndex[b * gstHeader.numOfAgents + agent - 1];
+        else
+            count += count_row(row(agent, b), lo, hi);
+    }
+    return count;
+}
+
+static int parse_agent(const char *pArg)
+{
+    int agent = atoi(pArg);
+
+    if (agent < 1 || agent > (int)gstHeader.numOfAgents)
+    {
+        printf("col_log: no agent %s in the log (1 .. %u). Exiting.\n", pArg, gstHeader.numOfAgents);
+        exit(777);
+    }
+    return agent;
+}
+
+static void parse_window(const char *pFirst, const char *pLast, uint64_t *pFirstEp, uint64_t *pLastEp)
+{
+    *pFirstEp = strtoull(pFirst, NULL, 10);
+    *pLastEp = strtoull(pLast, NULL, 10);
+    if (*pFirstEp < 1 || *pFirstEp > *pLastEp || *pLastEp > gNumOfEpisodes)
+    {
+        printf("col_log: episodes %s .. %s are not in the log (1 .. %llu). Exiting.\n", pFirst, pLast, (unsigned long long)gNumOfEpisodes);
+        exit(777);
+    }
+}
+
+static void print_info(void)
+{
+    uint64_t total = 0;
+
+    for (int a = 1; a <= (int)gstHeader.numOfAgents; a++)
+        total += count_collisions(a, 1, gNumOfEpisodes);
+    printf("agents %u episodes %llu block %u%s\n", gstHeader.numOfAgents, (unsigned long long)gNumOfEpisodes, gstHeader.blockEpisodes,
+           gpIndex ? "" : " (no index: the run did not finish)");
+    printf("collisions %llu rate %f\n", (unsigned long long)total, gNumOfEpisodes ? total * 1.0 / gstHeader.numOfAgents / gNumOfEpisodes : 0.0);
+}
+
+static void print_rates(uint64_t first, uint64_t last, int argc, char *argv[])
+{
+    uint64_t total = 0, count;
+    int numOfAgents = (argc > 0) ? argc : (int)gstHeader.numOfAgents;
+    int agent;
+
+    for (int a = 0; a < numOfAgents; a++)
+    {
+        agent = (argc > 0) ? parse_agent(argv[a]) : a + 1;
+        count = count_collisions(agent, first, last);
+        total += count;
+        printf("%d\t%llu\t%f\n", agent, (unsigned long long)count, count * 1.0 / (last - first + 1));
+    }
+    printf("mean\t%llu\t%f\n", (unsigned long long)total, total * 1.0 / numOfAgents / (last - first + 1));
+}
+
+static void print_windows(uint64_t size, int agent)
+{
+    uint64_t count, last;
+
+    if (size < 1)
+    {
+        printf("col_log: windows of at least one episode. Exiting.\n");
+        exit(777);
+    }
+    for (uint64_t first = 1; first <= gNumOfEpisodes; first += size)
+    {
+        last = (first + size - 1 < gNumOfEpisodes) ? first + size - 1 : gNumOfEpisodes;
+        count = 0;
+        if (agent > 0)
+            count = count_collisions(agent, first, last);
+        else
+        {
+            for (int a = 1; a <= (int)gstHeader.numOfAgents; a++)
+                count += count_collisions(a, first, last);
+        }
+        printf("%llu\t%llu\t%f\n", (unsigned long long)first, (unsigned long long)last,
+               count * 1.0 / (last - first + 1) / (agent > 0 ? 1 : gstHeader.numOfAgents));
+    }
+}
+
+// Runs of set bits, skipping the words with none when no run is open and the full ones inside a run.
+static void print_streaks(int agent, uint64_t min)
+{
+    uint64_t be = gstHeader.blockEpisodes, numOfBlocks = (gNumOfEpisodes + be - 1) / be;
+    uint64_t start = 0, length = 0, numOfStreaks = 0, longest = 0, base, word;
+    const uint64_t *pRow;
+
+    for (uint64_t b = 0; b < numOfBlocks; b++)
+    {
+        pRow = row(agent, b);
+        for (uint64_t w = 0; w < gRowWords; w++)
+        {
+            base = b * be + w * 64 + 1;
+            if (base > gNumOfEpisodes)
+                break;
+            word = pRow[w];
+            if ((length == 0 && word == 0) || (length > 0 && word == ~0ULL && base + 63 <= gNumOfEpisodes))
+            {
+                length += (word != 0) ? 64 : 0;
+                continue;
+            }
+            for (uint64_t k = 0; k < 64 && base + k <= gNumOfEpisodes; k++)
+            {
+                if ((word >> k) & 1)
+                {
+                    if (length++ == 0)
+                        start = base + k;
+                    continue;
+                }
+                if (length >= min && length > 0)
+                {
+                    printf("%llu\t%llu\n", (unsigned long long)start, (unsigned long long)length);
+                    numOfStreaks++;
+                }
+                longest = (length > longest) ? length : longest;
+                length = 0;
+            }
+        }
+    }
+    if (length >= min && length > 0)
+    {
+        printf("%llu\t%llu\n", (unsigned long long)start, (unsigned long long)length);
+        numOfStreaks++;
+    }
+    longest = (length > longest) ? length : longest;
+    printf("# agent %d: %llu streaks of at least %llu, longest %llu\n", agent, (unsigned long long)numOfStreaks, (unsigned long long)(min ? min : 1),
+           (unsigned long long)longest);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t first, last;
+
+    if (argc < 3)
+    {
+        printf("usage: col_log <collog_*.bin> info | rate <first> <last> [<agent>...] | window <size> [<agent>] |\n"
+               "               streaks <agent> [<min>] | bits <agent> <first> <last>\n");
+        return 1;
+    }
+    map_log(argv[1]);
+
+    if (strcmp(argv[2], "info") == 0)
+        print_info();
+    else if (strcmp(argv[2], "rate") == 0 && argc >= 5)
+    {
+        parse_window(argv[3], argv[4], &first, &last);
+        print_rates(first, last, argc - 5, argv + 5);
+    }
+    else if (strcmp(argv[2], "window") == 0 && argc >= 4)
+        print_windows(strtoull(argv[3], NULL, 10), (argc >= 5) ? parse_agent(argv[4]) : 0);
+    else if (strcmp(argv[2], "streaks") == 0 && argc >= 4)
+        print_streaks(parse_agent(argv[3]), (argc >= 5) ? strtoull(argv[4], NULL, 10) : 1);
+    else if (strcmp(argv[2], "bits") == 0 && argc == 6)
+    {
+        int agent = parse_agent(argv[3]);
+
+        parse_window(argv[4], argv[5], &first, &last);
+        for (uint64_t e = first; e <= last; e++)
+            putchar(bit(agent, e) ? '1' : '0');
+        putchar('\n');
+    }
+    else
+    {
+        printf("col_log: unknown command %s. Exiting.\n", argv[2]);
+        exit(777);
+    }
+    return 0;
+}
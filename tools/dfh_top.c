@@ -0,0 +1,155 @@
+/*
+ * Shows the live counters of the sweeps running with LIVE_STATS (src/live_stats.h).
+ *
+ *   dfh_top [-1] [<pid>...]
+ *
+ * Every second the screen is redrawn with the segment of each pid given, or of every /dev/shm/dfh_live.*
+ * when none is: the sweep point, its episode, the progress and time left, the slot rate, the running pcol,
+ * the resident memory and the mean and last pcol of each mode. -1 prints them once, without clearing the
+ * screen. The segments of processes that are gone (killed sweeps) are removed.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "../src/live_stats.h"
+
+#define DFH_TOP_MAX_SEGMENTS 64
+#define DFH_TOP_RETRIES 1000
+
+static const char *gModeNames[LIVE_STATS_MODES] = {"LFH", "LFH_RL", "AFH", "AFH_RL", "DFH_RL"};
+
+// Copies the segment under its sequence lock. False if the writer kept it busy.
+static bool read_segment(const volatile S_LIVE_STATS *pLive, S_LIVE_STATS *pCopy)
+{
+    uint32_t seq;
+
+    for (int r = 0; r < DFH_TOP_RETRIES; r++)
+    {
+        seq = __atomic_load_n(&pLive->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+            continue;
+        memcpy(pCopy, (const void *)pLive, sizeof(S_LIVE_STATS));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&pLive->seq, __ATOMIC_RELAXED) == seq)
+            return true;
+    }
+    return false;
+}
+
+static void show(int pid)
+{
+    char name[64];
+    const S_LIVE_STATS *pLive;
+    S_LIVE_STATS st;
+    double progress, left;
+    int fd;
+
+    snprintf(name, sizeof(name), LIVE_STATS_NAME, pid);
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        printf("%d: no segment\n\n", pid);
+        return;
+    }
+    pLive = mmap(NULL, sizeof(S_LIVE_STATS), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pLive == MAP_FAILED)
+    {
+        printf("%d: can't map /dev/shm%s\n\n", pid, name);
+        return;
+    }
+    if (!read_segment(pLive, &st) || st.magic != LIVE_STATS_MAGIC || st.version != LIVE_STATS_VERSION)
+    {
+        printf("%d: not a segment of version %d\n\n", pid, LIVE_STATS_VERSION);
+        munmap((void *)pLive, sizeof(S_LIVE_STATS));
+        return;
+    }
+    munmap((void *)pLive, sizeof(S_LIVE_STATS));
+
+    if (kill(pid, 0) != 0 && errno == ESRCH)
+    {
+        printf("%d: exited at point %d of %d after %.0f s, segment removed\n\n", pid, st.point, st.numOfPoints, st.elapsed);
+        shm_unlink(name);
+        return;
+    }
+
+    progress = 0.0;
+    if (st.numOfPoints > 0 && st.episodes > 0)
+        progress = (st.point - 1 + st.episode * 1.0 / st.episodes) / st.numOfPoints;
+    if (st.bDone)
+        progress = 1.0;
+    left = (progress > 0.0) ? st.elapsed * (1.0 - progress) / progress : 0.0;
+
+    printf("%d: point %d/%d %5.1f%%  elapsed %.0f s  left %.0f s%s\n", pid, st.point, st.numOfPoints, progress * 100.0, st.elapsed, left,
+           st.bDone ? "  done" : "");
+    printf("  M%d %s nc %d na %d avail %d hmax %d  episode %d/%d  pcol %f\n", st.mode, (st.mode >= 0 && st.mode < LIVE_STATS_MODES) ? gModeNames[st.mode] : "?",
+           st.nc, st.na, st.avail, st.hmax, st.episode, st.episodes, st.pcol);
+    printf("  %.3g slots/s  %llu slots  rss %.1f MB\n", st.slotsPerSec, (unsigned long long)st.slots, st.rssBytes / 1048576.0);
+    printf("  %-7s %6s %10s %10s\n", "mode", "points", "mean pcol", "last pcol");
+    for (int m = 0; m < LIVE_STATS_MODES; m++)
+    {
+        if (st.pointsDone[m] > 0)
+            printf("  %-7s %6d %10f %10f\n", gModeNames[m], st.pointsDone[m], st.pcolSum[m] / st.pointsDone[m], st.lastPcol[m]);
+    }
+    printf("\n");
+}
+
+// Pids of the segments in /dev/shm.
+static int find_segments(int pids[])
+{
+    struct dirent *pEntry;
+    int numOfPids = 0;
+    DIR *pDir = opendir("/dev/shm");
+
+    if (pDir == NULL)
+        return 0;
+    while ((pEntry = readdir(pDir)) != NULL && numOfPids < DFH_TOP_MAX_SEGMENTS)
+    {
+        if (strncmp(pEntry->d_name, LIVE_STATS_PREFIX, strlen(LIVE_STATS_PREFIX)) == 0)
+            pids[numOfPids++] = atoi(pEntry->d_name + strlen(LIVE_STATS_PREFIX));
+    }
+    closedir(pDir);
+    return numOfPids;
+}
+
+int main(int argc, char *argv[])
+{
+    int pids[DFH_TOP_MAX_SEGMENTS];
+    int numOfPids = 0;
+    bool bOnce = false;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(argv[a], "-1") == 0)
+            bOnce = true;
+        else if (numOfPids < DFH_TOP_MAX_SEGMENTS)
+            pids[numOfPids++] = atoi(argv[a]);
+    }
+
+    for (;;)
+    {
+        int n = numOfPids ? numOfPids : find_segments(pids);
+
+        if (!bOnce)
+            printf("\033[H\033[2J");
+        if (n == 0)
+            printf("dfh_top: no sweep with LIVE_STATS running\n");
+        for (int p = 0; p < n; p++)
+            show(pids[p]);
+        if (bOnce)
+            break;
+        fflush(stdout);
+        sleep(1);
+    }
+    return 0;
+}
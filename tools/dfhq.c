@@ -0,0 +1,654 @@
+/*
+ * Queries the columnar result store written by RESULT_STORE (src/result_store.h).
+ *
+ *   dfhq <store> info
+ *   dfhq <store> rows [<filter>...]              sweep points in the layout of pcol_*.txt
+ *   dfhq <store> agg [by=<col>,...] [<filter>...] n, mean, sd and 95% CI of pcol per group
+ *   dfhq <store> ci [id=<col>] [<filter>...]     the *_ci.txt layouts of processed/
+ *   dfhq <store> import <pcol_*.txt>...          appends pcol files of earlier sweeps
+ *
+ * Columns are run, mode, nc, na, avail, hmax, diff and coexist; a filter is <col>=<v> or <col>=<lo>..<hi>.
+ * ci groups the runs of each sweep point, one column per run in the order they were stored: by mode, nc,
+ * na, avail and hmax as "M4 20 10 20 hmax2 <avg> <ci> <run 1> ...", or by the one column given with id=
+ * as "<id>\t<avg>\t<ci>\t<run 1>...". agg groups by mode, nc, na, avail and hmax unless by= is given.
+ *
+ * The file is mapped and filtered column by column in place, so nothing is parsed or copied but the
+ * matching values.
+ */
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../src/result_store.h"
+
+#define DFHQ_MAX_FILTERS 16
+#define DFHQ_MAX_KEYS STORE_COL_PCOL // run and the int32 columns
+#define DFHQ_LINE 65536
+
+typedef struct
+{
+    uint32_t numOfRows;
+    const int64_t *pRun;
+    const int32_t *pVal[STORE_NUM_INT_COLS];
+    const double *pPcol;
+    const double *pWifi;
+    const float *pAgents;
+} S_DFHQ_BLOCK;
+
+typedef struct
+{
+    int column;
+    int64_t lo, hi;
+} S_DFHQ_FILTER;
+
+typedef struct
+{
+    int numOfKeys;
+    int keys[DFHQ_MAX_KEYS];
+    int64_t *pKeyVals; // numOfKeys values per group
+    long long *pCount;
+    double *pSum, *pSumSq;
+    int numOfGroups, maxGroups;
+    int *pSlots; // Open addressing, -1 when free
+    int numOfSlots;
+} S_DFHQ_GROUPS;
+
+static const char *gColNames[DFHQ_MAX_KEYS] = {"run", "mode", "nc", "na", "avail", "hmax", "diff", "coexist"};
+
+static uint32_t gWidth;
+static S_DFHQ_BLOCK *gpBlocks;
+static int gNumOfBlocks;
+static long long gNumOfRows;
+static uint32_t gMaxBlockRows;
+static S_DFHQ_FILTER gFilters[DFHQ_MAX_FILTERS];
+static int gNumOfFilters;
+
+static void *xmalloc(size_t size)
+{
+    void *p = malloc(size ? size : 1);
+
+    if (p == NULL)
+    {
+        printf("dfhq: out of memory. Exiting.\n");
+        exit(777);
+    }
+    return p;
+}
+
+static int find_column(const char *pName, size_t len)
+{
+    for (int c = 0; c < DFHQ_MAX_KEYS; c++)
+    {
+        if (strlen(gColNames[c]) == len && strncmp(gColNames[c], pName, len) == 0)
+            return c;
+    }
+    printf("dfhq: no column '%.*s'. Exiting.\n", (int)len, pName);
+    exit(777);
+}
+
+static inline int64_t key_value(const S_DFHQ_BLOCK *pBlock, int column, uint32_t r)
+{
+    return (column == STORE_COL_RUN) ? pBlock->pRun[r] : pBlock->pVal[column - STORE_COL_MODE][r];
+}
+
+// Maps the store and finds its blocks. A partial block at the end (a sweep still running) is left out.
+static void map_store(const char *pPath)
+{
+    const S_STORE_HEADER *pHeader;
+    const S_STORE_BLOCK *pBlock;
+    const uint8_t *pMap;
+    S_DFHQ_BLOCK *pView;
+    uint64_t offset;
+    struct stat st;
+    int fd = open(pPath, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(S_STORE_HEADER))
+    {
+        printf("dfhq: can't read %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    pMap = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED)
+    {
+        printf("dfhq: can't map %s. Exiting.\n", pPath);
+        exit(777);
+    }
+    pHeader = (const S_STORE_HEADER *)pMap;
+    if (pHeader->magic != STORE_MAGIC || pHeader->version != STORE_VERSION)
+    {
+        printf("dfhq: %s is not a result store of version %d. Exiting.\n", pPath, STORE_VERSION);
+        exit(777);
+    }
+    gWidth = pHeader->width;
+
+    // Blocks hold at least one row, so there are fewer blocks than 8-byte words.
+    gpBlocks = xmalloc((st.st_size / 8) * sizeof(S_DFHQ_BLOCK));
+    for (offset = sizeof(S_STORE_HEADER); offset + sizeof(S_STORE_BLOCK) <= (uint64_t)st.st_size; offset += pBlock->size)
+    {
+        pBlock = (const S_STORE_BLOCK *)(pMap + offset);
+        if (pBlock->magic != STORE_BLOCK_MAGIC || pBlock->size != store_column_offset(STORE_COL_MAX, pBlock->numOfRows, gWidth) ||
+            offset + pBlock->size > (uint64_t)st.st_size)
+            break;
+
+        pView = &gpBlocks[gNumOfBlocks++];
+        pView->numOfRows = pBlock->numOfRows;
+        pView->pRun = (const int64_t *)((const uint8_t *)pBlock + store_column_offset(STORE_COL_RUN, pBlock->numOfRows, gWidth));
+        for (int c = STORE_COL_MODE; c <= STORE_COL_COEXIST; c++)
+            pView->pVal[c - STORE_COL_MODE] = (const int32_t *)((const uint8_t *)pBlock + store_column_offset(c, pBlock->numOfRows, gWidth));
+        pView->pPcol = (const double *)((const uint8_t *)pBlock + store_column_offset(STORE_COL_PCOL, pBlock->numOfRows, gWidth));
+        pView->pWifi = (const double *)((const uint8_t *)pBlock + store_column_offset(STORE_COL_WIFI, pBlock->numOfRows, gWidth));
+        pView->pAgents = (const float *)((const uint8_t *)pBlock + store_column_offset(STORE_COL_AGENTS, pBlock->numOfRows, gWidth));
+        gNumOfRows += pBlock->numOfRows;
+        if (pBlock->numOfRows > gMaxBlockRows)
+            gMaxBlockRows = pBlock->numOfRows;
+    }
+}
+
+// Takes the filters out of the arguments and returns the rest, in place.
+static int parse_filters(int argc, char *argv[])
+{
+    int rest = 0;
+    char *pEq, *pEnd;
+
+    for (int a = 0; a < argc; a++)
+    {
+        pEq = strchr(argv[a], '=');
+        if (pEq == NULL || strncmp(argv[a], "by=", 3) == 0 || strncmp(argv[a], "id=", 3) == 0)
+        {
+            argv[rest++] = argv[a];
+            continue;
+        }
+        if (gNumOfFilters == DFHQ_MAX_FILTERS)
+        {
+            printf("dfhq: more than %d filters. Exiting.\n", DFHQ_MAX_FILTERS);
+            exit(777);
+        }
+        gFilters[gNumOfFilters].column = find_column(argv[a], pEq - argv[a]);
+        gFilters[gNumOfFilters].lo = strtoll(pEq + 1, &pEnd, 10);
+        gFilters[gNumOfFilters].hi = gFilters[gNumOfFilters].lo;
+        if (strncmp(pEnd, "..", 2) == 0)
+            gFilters[gNumOfFilters].hi = strtoll(pEnd + 2, &pEnd, 10);
+        if (*pEnd != '\0')
+        {
+            printf("dfhq: bad filter '%s'. Exiting.\n", argv[a]);
+            exit(777);
+        }
+        gNumOfFilters++;
+    }
+    return rest;
+}
+
+// Marks the rows of the block that pass every filter, one column at a time. Returns how many do.
+static uint32_t select_rows(const S_DFHQ_BLOCK *pBlock, uint8_t *pSel)
+{
+    uint32_t n = 0;
+    int64_t v;
+
+    memset(pSel, 1, pBlock->numOfRows);
+    for (int f = 0; f < gNumOfFilters; f++)
+    {
+        for (uint32_t r = 0; r < pBlock->numOfRows; r++)
+        {
+            v = key_value(pBlock, gFilters[f].column, r);
+            pSel[r] &= (v >= gFilters[f].lo) & (v <= gFilters[f].hi);
+        }
+    }
+    for (uint32_t r = 0; r < pBlock->numOfRows; r++)
+        n += pSel[r];
+    return n;
+}
+
+/*
+ * Groups
+ */
+static void init_groups(S_DFHQ_GROUPS *pGroups, const char *pBy)
+{
+    const char *p = pBy, *pComma;
+
+    memset(pGroups, 0, sizeof(*pGroups));
+    while (*p != '\0')
+    {
+        pComma = strchr(p, ',');
+        if (pComma == NULL)
+            pComma = p + strlen(p);
+        if (pGroups->numOfKeys == DFHQ_MAX_KEYS)
+        {
+            printf("dfhq: more than %d columns in '%s'. Exiting.\n", DFHQ_MAX_KEYS, pBy);
+            exit(777);
+        }
+        pGroups->keys[pGroups->numOfKeys++] = find_column(p, pComma - p);
+        p = (*pComma == ',') ? pComma + 1 : pComma;
+    }
+    pGroups->numOfSlots = 1024;
+    pGroups->pSlots = xmalloc(pGroups->numOfSlots * sizeof(int));
+    memset(pGroups->pSlots, -1, pGroups->numOfSlots * sizeof(int));
+}
+
+static uint64_t hash_keys(const int64_t *pKeys, int numOfKeys)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (int k = 0; k < numOfKeys; k++)
+    {
+        hash ^= (uint64_t)pKeys[k];
+        hash *= 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+static void grow_groups(S_DFHQ_GROUPS *pGroups)
+{
+    int slot;
+
+    if (pGroups->numOfGroups == pGroups->maxGroups)
+    {
+        pGroups->maxGroups = pGroups->maxGroups ? pGroups->maxGroups * 2 : 256;
+        pGroups->pKeyVals = realloc(pGroups->pKeyVals, (size_t)pGroups->maxGroups * DFHQ_MAX_KEYS * sizeof(int64_t));
+        pGroups->pCount = realloc(pGroups->pCount, pGroups->maxGroups * sizeof(long long));
+        pGroups->pSum = realloc(pGroups->pSum, pGroups->maxGroups * sizeof(double));
+        pGroups->pSumSq = realloc(pGroups->pSumSq, pGroups->maxGroups * sizeof(double));
+        if (pGroups->pKeyVals == NULL || pGroups->pCount == NULL || pGroups->pSum == NULL || pGroups->pSumSq == NULL)
+        {
+            printf("dfhq: out of memory. Exiting.\n");
+            exit(777);
+        }
+    }
+    if (pGroups->numOfGroups * 2 < pGroups->numOfSlots)
+        return;
+
+    free(pGroups->pSlots);
+    pGroups->numOfSlots *= 2;
+    pGroups->pSlots = xmalloc(pGroups->numOfSlots * sizeof(int));
+    memset(pGroups->pSlots, -1, pGroups->numOfSlots * sizeof(int));
+    for (int g = 0; g < pGroups->numOfGroups; g++)
+    {
+        slot = hash_keys(&pGroups->pKeyVals[g * DFHQ_MAX_KEYS], pGroups->numOfKeys) & (pGroups->numOfSlots - 1);
+        while (pGroups->pSlots[slot] >= 0)
+            slot = (slot + 1) & (pGroups->numOfSlots - 1);
+        pGroups->pSlots[slot] = g;
+    }
+}
+
+// Group of row r of the block, added in the order groups first appear.
+static int find_group(S_DFHQ_GROUPS *pGroups, const S_DFHQ_BLOCK *pBlock, uint32_t r)
+{
+    int64_t keys[DFHQ_MAX_KEYS];
+    int slot, g;
+
+    for (int k = 0; k < pGroups->numOfKeys; k++)
+        keys[k] = key_value(pBlock, pGroups->keys[k], r);
+    slot = hash_keys(keys, pGroups->numOfKeys) & (pGroups->numOfSlots - 1);
+    while ((g = pGroups->pSlots[slot]) >= 0)
+    {
+        if (memcmp(&pGroups->pKeyVals[g * DFHQ_MAX_KEYS], keys, pGroups->numOfKeys * sizeof(int64_t)) == 0)
+            return g;
+        slot = (slot + 1) & (pGroups->numOfSlots - 1);
+    }
+
+    grow_groups(pGroups);
+    g = pGroups->numOfGroups++;
+    memcpy(&pGroups->pKeyVals[g * DFHQ_MAX_KEYS], keys, pGroups->numOfKeys * sizeof(int64_t));
+    pGroups->pCount[g] = 0;
+    pGroups->pSum[g] = 0;
+    pGroups->pSumSq[g] = 0;
+    slot = hash_keys(keys, pGroups->numOfKeys) & (pGroups->numOfSlots - 1);
+    while (pGroups->pSlots[slot] >= 0)
+        slot = (slot + 1) & (pGroups->numOfSlots - 1);
+    pGroups->pSlots[slot] = g;
+    return g;
+}
+
+// Two-sided 95% quantile of Student's t with df degrees of freedom.
+static double t_975(long long df)
+{
+    // To 10 digits: the intervals are printed to 9 places.
+    static const double table[30] = {12.706204736, 4.302652730, 3.182446305, 2.776445105, 2.570581836, 2.446911851,
+                                     2.364624252,  2.306004135, 2.262157163, 2.228138852, 2.200985160, 2.178812830,
+                                     2.160368656,  2.144786688, 2.131449546, 2.119905299, 2.109815578, 2.100922040,
+                                     2.093024054,  2.085963447, 2.079613845, 2.073873068, 2.068657610, 2.063898562,
+                                     2.059538553,  2.055529439, 2.051830516, 2.048407142, 2.045229642, 2.042272456};
+    double z = 1.959963985;
+
+    if (df < 1)
+        return NAN;
+    if (df <= 30)
+        return table[df - 1];
+    // Cornish-Fisher expansion, within 1e-5 beyond 30.
+    return z + (z * z * z + z) / (4.0 * df) + (5 * pow(z, 5) + 16 * pow(z, 3) + 3 * z) / (96.0 * df * df);
+}
+
+static void group_stats(const S_DFHQ_GROUPS *pGroups, int g, double *pMean, double *pSd, double *pCi)
+{
+    long long n = pGroups->pCount[g];
+    double var;
+
+    *pMean = pGroups->pSum[g] / n;
+    var = (n > 1) ? (pGroups->pSumSq[g] - n * *pMean * *pMean) / (n - 1) : 0;
+    *pSd = sqrt(var > 0 ? var : 0);
+    *pCi = (n > 1) ? t_975(n - 1) * *pSd / sqrt((double)n) : 0;
+}
+
+/*
+ * Commands
+ */
+static void cmd_info(const char *pPath)
+{
+    S_DFHQ_GROUPS stRuns;
+
+    init_groups(&stRuns, "run");
+    for (int b = 0; b < gNumOfBlocks; b++)
+    {
+        for (uint32_t r = 0; r < gpBlocks[b].numOfRows; r++)
+            find_group(&stRuns, &gpBlocks[b], r);
+    }
+    printf("%s: %d agents per row, %lld rows in %d blocks, %d runs\n", pPath, gWidth, gNumOfRows, gNumOfBlocks, stRuns.numOfGroups);
+}
+
+static void cmd_rows(void)
+{
+    uint8_t *pSel = xmalloc(gMaxBlockRows);
+    const S_DFHQ_BLOCK *pBlock;
+    const float *pAgents;
+
+    for (int b = 0; b < gNumOfBlocks; b++)
+    {
+        pBlock = &gpBlocks[b];
+        if (select_rows(pBlock, pSel) == 0)
+            continue;
+        for (uint32_t r = 0; r < pBlock->numOfRows; r++)
+        {
+            if (!pSel[r])
+                continue;
+            printf("M%d %d %d %d %f %f hmax%d ", pBlock->pVal[0][r], pBlock->pVal[1][r], pBlock->pVal[2][r], pBlock->pVal[3][r],
+                   pBlock->pPcol[r], pBlock->pWifi[r], pBlock->pVal[4][r]);
+            pAgents = &pBlock->pAgents[(size_t)r * gWidth];
+            for (uint32_t i = 0; i < gWidth; i++)
+                printf("%f ", pAgents[i]);
+            printf("\n");
+        }
+    }
+    free(pSel);
+}
+
+static void cmd_agg(const char *pBy)
+{
+    uint8_t *pSel = xmalloc(gMaxBlockRows);
+    const S_DFHQ_BLOCK *pBlock;
+    S_DFHQ_GROUPS stGroups;
+    double mean, sd, ci;
+    int g;
+
+    init_groups(&stGroups, pBy);
+    for (int b = 0; b < gNumOfBlocks; b++)
+    {
+        pBlock = &gpBlocks[b];
+        if (select_rows(pBlock, pSel) == 0)
+            continue;
+        for (uint32_t r = 0; r < pBlock->numOfRows; r++)
+        {
+            if (!pSel[r])
+                continue;
+            g = find_group(&stGroups, pBlock, r);
+            stGroups.pCount[g]++;
+            stGroups.pSum[g] += pBlock->pPcol[r];
+            stGroups.pSumSq[g] += pBlock->pPcol[r] * pBlock->pPcol[r];
+        }
+    }
+
+    printf("#");
+    for (int k = 0; k < stGroups.numOfKeys; k++)
+        printf("%s ", gColNames[stGroups.keys[k]]);
+    printf("n mean sd ci\n");
+    for (g = 0; g < stGroups.numOfGroups; g++)
+    {
+        group_stats(&stGroups, g, &mean, &sd, &ci);
+        for (int k = 0; k < stGroups.numOfKeys; k++)
+            printf("%lld ", (long long)stGroups.pKeyVals[g * DFHQ_MAX_KEYS + k]);
+        printf("%lld %.7g %.7g %.7g\n", stGroups.pCount[g], mean, sd, ci);
+    }
+    free(pSel);
+}
+
+// The processed/*_ci.txt layouts: sep, then value rounded to decimals places, without trailing zeros.
+static void print_fixed(const char *pSep, double value, int decimals)
+{
+    char buf[64];
+    int len = snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+
+    while (len > 1 && buf[len - 1] == '0')
+        buf[--len] = '\0';
+    if (buf[len - 1] == '.')
+        buf[--len] = '\0';
+    printf("%s%s", pSep, buf);
+}
+
+static void cmd_ci(const char *pId)
+{
+    uint8_t *pSel = xmalloc(gMaxBlockRows);
+    const S_DFHQ_BLOCK *pBlock;
+    S_DFHQ_GROUPS stGroups;
+    int *pRowGroup = xmalloc(gNumOfRows * sizeof(int));
+    double *pRowPcol = xmalloc(gNumOfRows * sizeof(double));
+    double *pValues = xmalloc(gNumOfRows * sizeof(double));
+    long long *pStart, n = 0, maxRuns = 0;
+    double mean, sd, ci;
+    const int64_t *pKey;
+
+    init_groups(&stGroups, pId ? pId : "mode,nc,na,avail,hmax");
+    if (pId != NULL && stGroups.numOfKeys != 1)
+    {
+        printf("dfhq: id= takes one column. Exiting.\n");
+        exit(777);
+    }
+    for (int b = 0; b < gNumOfBlocks; b++)
+    {
+        pBlock = &gpBlocks[b];
+        if (select_rows(pBlock, pSel) == 0)
+            continue;
+        for (uint32_t r = 0; r < pBlock->numOfRows; r++)
+        {
+            if (!pSel[r])
+                continue;
+            pRowGroup[n] = find_group(&stGroups, pBlock, r);
+            pRowPcol[n] = pBlock->pPcol[r];
+            stGroups.pCount[pRowGroup[n]]++;
+            stGroups.pSum[pRowGroup[n]] += pRowPcol[n];
+            stGroups.pSumSq[pRowGroup[n]] += pRowPcol[n] * pRowPcol[n];
+            n++;
+        }
+    }
+
+    // The runs of each group side by side, in the order they were stored (counting sort by group).
+    pStart = xmalloc((stGroups.numOfGroups + 1) * sizeof(long long));
+    pStart[0] = 0;
+    for (int g = 0; g < stGroups.numOfGroups; g++)
+    {
+        pStart[g + 1] = pStart[g] + stGroups.pCount[g];
+        if (stGroups.pCount[g] > maxRuns)
+            maxRuns = stGroups.pCount[g];
+    }
+    for (long long i = 0; i < n; i++)
+        pValues[pStart[pRowGroup[i]]++] = pRowPcol[i];
+    for (int g = stGroups.numOfGroups; g > 0; g--)
+        pStart[g] = pStart[g - 1];
+    pStart[0] = 0;
+
+    printf(pId ? "#id\tAVG\tci" : "#scheme channel agents used ch hmax avg Ci_value");
+    for (long long i = 1; i <= maxRuns; i++)
+        printf(pId ? "\t%lld" : " %lld", i);
+    printf("\n");
+    for (int g = 0; g < stGroups.numOfGroups; g++)
+    {
+        group_stats(&stGroups, g, &mean, &sd, &ci);
+        pKey = &stGroups.pKeyVals[g * DFHQ_MAX_KEYS];
+        if (pId)
+            printf("%lld", (long long)pKey[0]);
+        else
+            printf("M%lld %lld %lld %lld hmax%lld", (long long)pKey[0], (long long)pKey[1], (long long)pKey[2], (long long)pKey[3], (long long)pKey[4]);
+        // The mean to 7 places and the interval to 9, as in the reference files.
+        print_fixed(pId ? "\t" : " ", mean, 7);
+        print_fixed(pId ? "\t" : " ", ci, 9);
+        for (long long i = pStart[g]; i < pStart[g] + stGroups.pCount[g]; i++)
+            printf(pId ? "\t%g" : " %g", pValues[i]);
+        printf("\n");
+    }
+    free(pStart);
+    free(pValues);
+    free(pRowPcol);
+    free(pRowGroup);
+    free(pSel);
+}
+
+// The run of a pcol file is the time in its name, pcol_YYYYMMDD_HHMMSS*.txt, else its modification time.
+static int64_t pcol_run(const char *pPath)
+{
+    const char *pName = strrchr(pPath, '/') ? strrchr(pPath, '/') + 1 : pPath;
+    struct tm stTime;
+    struct stat st;
+
+    memset(&stTime, 0, sizeof(stTime));
+    if (sscanf(pName, "pcol_%4d%2d%2d_%2d%2d%2d", &stTime.tm_year, &stTime.tm_mon, &stTime.tm_mday, &stTime.tm_hour, &stTime.tm_min,
+               &stTime.tm_sec) == 6)
+    {
+        stTime.tm_year -= 1900;
+        stTime.tm_mon -= 1;
+        stTime.tm_isdst = -1;
+        return mktime(&stTime);
+    }
+    return (stat(pPath, &st) == 0) ? st.st_mtime : 0;
+}
+
+// Values after hmax<n> on a pcol line.
+static int count_agents(const char *pLine)
+{
+    const char *p = strstr(pLine, "hmax");
+    char *pEnd;
+    int n = 0;
+
+    if (p == NULL)
+        return 0;
+    strtol(p + 4, &pEnd, 10);
+    for (p = pEnd;; p = pEnd, n++)
+    {
+        strtod(p, &pEnd);
+        if (pEnd == p)
+            return n;
+    }
+}
+
+static void cmd_import(const char *pStore, int numOfFiles, char *files[])
+{
+    char *pLine = xmalloc(DFHQ_LINE), *p, *pEnd;
+    float *pAgents = NULL;
+    S_STORE_HEADER stHeader;
+    S_STORE_ROW stRow;
+    long long numOfRows = 0;
+    int width = 0, consumed;
+    FILE *fp;
+
+    fp = fopen(pStore, "rb");
+    if (fp != NULL)
+    {
+        if (fread(&stHeader, sizeof(stHeader), 1, fp) == 1)
+            width = stHeader.width;
+        fclose(fp);
+    }
+
+    for (int f = 0; f < numOfFiles; f++)
+    {
+        fp = fopen(files[f], "r");
+        if (fp == NULL)
+        {
+            printf("dfhq: can't open %s. Exiting.\n", files[f]);
+            exit(777);
+        }
+        memset(&stRow, 0, sizeof(stRow));
+        stRow.run = pcol_run(files[f]);
+        while (fgets(pLine, DFHQ_LINE, fp) != NULL)
+        {
+            if (sscanf(pLine, "M%d %d %d %d %lf %lf hmax%d%n", &stRow.val[0], &stRow.val[1], &stRow.val[2], &stRow.val[3], &stRow.pcol,
+                       &stRow.wifi, &stRow.val[4], &consumed) != 7)
+                continue;
+            if (width == 0)
+                width = count_agents(pLine);
+            if (pAgents == NULL)
+            {
+                result_store_open(pStore, width);
+                pAgents = xmalloc(width * sizeof(float));
+            }
+            p = pLine + consumed;
+            for (int i = 0; i < width; i++)
+            {
+                pAgents[i] = strtod(p, &pEnd);
+                p = pEnd;
+            }
+            result_store_add(&stRow, pAgents);
+            numOfRows++;
+        }
+        fclose(fp);
+        if (pAgents != NULL)
+            result_store_flush();
+    }
+    if (pAgents != NULL)
+        result_store_close();
+    printf("dfhq: %lld rows of %d files added to %s\n", numOfRows, numOfFiles, pStore);
+    free(pAgents);
+    free(pLine);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *pOption = NULL;
+    int rest;
+
+    if (argc < 3)
+    {
+        printf("usage: dfhq <store> info | rows | agg [by=<col>,...] | ci [id=<col>] [<col>=<v>[..<hi>]...]\n"
+               "       dfhq <store> import <pcol_*.txt>...\n");
+        return 1;
+    }
+    if (strcmp(argv[2], "import") == 0)
+    {
+        cmd_import(argv[1], argc - 3, &argv[3]);
+        return 0;
+    }
+
+    rest = parse_filters(argc - 3, &argv[3]);
+    for (int a = 0; a < rest; a++)
+    {
+        if (strncmp(argv[3 + a], "by=", 3) == 0 || strncmp(argv[3 + a], "id=", 3) == 0)
+            pOption = argv[3 + a] + 3;
+        else
+        {
+            printf("dfhq: unknown argument '%s'. Exiting.\n", argv[3 + a]);
+            exit(777);
+        }
+    }
+    map_store(argv[1]);
+
+    if (strcmp(argv[2], "info") == 0)
+        cmd_info(argv[1]);
+    else if (strcmp(argv[2], "rows") == 0)
+        cmd_rows();
+    else if (strcmp(argv[2], "agg") == 0)
+        cmd_agg(pOption ? pOption : "mode,nc,na,avail,hmax");
+    else if (strcmp(argv[2], "ci") == 0)
+        cmd_ci(pOption);
+    else
+    {
+        printf("dfhq: unknown command '%s'. Exiting.\n", argv[2]);
+        exit(777);
+    }
+    return 0;
+}
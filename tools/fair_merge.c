@@ -0,0 +1,94 @@
+/*
+ * Merges the fair_<time>.txt files of replicated runs written with AGENT_STATS (src/agent_stats.h).
+ *
+ *   fair_merge <fair_*.txt>...
+ *
+ * The sketches of the same sweep point (mode, nc, na, avail, hmax) are added up, and the summary of all
+ * the agents of all the runs is printed with the merged sketch, in the layout of fair_<time>.txt, so
+ * merged files can be merged again. Sweep points keep the order they first appear in.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/agent_stats.h"
+
+#define FAIR_MERGE_KEY 64
+#define FAIR_MERGE_LINE 65536
+
+typedef struct
+{
+    char key[FAIR_MERGE_KEY];
+    S_AGENT_STATS stStats;
+} S_FAIR_POINT;
+
+static S_FAIR_POINT *gpPoints;
+static int gNumOfPoints, gMaxPoints;
+
+static S_FAIR_POINT *find_point(const char *pKey)
+{
+    for (int p = 0; p < gNumOfPoints; p++)
+    {
+        if (strcmp(gpPoints[p].key, pKey) == 0)
+            return &gpPoints[p];
+    }
+    if (gNumOfPoints == gMaxPoints)
+    {
+        gMaxPoints = gMaxPoints ? gMaxPoints * 2 : 256;
+        gpPoints = realloc(gpPoints, gMaxPoints * sizeof(S_FAIR_POINT));
+        if (gpPoints == NULL)
+        {
+            printf("fair_merge: out of memory. Exiting.\n");
+            exit(777);
+        }
+    }
+    memset(&gpPoints[gNumOfPoints], 0, sizeof(S_FAIR_POINT));
+    snprintf(gpPoints[gNumOfPoints].key, FAIR_MERGE_KEY, "%s", pKey);
+    agent_stats_reset(&gpPoints[gNumOfPoints].stStats);
+    return &gpPoints[gNumOfPoints++];
+}
+
+int main(int argc, char *argv[])
+{
+    char *pLine = malloc(FAIR_MERGE_LINE), key[FAIR_MERGE_KEY] = "";
+    S_AGENT_STATS stStats;
+    S_FAIR_POINT *pPoint;
+    int mode, nc, na, avail, hmax;
+    FILE *fp;
+
+    if (argc < 2 || pLine == NULL)
+    {
+        printf("usage: fair_merge <fair_*.txt>...\n");
+        return 1;
+    }
+    for (int f = 1; f < argc; f++)
+    {
+        fp = fopen(argv[f], "r");
+        if (fp == NULL)
+        {
+            printf("fair_merge: can't open %s. Exiting.\n", argv[f]);
+            exit(777);
+        }
+        // A summary line names the sweep point of the sketch line after it.
+        while (fgets(pLine, FAIR_MERGE_LINE, fp) != NULL)
+        {
+            if (sscanf(pLine, "M%d %d %d %d hmax%d", &mode, &nc, &na, &avail, &hmax) == 5)
+                snprintf(key, sizeof(key), "M%d %d %d %d hmax%d", mode, nc, na, avail, hmax);
+            else if (key[0] != '\0' && agent_stats_read(pLine, &stStats))
+            {
+                pPoint = find_point(key);
+                agent_stats_merge(&pPoint->stStats, &stStats);
+                key[0] = '\0';
+            }
+        }
+        fclose(fp);
+    }
+
+    printf("# mode nc na avail hmax n jain mean min p05 q1 median q3 p95 max whisker_lo whisker_hi outliers, then its sketch (agent_stats.h)\n");
+    for (int p = 0; p < gNumOfPoints; p++)
+        agent_stats_write(stdout, gpPoints[p].key, &gpPoints[p].stStats);
+    free(gpPoints);
+    free(pLine);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Merges the retx_<time>.txt files of replicated runs written with RUN_LENGTH (src/run_length.h).
+ *
+ *   retx_merge <retx_*.txt>...
+ *
+ * The histograms of the same sweep point (mode, nc, na, avail, hmax) are added up and printed with their
+ * CDF in the layout of retx_<time>.txt, so merged files can be merged again. Sweep points keep the order
+ * they first appear in.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/run_length.h"
+
+#define RETX_MERGE_KEY 64
+
+typedef struct
+{
+    char key[RETX_MERGE_KEY];
+    S_RUN_HIST stHist;
+} S_RETX_POINT;
+
+static S_RETX_POINT *gpPoints;
+static int gNumOfPoints, gMaxPoints;
+
+static S_RETX_POINT *find_point(const char *pKey)
+{
+    for (int p = 0; p < gNumOfPoints; p++)
+    {
+        if (strcmp(gpPoints[p].key, pKey) == 0)
+            return &gpPoints[p];
+    }
+    if (gNumOfPoints == gMaxPoints)
+    {
+        gMaxPoints = gMaxPoints ? gMaxPoints * 2 : 64;
+        gpPoints = realloc(gpPoints, gMaxPoints * sizeof(S_RETX_POINT));
+        if (gpPoints == NULL)
+        {
+            printf("retx_merge: out of memory. Exiting.\n");
+            exit(777);
+        }
+    }
+    snprintf(gpPoints[gNumOfPoints].key, RETX_MERGE_KEY, "%s", pKey);
+    run_hist_reset(&gpPoints[gNumOfPoints].stHist);
+    return &gpPoints[gNumOfPoints++];
+}
+
+int main(int argc, char *argv[])
+{
+    static S_RUN_HIST stHist;
+    char key[RETX_MERGE_KEY];
+    FILE *fp;
+
+    if (argc < 2)
+    {
+        printf("usage: retx_merge <retx_*.txt>...\n");
+        return 1;
+    }
+    for (int f = 1; f < argc; f++)
+    {
+        fp = fopen(argv[f], "r");
+        if (fp == NULL)
+        {
+            printf("retx_merge: can't open %s. Exiting.\n", argv[f]);
+            exit(777);
+        }
+        while (run_hist_read(fp, key, sizeof(key), &stHist))
+            run_hist_merge(&find_point(key)->stHist, &stHist);
+        fclose(fp);
+    }
+
+    printf("# mode nc na avail hmax, then run_length runs cdf (run_length.h)\n");
+    for (int p = 0; p < gNumOfPoints; p++)
+        run_hist_write(stdout, gpPoints[p].key, &gpPoints[p].stHist);
+    free(gpPoints);
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Converts a text capture of channel occupancy into the binary trace read by TRACE_REPLAY.
+ *
+ *   trace_convert <capture.txt> <trace.bin> [<slots>]
+ *
+ * Each line of the capture is one busy slot, in increasing slot order:
+ *
+ *   <slot> <ch> [<ch> ...]   busy channels, 1-based
+ *   <slot> <79 x '0'/'1'>    occupancy of channels 1..79
+ *
+ * Slots that are not listed are idle. Lines starting with '#' are skipped. The trace ends after the
+ * last listed slot, or after <slots> slots if that is given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "../src/trace_replay.h"
+
+static void set_channel(S_TRACE_RECORD *pRecord, int channel, long lineNo)
+{
+    if (channel < 1 || channel > 79)
+    {
+        printf("line %ld: channel %d is not in 1..79. Exiting.\n", lineNo, channel);
+        exit(777);
+    }
+    pRecord->mask[(channel - 1) >> 6] |= 1ULL << ((channel - 1) & 63);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in, *out;
+    char line[1024], *pTok, *pEnd;
+    S_TRACE_HEADER stHeader = {TRACE_MAGIC, TRACE_VERSION, 0};
+    S_TRACE_RECORD stIdle = {{0, 0}}, stRecord;
+    uint64_t slot, numOfSlots = 0;
+    long lineNo = 0;
+
+    if (argc < 3)
+    {
+        printf("usage: %s <capture.txt> <trace.bin> [<slots>]\n", argv[0]);
+        return 1;
+    }
+    in = fopen(argv[1], "r");
+    out = fopen(argv[2], "wb");
+    if (in == NULL || out == NULL)
+    {
+        printf("Can't open %s or %s. Exiting.\n", argv[1], argv[2]);
+        exit(777);
+    }
+
+    // numOfSlots is filled in at the end.
+    fwrite(&stHeader, sizeof(stHeader), 1, out);
+
+    while (fgets(line, sizeof(line), in) != NULL)
+    {
+        lineNo++;
+        pTok = strtok(line, " \t\r\n");
+        if (pTok == NULL || pTok[0] == '#')
+            continue;
+
+        slot = strtoull(pTok, &pEnd, 10);
+        if (*pEnd != '\0' || slot < numOfSlots)
+        {
+            printf("line %ld: slot '%s' is not a number after slot %llu. Exiting.\n", lineNo, pTok, (unsigned long long)numOfSlots);
+            exit(777);
+        }
+
+        // Idle slots up to this one.
+        for (; numOfSlots < slot; numOfSlots++)
+            fwrite(&stIdle, sizeof(stIdle), 1, out);
+
+        memset(&stRecord, 0, sizeof(stRecord));
+        while ((pTok = strtok(NULL, " \t\r\n")) != NULL)
+        {
+            if (strlen(pTok) == 79 && strspn(pTok, "01") == 79)
+            {
+                for (int ch = 1; ch <= 79; ch++)
+                {
+                    if (pTok[ch - 1] == '1')
+                        set_channel(&stRecord, ch, lineNo);
+                }
+            }
+            else
+            {
+                set_channel(&stRecord, atoi(pTok), lineNo);
+            }
+        }
+        fwrite(&stRecord, sizeof(stRecord), 1, out);
+        numOfSlots = slot + 1;
+    }
+
+    if (argc > 3)
+    {
+        for (; numOfSlots < strtoull(argv[3], NULL, 10); numOfSlots++)
+            fwrite(&stIdle, sizeof(stIdle), 1, out);
+    }
+
+    stHeader.numOfSlots = numOfSlots;
+    fseek(out, 0, SEEK_SET);
+    fwrite(&stHeader, sizeof(stHeader), 1, out);
+    fclose(out);
+    fclose(in);
+
+    printf("%s: %llu slots\n", argv[2], (unsigned long long)numOfSlots);
+
+    return 0;
+}